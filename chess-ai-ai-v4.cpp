@@ -1,3 +1,5 @@
+// Build: g++ -std=c++17 -O2 -pthread chess-ai-ai-v4.cpp -o chess-ai
+
 #include <iostream>
 #include <vector>
 #include <string>
@@ -14,22 +16,72 @@
 #include <iomanip>
 #include <fstream>
 #include <ctime>
+#include <deque>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <atomic>
+#include <cmath>
+#include <string_view>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CHESS_AVX2_KERNEL 1
+#endif
 
 using namespace std;
 
 // ============= ENHANCED AI TUNING PARAMETERS =============
 
-// Piece values for AI evaluation (centipawns)
+// Piece values for AI evaluation (centipawns), in a flat table indexed by
+// the piece character
 struct PieceValues {
     static int get(char piece) {
-        static map<char, int> values;
-        if (values.empty()) {
-            values['P'] = 100; values['N'] = 320; values['B'] = 330;
-            values['R'] = 500; values['Q'] = 900; values['K'] = 20000;
-            values['p'] = -100; values['n'] = -320; values['b'] = -330;
-            values['r'] = -500; values['q'] = -900; values['k'] = -20000;
-        }
-        return values[piece];
+        return table().values[(unsigned char)piece & 127];
+    }
+    
+    // Sets a white piece's value and the negated black one. Only for use at
+    // startup, before any game runs.
+    static void set(char white_piece, int value) {
+        table().values[(unsigned char)white_piece] = value;
+        table().values[tolower(static_cast<unsigned char>(white_piece))] = -value;
+    }
+
+private:
+    struct Table {
+        alignas(64) int values[128];
+    };
+    
+    static Table& table() {
+        // Built once on first use; static initialization is thread-safe, so
+        // games running on scheduler threads can share the table.
+        static Table values = build();
+        return values;
+    }
+    
+    static Table build() {
+        Table t;
+        memset(t.values, 0, sizeof(t.values));
+        t.values['P'] = 100; t.values['N'] = 320; t.values['B'] = 330;
+        t.values['R'] = 500; t.values['Q'] = 900; t.values['K'] = 20000;
+        t.values['p'] = -100; t.values['n'] = -320; t.values['b'] = -330;
+        t.values['r'] = -500; t.values['q'] = -900; t.values['k'] = -20000;
+        return t;
     }
 };
 
@@ -111,6 +163,69 @@ int KING_END_TABLE[8][8] = {
     {-50,-30,-30,-30,-30,-30,-30,-50}
 };
 
+// Evaluation terms are packed midgame/endgame pairs: the endgame half lives in
+// the upper 16 bits and the midgame half in the lower 16, so both phases are
+// accumulated with a single add and only split when the score is tapered.
+typedef int32_t Score;
+
+inline Score make_score(int mg, int eg) {
+    return (Score)((uint32_t)eg << 16) + mg;
+}
+
+inline int mg_value(Score s) {
+    return (int16_t)(uint16_t)(uint32_t)s;
+}
+
+inline int eg_value(Score s) {
+    return (int16_t)(uint16_t)((uint32_t)(s + 0x8000) >> 16);
+}
+
+// Game phase: 24 with all minor and major pieces on the board, 0 with none
+const int MAX_PHASE = 24;
+const int PHASE_WEIGHT[12] = { 0, 1, 1, 2, 4, 0, 0, 1, 1, 2, 4, 0 };
+
+// Evaluation table baked from the ones above, indexed by piece_index() and
+// square (row * 8 + col). It is colour-flipped for black and has the material
+// value folded in, so material + PST is one add per piece. Only the king uses
+// different middlegame and endgame tables.
+alignas(64) Score PSQ[12][64];
+
+// The same table split into 16-bit midgame/endgame halves for the SIMD kernel
+alignas(32) int16_t PSQ_MG16[12][64];
+alignas(32) int16_t PSQ_EG16[12][64];
+
+void init_piece_square_tables() {
+    const char white_pieces[] = "PNBRQK";
+    int (*tables[6])[8] = {
+        PAWN_TABLE, KNIGHT_TABLE, BISHOP_TABLE, ROOK_TABLE, QUEEN_TABLE, KING_MIDDLE_TABLE
+    };
+    
+    for (int t = 0; t < 6; t++) {
+        char white = white_pieces[t];
+        char black = tolower(static_cast<unsigned char>(white));
+        for (int sq = 0; sq < 64; sq++) {
+            int row = sq / 8;
+            int col = sq % 8;
+            int white_bonus = tables[t][7 - row][col];
+            int black_bonus = tables[t][row][col];
+            int white_end = (white == 'K') ? KING_END_TABLE[7 - row][col] : white_bonus;
+            int black_end = (white == 'K') ? KING_END_TABLE[row][col] : black_bonus;
+            
+            PSQ[t][sq] = make_score(PieceValues::get(white) + white_bonus,
+                                    PieceValues::get(white) + white_end);
+            PSQ[t + 6][sq] = make_score(PieceValues::get(black) - black_bonus,
+                                        PieceValues::get(black) - black_end);
+        }
+    }
+    
+    for (int p = 0; p < 12; p++) {
+        for (int sq = 0; sq < 64; sq++) {
+            PSQ_MG16[p][sq] = (int16_t)mg_value(PSQ[p][sq]);
+            PSQ_EG16[p][sq] = (int16_t)eg_value(PSQ[p][sq]);
+        }
+    }
+}
+
 // Utility structures
 struct Position {
     int row, col;
@@ -149,1183 +264,8755 @@ bool compare_move_scores(const MoveScore& a, const MoveScore& b) {
     return a.score > b.score;
 }
 
-// Helper function to repeat a string
-string repeat_string(const string& str, int times) {
-    string result;
-    for (int i = 0; i < times; i++) {
-        result += str;
+// ============= ZOBRIST HASHING & TRANSPOSITION TABLE =============
+
+// Piece index used by hashing tables: white PNBRQK = 0-5, black pnbrqk = 6-11
+inline int piece_index(char piece) {
+    switch (piece) {
+        case 'P': return 0; case 'N': return 1; case 'B': return 2;
+        case 'R': return 3; case 'Q': return 4; case 'K': return 5;
+        case 'p': return 6; case 'n': return 7; case 'b': return 8;
+        case 'r': return 9; case 'q': return 10; case 'k': return 11;
     }
-    return result;
+    return -1;
 }
 
-class Chess {
-private:
-    vector<vector<char> > board;
-    string current_player;
-    vector<string> move_history;
-    vector<string> pgn_moves;
-    map<string, vector<char> > captured_pieces;
-    string winner;
-    int difficulty_ai1;
-    int difficulty_ai2;
+// Zobrist keys come from a fixed-seed generator so every process computes
+// the same key for a position (required for a shared transposition table).
+struct ZobristKeys {
+    uint64_t pieces[12][64];
+    uint64_t castling[16];
+    uint64_t en_passant[8];
+    uint64_t black_to_move;
     
-    Position white_king_pos;
-    Position black_king_pos;
-    bool white_can_castle_kingside;
-    bool white_can_castle_queenside;
-    bool black_can_castle_kingside;
-    bool black_can_castle_queenside;
-    Position en_passant_target;
-    
-    int white_wins;
-    int black_wins;
-    int draws;
-    int total_games;
-    
-    mt19937 gen;
-    
-    string last_game_pgn;
+    ZobristKeys() {
+        uint64_t state = 0x2545F4914F6CDD1DULL;
+        for (int p = 0; p < 12; p++) {
+            for (int sq = 0; sq < 64; sq++) {
+                pieces[p][sq] = next(state);
+            }
+        }
+        for (int i = 0; i < 16; i++) castling[i] = next(state);
+        for (int i = 0; i < 8; i++) en_passant[i] = next(state);
+        black_to_move = next(state);
+    }
     
-    // AI search statistics
-    int nodes_searched;
-
-public:
-    Chess() {
-        random_device rd;
-        gen.seed(rd());
-        
-        board = init_board();
-        current_player = "white";
-        winner = "";
-        difficulty_ai1 = 2;
-        difficulty_ai2 = 2;
-        
-        white_king_pos = Position(7, 4);
-        black_king_pos = Position(0, 4);
-        white_can_castle_kingside = true;
-        white_can_castle_queenside = true;
-        black_can_castle_kingside = true;
-        black_can_castle_queenside = true;
-        
-        white_wins = 0;
-        black_wins = 0;
-        draws = 0;
-        total_games = 0;
-        nodes_searched = 0;
-        
-        captured_pieces["white"] = vector<char>();
-        captured_pieces["black"] = vector<char>();
+    // splitmix64
+    static uint64_t next(uint64_t& state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
     }
+};
+
+const ZobristKeys ZOBRIST;
+
+enum TTFlag { TT_EXACT = 0, TT_LOWER = 1, TT_UPPER = 2 };
+
+// Entries are validated locklessly: the key is stored XORed with the data
+// word, so a torn write from another thread or process reads as a miss.
+struct TTEntry {
+    atomic<uint64_t> check;
+    atomic<uint64_t> data;
+};
+
+struct TTProbe {
+    int score;
+    int depth;
+    int flag;
+    int from_sq;  // 64 when no move is stored
+    int to_sq;
+};
+
+// Header at the start of a shared-memory table so attaching processes agree
+// on its size
+struct SharedTTHeader {
+    atomic<uint64_t> magic;
+    uint64_t num_entries;
+    char padding[48];
+};
+
+const uint64_t SHARED_TT_MAGIC = 0x43485454414231ULL;  // "CHTTAB1"
+
+class TranspositionTable {
+private:
+    TTEntry* entries;
+    size_t mask;
+    TTEntry* local_storage;
+    void* mapping;
+    size_t mapping_size;
+    string shm_name;
+    bool shm_owner;
     
-    vector<vector<char> > init_board() {
-        vector<vector<char> > b(8, vector<char>(8, ' '));
-        
-        char black_back[] = {'r', 'n', 'b', 'q', 'k', 'b', 'n', 'r'};
-        char black_pawns[] = {'p', 'p', 'p', 'p', 'p', 'p', 'p', 'p'};
-        for (int i = 0; i < 8; i++) {
-            b[0][i] = black_back[i];
-            b[1][i] = black_pawns[i];
-        }
-        
-        char white_pawns[] = {'P', 'P', 'P', 'P', 'P', 'P', 'P', 'P'};
-        char white_back[] = {'R', 'N', 'B', 'Q', 'K', 'B', 'N', 'R'};
-        for (int i = 0; i < 8; i++) {
-            b[6][i] = white_pawns[i];
-            b[7][i] = white_back[i];
-        }
-        
-        return b;
+    static uint64_t pack(int score, int depth, int flag, int from_sq, int to_sq) {
+        score = max(-32767, min(32767, score));
+        return (uint64_t)(uint16_t)(int16_t)score |
+               ((uint64_t)(uint8_t)depth << 16) |
+               ((uint64_t)flag << 24) |
+               ((uint64_t)from_sq << 32) |
+               ((uint64_t)to_sq << 40);
     }
     
-    void clear_screen() {
-        #ifdef _WIN32
-            system("cls");
-        #else
-            system("clear");
-        #endif
+    static size_t entries_for(size_t megabytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(TTEntry) <= megabytes * 1024 * 1024) count *= 2;
+        return count;
     }
+
+public:
+    TranspositionTable() : entries(NULL), mask(0), local_storage(NULL), mapping(NULL), 
+                           mapping_size(0), shm_owner(false) {}
     
-    string get_piece_symbol(char piece) {
-        static map<char, string> symbols;
-        if (symbols.empty()) {
-            symbols['K'] = "♔"; symbols['Q'] = "♕"; symbols['R'] = "♖";
-            symbols['B'] = "♗"; symbols['N'] = "♘"; symbols['P'] = "♙";
-            symbols['k'] = "♚"; symbols['q'] = "♛"; symbols['r'] = "♜";
-            symbols['b'] = "♝"; symbols['n'] = "♞"; symbols['p'] = "♟";
-            symbols[' '] = "·";
+    ~TranspositionTable() { release(); }
+    
+    void release() {
+        delete[] local_storage;
+        local_storage = NULL;
+#ifndef _WIN32
+        if (mapping) {
+            munmap(mapping, mapping_size);
+            if (shm_owner) shm_unlink(shm_name.c_str());
         }
-        return symbols[piece];
+#endif
+        mapping = NULL;
+        entries = NULL;
+        mask = 0;
+        shm_owner = false;
     }
     
-    void display_board() {
-        clear_screen();
-        
-        cout << "\n" << string(50, '=') << endl;
-        cout << "   CHESS - " << current_player << "'s Turn" << endl;
-        cout << string(50, '=') << endl;
+    void resize(size_t megabytes) {
+        release();
+        size_t count = entries_for(megabytes);
+        local_storage = new TTEntry[count]();
+        entries = local_storage;
+        mask = count - 1;
+    }
+
+#ifndef _WIN32
+    // Backs the table with a POSIX shared-memory segment so cooperating
+    // processes on the same host share it. The first process creates and
+    // sizes the segment (and unlinks it on release); others attach to it.
+    bool attach_shared(const string& name, size_t megabytes) {
+        release();
+        shm_name = (!name.empty() && name[0] == '/') ? name : "/" + name;
+        size_t count = entries_for(megabytes);
         
-        cout << "\n    a  b  c  d  e  f  g  h" << endl;
-        cout << "  ┌" << repeat_string("─", 24) << "┐" << endl;
+        bool created = true;
+        int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            created = false;
+            fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+        }
+        if (fd < 0) return false;
         
-        for (int i = 0; i < 8; i++) {
-            cout << (8 - i) << " │";
-            for (int j = 0; j < 8; j++) {
-                char piece = board[i][j];
-                cout << " " << get_piece_symbol(piece) << " ";
+        if (created) {
+            mapping_size = sizeof(SharedTTHeader) + count * sizeof(TTEntry);
+            if (ftruncate(fd, mapping_size) < 0) {
+                close(fd);
+                shm_unlink(shm_name.c_str());
+                return false;
             }
-            cout << "│ " << (8 - i) << endl;
+        } else {
+            // Wait briefly for the creator to finish sizing the segment
+            struct stat st;
+            for (int tries = 0; tries < 100; tries++) {
+                if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(SharedTTHeader)) break;
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+            if (fstat(fd, &st) < 0 || (size_t)st.st_size <= sizeof(SharedTTHeader)) {
+                close(fd);
+                return false;
+            }
+            mapping_size = st.st_size;
         }
         
-        cout << "  └" << repeat_string("─", 24) << "┘" << endl;
-        cout << "    a  b  c  d  e  f  g  h\n" << endl;
+        mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = NULL;
+            if (created) shm_unlink(shm_name.c_str());
+            return false;
+        }
         
-        if (!captured_pieces["white"].empty() || !captured_pieces["black"].empty()) {
-            cout << "Captured pieces:" << endl;
-            if (!captured_pieces["black"].empty()) {
-                cout << "  White captured: ";
-                for (size_t i = 0; i < captured_pieces["black"].size(); i++) {
-                    cout << get_piece_symbol(captured_pieces["black"][i]) << " ";
-                }
-                cout << endl;
+        SharedTTHeader* header = static_cast<SharedTTHeader*>(mapping);
+        if (created) {
+            header->num_entries = count;
+            header->magic.store(SHARED_TT_MAGIC, memory_order_release);
+        } else {
+            for (int tries = 0; tries < 100 && header->magic.load(memory_order_acquire) != SHARED_TT_MAGIC; tries++) {
+                this_thread::sleep_for(chrono::milliseconds(10));
             }
-            if (!captured_pieces["white"].empty()) {
-                cout << "  Black captured: ";
-                for (size_t i = 0; i < captured_pieces["white"].size(); i++) {
-                    cout << get_piece_symbol(captured_pieces["white"][i]) << " ";
-                }
-                cout << endl;
+            count = header->num_entries;
+            if (header->magic.load(memory_order_acquire) != SHARED_TT_MAGIC ||
+                (count & (count - 1)) != 0 ||
+                sizeof(SharedTTHeader) + count * sizeof(TTEntry) > mapping_size) {
+                munmap(mapping, mapping_size);
+                mapping = NULL;
+                return false;
             }
-            cout << endl;
         }
         
-        if (!move_history.empty()) {
-            cout << "Last move: " << move_history.back() << "\n" << endl;
-        }
+        shm_owner = created;
+        entries = reinterpret_cast<TTEntry*>(static_cast<char*>(mapping) + sizeof(SharedTTHeader));
+        mask = count - 1;
+        return true;
     }
+#endif
+
+    bool is_shared() const { return mapping != NULL; }
+    size_t size() const { return entries ? mask + 1 : 0; }
     
-    bool is_valid_position(int row, int col) const {
-        return row >= 0 && row < 8 && col >= 0 && col < 8;
+    bool probe(uint64_t key, TTProbe& result) const {
+        if (!entries) return false;
+        const TTEntry& entry = entries[key & mask];
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        uint64_t check = entry.check.load(memory_order_relaxed);
+        if ((check ^ data) != key) return false;
+        
+        result.score = (int16_t)(data & 0xFFFF);
+        result.depth = (int)((data >> 16) & 0xFF);
+        result.flag = (int)((data >> 24) & 0xFF);
+        result.from_sq = (int)((data >> 32) & 0xFF);
+        result.to_sq = (int)((data >> 40) & 0xFF);
+        return true;
     }
     
-    bool is_white_piece(char piece) const {
-        return piece != ' ' && isupper(static_cast<unsigned char>(piece));
+    // Depth-preferred replacement within a slot; different positions always replace
+    void store(uint64_t key, int score, int depth, int flag, int from_sq, int to_sq) {
+        if (!entries) return;
+        TTEntry& entry = entries[key & mask];
+        uint64_t old_data = entry.data.load(memory_order_relaxed);
+        uint64_t old_check = entry.check.load(memory_order_relaxed);
+        if ((old_check ^ old_data) == key && (int)((old_data >> 16) & 0xFF) > depth) return;
+        
+        uint64_t data = pack(score, depth, flag, from_sq, to_sq);
+        entry.data.store(data, memory_order_relaxed);
+        entry.check.store(key ^ data, memory_order_relaxed);
     }
+};
+
+// Process-wide table shared by every game (and scheduler thread) in this process
+TranspositionTable TT;
+
+// ============= BITBOARDS & PAWN MASKS =============
+
+// Bitboards use the board's square numbering: bit (row * 8 + col), so bit 0
+// is a8 and white pawns advance towards lower rows.
+const uint64_t FILE_A_BB = 0x0101010101010101ULL;
+const uint64_t FILE_H_BB = FILE_A_BB << 7;
+const uint64_t LIGHT_SQUARES_BB = 0xAA55AA55AA55AA55ULL;   // a8, c8, ..., h1
+
+inline int popcount(uint64_t b) {
+    return __builtin_popcountll(b);
+}
+
+inline int lsb(uint64_t b) {
+    return __builtin_ctzll(b);
+}
+
+// Whether b has more than n squares. Clears at most n bits, so for the
+// small piece-count caps it is cheaper than a full population count.
+inline bool has_more_than(uint64_t b, int n) {
+    for (; n > 0 && b; n--) b &= b - 1;
+    return b != 0;
+}
+
+// Bit f set for every file f that holds at least one square of b
+inline int file_occupancy(uint64_t b) {
+    b |= b >> 32;
+    b |= b >> 16;
+    b |= b >> 8;
+    return (int)(b & 0xFF);
+}
+
+inline uint64_t white_pawn_attacks(uint64_t pawns) {
+    return ((pawns >> 9) & ~FILE_H_BB) | ((pawns >> 7) & ~FILE_A_BB);
+}
+
+inline uint64_t black_pawn_attacks(uint64_t pawns) {
+    return ((pawns << 7) & ~FILE_H_BB) | ((pawns << 9) & ~FILE_A_BB);
+}
+
+// Every square of b and all squares towards row 0 (white's forward
+// direction) or row 7 (black's) from them
+inline uint64_t north_fill(uint64_t b) {
+    b |= b >> 8;
+    b |= b >> 16;
+    b |= b >> 32;
+    return b;
+}
+
+inline uint64_t south_fill(uint64_t b) {
+    b |= b << 8;
+    b |= b << 16;
+    b |= b << 32;
+    return b;
+}
+
+// Squares one file either side of those of b
+inline uint64_t adjacent_files_of(uint64_t b) {
+    return ((b << 1) & ~FILE_A_BB) | ((b >> 1) & ~FILE_H_BB);
+}
+
+// Sum of the rows of b's squares, from the three bits of the row number
+inline int row_sum(uint64_t b) {
+    return popcount(b & 0xFF00FF00FF00FF00ULL) + 2 * popcount(b & 0xFFFF0000FFFF0000ULL) + 
+           4 * popcount(b & 0xFFFFFFFF00000000ULL);
+}
+
+// Pawn structure weights. These and the other weights below can be replaced
+// at startup from a parameter file (see load_eval_params()).
+// Isolated and backward pawns are detected (and traced for the tuner) but
+// carry no weight unless a parameter file gives them one.
+Score DOUBLED_PAWN = make_score(-20, -20);
+Score ISOLATED_PAWN = make_score(0, 0);
+Score BACKWARD_PAWN = make_score(0, 0);
+int PASSED_PAWN_PER_RANK = 10;
+
+// Piece activity weights, per safe square attacked (N, B, R, Q)
+Score MOBILITY_WEIGHT[4] = {
+    make_score(3, 3), make_score(3, 3), make_score(3, 3), make_score(3, 3)
+};
+Score KING_EXPOSED = make_score(-15, 0);
+Score KING_ZONE_ATTACK = make_score(-8, 0);   // per attacked square next to the king
+Score HANGING_PIECE = make_score(-25, -15);   // attacked and undefended minor/major
+Score ROOK_OPEN_FILE = make_score(20, 10);
+Score ROOK_SEMI_OPEN_FILE = make_score(10, 5);
+
+// Largest swing the expensive evaluation terms (mobility, pawn structure,
+// king safety, hanging pieces) are assumed to make; lazy evaluation exits
+// beyond it. Set for the default weights and rescaled by apply_eval_params().
+const int DEFAULT_LAZY_EVAL_MARGIN = 400;
+int LAZY_EVAL_MARGIN = DEFAULT_LAZY_EVAL_MARGIN;
+
+int score_magnitude(Score s) {
+    return max(abs(mg_value(s)), abs(eg_value(s)));
+}
+
+// Sum of the expensive terms' weight magnitudes, which the lazy margin is
+// taken to be proportional to
+int expensive_term_weight() {
+    int total = score_magnitude(DOUBLED_PAWN) + score_magnitude(ISOLATED_PAWN) + 
+                score_magnitude(BACKWARD_PAWN) + abs(PASSED_PAWN_PER_RANK) + 
+                score_magnitude(KING_EXPOSED) + score_magnitude(KING_ZONE_ATTACK) + 
+                score_magnitude(HANGING_PIECE) + score_magnitude(ROOK_OPEN_FILE) + 
+                score_magnitude(ROOK_SEMI_OPEN_FILE);
+    for (int p = 0; p < 4; p++) total += score_magnitude(MOBILITY_WEIGHT[p]);
+    return total;
+}
+
+// ============= ATTACK MAPS =============
+
+inline int msb(uint64_t b) {
+    return 63 - __builtin_clzll(b);
+}
+
+// Leaper attacks and sliding rays per square, generated at compile time.
+// Ray directions 0-3 step towards lower square numbers (N, W, NW, NE) and
+// 4-7 towards higher ones (S, E, SW, SE).
+struct AttackTables {
+    uint64_t knight[64];
+    uint64_t king[64];
+    uint64_t rays[8][64];
+};
+
+constexpr AttackTables build_attack_tables() {
+    AttackTables t{};
+    const int knight_deltas[8][2] = {
+        {-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1}
+    };
+    const int ray_deltas[8][2] = {
+        {-1, 0}, {0, -1}, {-1, -1}, {-1, 1}, {1, 0}, {0, 1}, {1, -1}, {1, 1}
+    };
     
-    bool is_black_piece(char piece) const {
-        return piece != ' ' && islower(static_cast<unsigned char>(piece));
+    for (int sq = 0; sq < 64; sq++) {
+        int row = sq / 8;
+        int col = sq % 8;
+        for (int i = 0; i < 8; i++) {
+            int r = row + knight_deltas[i][0];
+            int c = col + knight_deltas[i][1];
+            if (r >= 0 && r < 8 && c >= 0 && c < 8) t.knight[sq] |= 1ULL << (r * 8 + c);
+            
+            r = row + ray_deltas[i][0];
+            c = col + ray_deltas[i][1];
+            if (r >= 0 && r < 8 && c >= 0 && c < 8) t.king[sq] |= 1ULL << (r * 8 + c);
+            while (r >= 0 && r < 8 && c >= 0 && c < 8) {
+                t.rays[i][sq] |= 1ULL << (r * 8 + c);
+                r += ray_deltas[i][0];
+                c += ray_deltas[i][1];
+            }
+        }
     }
-    
-    string get_piece_color(char piece) const {
-        if (piece == ' ') return "";
-        return is_white_piece(piece) ? "white" : "black";
+    return t;
+}
+
+constexpr AttackTables ATTACKS = build_attack_tables();
+
+inline uint64_t ray_attacks(int dir, int sq, uint64_t occupied) {
+    uint64_t attacks = ATTACKS.rays[dir][sq];
+    uint64_t blockers = attacks & occupied;
+    if (blockers) {
+        int first = (dir < 4) ? msb(blockers) : lsb(blockers);
+        attacks ^= ATTACKS.rays[dir][first];
     }
-    
-    vector<Position> get_pawn_moves(int row, int col, char piece) {
-        vector<Position> moves;
-        int direction = is_white_piece(piece) ? -1 : 1;
-        int start_row = is_white_piece(piece) ? 6 : 1;
-        
-        int new_row = row + direction;
-        if (is_valid_position(new_row, col) && board[new_row][col] == ' ') {
-            moves.push_back(Position(new_row, col));
-            
-            if (row == start_row) {
-                int new_row2 = row + 2 * direction;
-                if (board[new_row2][col] == ' ') {
-                    moves.push_back(Position(new_row2, col));
-                }
-            }
-        }
+    return attacks;
+}
+
+inline uint64_t rook_attacks(int sq, uint64_t occupied) {
+    return ray_attacks(0, sq, occupied) | ray_attacks(1, sq, occupied) |
+           ray_attacks(4, sq, occupied) | ray_attacks(5, sq, occupied);
+}
+
+inline uint64_t bishop_attacks(int sq, uint64_t occupied) {
+    return ray_attacks(2, sq, occupied) | ray_attacks(3, sq, occupied) |
+           ray_attacks(6, sq, occupied) | ray_attacks(7, sq, occupied);
+}
+
+// Attack information computed once per evaluation and shared by the
+// mobility, king safety and hanging-piece terms. Colour 0 = white.
+struct AttackInfo {
+    uint64_t occupied[2];
+    uint64_t pawn_attacks[2];
+    uint64_t by_color[2];   // every square attacked by the colour, pawns included
+    int safe_squares[2][4]; // mobility per piece type (N, B, R, Q)
+};
+
+void compute_attacks(const uint64_t bb[12], AttackInfo& info) {
+    for (int c = 0; c < 2; c++) {
+        info.occupied[c] = 0;
+        for (int p = 0; p < 6; p++) info.occupied[c] |= bb[c * 6 + p];
+    }
+    info.pawn_attacks[0] = white_pawn_attacks(bb[0]);
+    info.pawn_attacks[1] = black_pawn_attacks(bb[6]);
+    uint64_t occupied = info.occupied[0] | info.occupied[1];
+    
+    for (int c = 0; c < 2; c++) {
+        int base = c * 6;
+        // Squares a piece can use without landing on its own men or on a
+        // square guarded by an enemy pawn
+        uint64_t safe = ~info.occupied[c] & ~info.pawn_attacks[c ^ 1];
+        uint64_t attacked = info.pawn_attacks[c];
+        if (bb[base + 5]) attacked |= ATTACKS.king[lsb(bb[base + 5])];
         
-        int deltas[] = {-1, 1};
-        for (int d = 0; d < 2; d++) {
-            int dc = deltas[d];
-            new_row = row + direction;
-            int new_col = col + dc;
-            if (is_valid_position(new_row, new_col)) {
-                char target = board[new_row][new_col];
-                if (target != ' ' && get_piece_color(target) != get_piece_color(piece)) {
-                    moves.push_back(Position(new_row, new_col));
-                }
-                else if (en_passant_target.has_value() && 
-                         en_passant_target.row == new_row && 
-                         en_passant_target.col == new_col) {
-                    moves.push_back(Position(new_row, new_col));
-                }
+        for (int p = 0; p < 4; p++) {
+            int count = 0;
+            for (uint64_t b = bb[base + 1 + p]; b; b &= b - 1) {
+                int sq = lsb(b);
+                uint64_t a;
+                if (p == 0) a = ATTACKS.knight[sq];
+                else if (p == 1) a = bishop_attacks(sq, occupied);
+                else if (p == 2) a = rook_attacks(sq, occupied);
+                else a = rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+                attacked |= a;
+                count += popcount(a & safe);
             }
+            info.safe_squares[c][p] = count;
         }
-        
-        return moves;
+        info.by_color[c] = attacked;
     }
+}
+
+// ============= PAWN HASH TABLE =============
+
+// Cached pawn-structure evaluation, keyed by the Zobrist key of the pawns
+// alone. Besides the score it keeps masks that other terms can reuse.
+struct PawnEntry {
+    uint64_t key;
+    Score score;
+    uint8_t open_files;          // bit f set: no pawns at all on file f
+    uint8_t semi_open_files[2];  // bit f set: no pawns of that colour (0 = white)
+    uint64_t passed[2];          // squares (row * 8 + col) of passed pawns
+};
+
+class PawnHashTable {
+private:
+    vector<PawnEntry> entries;
+
+public:
+    static const size_t SIZE = 16384;
     
-    vector<Position> get_knight_moves(int row, int col, char piece) {
-        vector<Position> moves;
-        int knight_deltas[][2] = {
-            {-2, -1}, {-2, 1}, {-1, -2}, {-1, 2},
-            {1, -2}, {1, 2}, {2, -1}, {2, 1}
-        };
-        
-        for (int i = 0; i < 8; i++) {
-            int dr = knight_deltas[i][0];
-            int dc = knight_deltas[i][1];
-            int new_row = row + dr;
-            int new_col = col + dc;
-            if (is_valid_position(new_row, new_col)) {
-                char target = board[new_row][new_col];
-                if (target == ' ' || get_piece_color(target) != get_piece_color(piece)) {
-                    moves.push_back(Position(new_row, new_col));
-                }
-            }
+    PawnHashTable() : entries(SIZE) {
+        // A zeroed entry would otherwise match the key of a pawnless board
+        for (size_t i = 0; i < entries.size(); i++) {
+            entries[i].key = ~0ULL;
         }
-        
-        return moves;
     }
     
-    vector<Position> get_sliding_moves(int row, int col, char piece, 
-                                       const int directions[][2], int num_dirs) {
-        vector<Position> moves;
+    PawnEntry& slot(uint64_t key) {
+        return entries[key & (SIZE - 1)];
+    }
+};
+
+// Pawn structure changes rarely between nodes, so one table per thread is
+// shared by all the games a scheduler thread multiplexes, without locking.
+thread_local PawnHashTable PAWN_TABLE_CACHE;
+
+// How often each weighted term fired, per colour, for the tuner. The
+// evaluator only fills it in when given one.
+struct EvalTrace {
+    int doubled[2];
+    int isolated[2];
+    int backward[2];
+    int passed_ranks[2];    // sum of the passed pawns' advance
+    int mobility[2][4];
+    int rook_open[2];
+    int rook_semi_open[2];
+    int king_exposed[2];
+    int king_zone[2];
+    int hanging[2];
+};
+
+// Bitboard pawn evaluator: doubled, isolated, backward and passed pawns
+// are each found for all pawns at once with file fills and shifts, and
+// scored by population count.
+void evaluate_pawn_structure(uint64_t white_pawns, uint64_t black_pawns, PawnEntry& entry,
+                             EvalTrace* trace = NULL) {
+    uint64_t pawns[2] = { white_pawns, black_pawns };
+    uint64_t attacks[2] = { white_pawn_attacks(pawns[0]), black_pawn_attacks(pawns[1]) };
+    Score score = 0;
+    
+    for (int c = 0; c < 2; c++) {
+        uint64_t own = pawns[c];
+        uint64_t enemy = pawns[c ^ 1];
+        int own_files = file_occupancy(own);
+        Score side = 0;
         
-        for (int i = 0; i < num_dirs; i++) {
-            int dr = directions[i][0];
-            int dc = directions[i][1];
-            int new_row = row + dr;
-            int new_col = col + dc;
-            while (is_valid_position(new_row, new_col)) {
-                char target = board[new_row][new_col];
-                if (target == ' ') {
-                    moves.push_back(Position(new_row, new_col));
-                } else if (get_piece_color(target) != get_piece_color(piece)) {
-                    moves.push_back(Position(new_row, new_col));
-                    break;
-                } else {
-                    break;
-                }
-                new_row += dr;
-                new_col += dc;
-            }
-        }
+        // Every pawn beyond the first on a file counts as doubled
+        side += DOUBLED_PAWN * (popcount(own) - popcount(own_files));
+        if (trace) trace->doubled[c] += popcount(own) - popcount(own_files);
+        entry.semi_open_files[c] = (uint8_t)~own_files;
         
-        return moves;
+        // Passed: outside every square an enemy pawn on the same or an
+        // adjacent file guards on its way down the board
+        uint64_t enemy_span = enemy | adjacent_files_of(enemy);
+        uint64_t guarded = (c == 0) ? south_fill(enemy_span << 8) : north_fill(enemy_span >> 8);
+        uint64_t passed = own & ~guarded;
+        entry.passed[c] = passed;
+        int passed_count = popcount(passed);
+        int advance = (c == 0) ? 7 * passed_count - row_sum(passed) : row_sum(passed);
+        side += make_score(advance * PASSED_PAWN_PER_RANK, advance * PASSED_PAWN_PER_RANK);
+        if (trace) trace->passed_ranks[c] += advance;
+        
+        // Isolated: no own pawn on either adjacent file
+        uint64_t neighbour_files = adjacent_files_of(north_fill(own) | south_fill(own));
+        uint64_t isolated = own & ~neighbour_files;
+        side += ISOLATED_PAWN * popcount(isolated);
+        if (trace) trace->isolated[c] += popcount(isolated);
+        
+        // Backward: every neighbour is further advanced and the stop square
+        // is covered by an enemy pawn
+        uint64_t supported = (c == 0) ? north_fill(adjacent_files_of(own)) : 
+                                        south_fill(adjacent_files_of(own));
+        uint64_t stop_attacked = (c == 0) ? attacks[1] << 8 : attacks[0] >> 8;
+        uint64_t backward = own & neighbour_files & ~supported & stop_attacked;
+        side += BACKWARD_PAWN * popcount(backward);
+        if (trace) trace->backward[c] += popcount(backward);
+        
+        score += (c == 0) ? side : -side;
     }
     
-    vector<Position> get_bishop_moves(int row, int col, char piece) {
-        int directions[][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
-        return get_sliding_moves(row, col, piece, directions, 4);
-    }
+    entry.open_files = entry.semi_open_files[0] & entry.semi_open_files[1];
+    entry.score = score;
+}
+
+// ============= EVALUATION CACHE =============
+
+// Direct-mapped cache of static evaluations keyed by the piece-placement hash:
+// the evaluation is always from white's point of view and does not depend on
+// the side to move, castling rights or en passant.
+struct EvalCacheEntry {
+    uint64_t key;
+    int score;
+};
+
+class EvalCache {
+private:
+    vector<EvalCacheEntry> entries;
+
+public:
+    static const size_t SIZE = 32768;
     
-    vector<Position> get_rook_moves(int row, int col, char piece) {
-        int directions[][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
-        return get_sliding_moves(row, col, piece, directions, 4);
+    EvalCache() : entries(SIZE) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            entries[i].key = ~0ULL;
+        }
     }
     
-    vector<Position> get_queen_moves(int row, int col, char piece) {
-        int directions[][2] = {
-            {-1, -1}, {-1, 0}, {-1, 1},
-            {0, -1},           {0, 1},
-            {1, -1},  {1, 0},  {1, 1}
-        };
-        return get_sliding_moves(row, col, piece, directions, 8);
+    EvalCacheEntry& slot(uint64_t key) {
+        return entries[key & (SIZE - 1)];
     }
+};
+
+thread_local EvalCache EVAL_CACHE;
+
+// ============= MATERIAL TABLE =============
+
+// Everything that depends only on the piece counts, precomputed for every
+// material signature so the evaluator needs a single load per call.
+enum MaterialFlags { MATERIAL_DRAW = 1 };   // insufficient mating material
+enum EndgameEvaluator { EVAL_GENERIC = 0, EVAL_KXK_WHITE = 1, EVAL_KXK_BLACK = 2 };
+
+const int SCALE_NORMAL = 64;
+
+struct MaterialEntry {
+    Score imbalance;
+    uint8_t phase;
+    uint8_t scale[2];    // endgame scale factor (out of 64) when that colour is ahead
+    uint8_t flags;
+    uint8_t evaluator;
+};
+
+// The material key packs the counts of each colour's P (0-8), N, B, R (0-2)
+// and Q (0-1) into a mixed-radix index. Counts beyond those caps only arise
+// through promotion and fall back to computing the entry on the fly.
+const int MATERIAL_CAP[6] = { 8, 2, 2, 2, 1, 1 };
+const int MATERIAL_KEY_WEIGHT[12] = {
+    1, 9, 27, 81, 243, 0,
+    486, 4374, 13122, 39366, 118098, 0
+};
+const int MATERIAL_TABLE_SIZE = 486 * 486;
+
+Score BISHOP_PAIR = make_score(30, 50);
+int KNIGHT_PAWN_ADJUST = 4;   // per knight, per own pawn above five
+int ROOK_PAWN_ADJUST = -8;    // per rook, per own pawn above five
+const int KNOWN_WIN = 10000;
+
+// counts[colour][type] with type in P, N, B, R, Q, K order
+MaterialEntry compute_material_entry(const int counts[2][6]) {
+    MaterialEntry entry;
+    entry.imbalance = 0;
+    entry.flags = 0;
+    entry.evaluator = EVAL_GENERIC;
     
-    vector<Position> get_king_moves(int row, int col, char piece) {
-        vector<Position> moves;
-        int directions[][2] = {
-            {-1, -1}, {-1, 0}, {-1, 1},
-            {0, -1},           {0, 1},
-            {1, -1},  {1, 0},  {1, 1}
-        };
-        
-        for (int i = 0; i < 8; i++) {
-            int dr = directions[i][0];
-            int dc = directions[i][1];
-            int new_row = row + dr;
-            int new_col = col + dc;
-            if (is_valid_position(new_row, new_col)) {
-                char target = board[new_row][new_col];
-                if (target == ' ' || get_piece_color(target) != get_piece_color(piece)) {
-                    moves.push_back(Position(new_row, new_col));
-                }
-            }
+    int phase = 0;
+    int npm[2];
+    for (int c = 0; c < 2; c++) {
+        npm[c] = 0;
+        for (int t = 1; t < 5; t++) {
+            phase += PHASE_WEIGHT[t] * counts[c][t];
+            npm[c] += PieceValues::get("PNBRQK"[t]) * counts[c][t];
         }
         
-        if (piece == 'K' && row == 7 && col == 4) {
-            if (white_can_castle_kingside && board[7][5] == ' ' && board[7][6] == ' ') {
-                moves.push_back(Position(7, 6));
-            }
-            if (white_can_castle_queenside && board[7][1] == ' ' && 
-                board[7][2] == ' ' && board[7][3] == ' ') {
-                moves.push_back(Position(7, 2));
-            }
-        } else if (piece == 'k' && row == 0 && col == 4) {
-            if (black_can_castle_kingside && board[0][5] == ' ' && board[0][6] == ' ') {
-                moves.push_back(Position(0, 6));
-            }
-            if (black_can_castle_queenside && board[0][1] == ' ' && 
-                board[0][2] == ' ' && board[0][3] == ' ') {
-                moves.push_back(Position(0, 2));
-            }
+        Score side = 0;
+        if (counts[c][2] >= 2) side += BISHOP_PAIR;
+        int extra_pawns = counts[c][0] - 5;
+        int adjust = counts[c][1] * extra_pawns * KNIGHT_PAWN_ADJUST +
+                     counts[c][3] * extra_pawns * ROOK_PAWN_ADJUST;
+        side += make_score(adjust, adjust);
+        entry.imbalance += (c == 0) ? side : -side;
+    }
+    entry.phase = (uint8_t)min(phase, MAX_PHASE);
+    
+    // Without pawns, a small edge in pieces rarely wins
+    const int bishop_value = PieceValues::get('B');
+    const int rook_value = PieceValues::get('R');
+    for (int c = 0; c < 2; c++) {
+        entry.scale[c] = SCALE_NORMAL;
+        if (counts[c][0] == 0 && npm[c] - npm[c ^ 1] <= bishop_value) {
+            entry.scale[c] = npm[c] < rook_value ? 0 : (npm[c ^ 1] <= bishop_value ? 4 : 14);
         }
-        
-        return moves;
     }
     
-    vector<Position> get_piece_moves(int row, int col) {
-        char piece = board[row][col];
-        if (piece == ' ') return vector<Position>();
-        
-        char piece_type = toupper(static_cast<unsigned char>(piece));
-        
-        switch (piece_type) {
-            case 'P': return get_pawn_moves(row, col, piece);
-            case 'N': return get_knight_moves(row, col, piece);
-            case 'B': return get_bishop_moves(row, col, piece);
-            case 'R': return get_rook_moves(row, col, piece);
-            case 'Q': return get_queen_moves(row, col, piece);
-            case 'K': return get_king_moves(row, col, piece);
+    // Dead positions: no pawns or majors and at most one minor on the board
+    int minors = counts[0][1] + counts[0][2] + counts[1][1] + counts[1][2];
+    if (counts[0][0] + counts[1][0] == 0 &&
+        counts[0][3] + counts[1][3] + counts[0][4] + counts[1][4] == 0 && minors <= 1) {
+        entry.flags |= MATERIAL_DRAW;
+    }
+    
+    // Lone king against enough material to force mate: a major piece,
+    // bishop and knight, or two bishops (evaluate_kxk checks their colours).
+    // Two knights cannot force it.
+    for (int c = 0; c < 2; c++) {
+        bool lone_king = npm[c ^ 1] == 0 && counts[c ^ 1][0] == 0;
+        if (!lone_king) continue;
+        bool can_mate = counts[c][3] + counts[c][4] > 0 || 
+                        (counts[c][2] >= 1 && counts[c][1] >= 1) || counts[c][2] >= 2;
+        if (can_mate) {
+            entry.evaluator = (c == 0) ? EVAL_KXK_WHITE : EVAL_KXK_BLACK;
+        } else if (counts[c][0] == 0 && counts[c][2] == 0) {
+            entry.scale[c] = 0;
         }
-        
-        return vector<Position>();
     }
     
-    bool is_square_attacked(int row, int col, const string& by_color) {
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                char piece = board[i][j];
-                if (piece != ' ' && get_piece_color(piece) == by_color) {
-                    vector<Position> moves = get_piece_moves(i, j);
-                    for (size_t k = 0; k < moves.size(); k++) {
-                        if (moves[k].row == row && moves[k].col == col) {
-                            return true;
-                        }
-                    }
-                }
+    return entry;
+}
+
+MaterialEntry MATERIAL_TABLE[MATERIAL_TABLE_SIZE];
+
+void init_material_table() {
+    for (int key = 0; key < MATERIAL_TABLE_SIZE; key++) {
+        int counts[2][6];
+        int rest = key;
+        for (int c = 0; c < 2; c++) {
+            for (int t = 0; t < 5; t++) {
+                counts[c][t] = rest % (MATERIAL_CAP[t] + 1);
+                rest /= MATERIAL_CAP[t] + 1;
             }
+            counts[c][5] = 1;
         }
-        return false;
+        MATERIAL_TABLE[key] = compute_material_entry(counts);
     }
+}
+
+// Bonus for driving a king towards the edge, and for a short king distance
+inline int push_to_edge(int sq) {
+    int row = sq / 8;
+    int col = sq % 8;
+    int row_dist = min(row, 7 - row);
+    int col_dist = min(col, 7 - col);
+    return 90 - 10 * (row_dist + col_dist) - 10 * min(row_dist, col_dist);
+}
+
+inline int king_distance(int a, int b) {
+    return max(abs(a / 8 - b / 8), abs(a % 8 - b % 8));
+}
+
+// KXK: the lone king is driven to the edge and the strong king walks up to
+// it. Returned from white's point of view.
+int evaluate_kxk(const uint64_t bb[12], int strong) {
+    int base = strong * 6;
     
-    bool is_in_check(const string& color) {
-        Position king_pos = (color == "white") ? white_king_pos : black_king_pos;
-        string opponent_color = (color == "white") ? "black" : "white";
-        return is_square_attacked(king_pos.row, king_pos.col, opponent_color);
+    // Bishops alone, all on squares of one colour, cannot mate
+    uint64_t bishops = bb[base + 2];
+    if (!(bb[base] | bb[base + 1] | bb[base + 3] | bb[base + 4]) && 
+        (!(bishops & LIGHT_SQUARES_BB) || !(bishops & ~LIGHT_SQUARES_BB))) {
+        return 0;
     }
     
-    struct GameState {
-        vector<vector<char> > board;
-        Position white_king;
-        Position black_king;
-        bool w_castle_k, w_castle_q, b_castle_k, b_castle_q;
-        Position en_passant;
-    };
-    
-    GameState save_state() {
-        GameState state;
-        state.board = board;
-        state.white_king = white_king_pos;
-        state.black_king = black_king_pos;
-        state.w_castle_k = white_can_castle_kingside;
-        state.w_castle_q = white_can_castle_queenside;
-        state.b_castle_k = black_can_castle_kingside;
-        state.b_castle_q = black_can_castle_queenside;
-        state.en_passant = en_passant_target;
-        return state;
+    int material = 0;
+    for (int t = 0; t < 5; t++) {
+        material += PieceValues::get("PNBRQK"[t]) * popcount(bb[base + t]);
     }
     
-    void restore_state(const GameState& state) {
-        board = state.board;
-        white_king_pos = state.white_king;
-        black_king_pos = state.black_king;
-        white_can_castle_kingside = state.w_castle_k;
-        white_can_castle_queenside = state.w_castle_q;
-        black_can_castle_kingside = state.b_castle_k;
-        black_can_castle_queenside = state.b_castle_q;
-        en_passant_target = state.en_passant;
-    }
+    int strong_king = lsb(bb[base + 5]);
+    int weak_king = lsb(bb[(strong ^ 1) * 6 + 5]);
+    int score = material + KNOWN_WIN + push_to_edge(weak_king) + 
+                10 * (7 - king_distance(strong_king, weak_king));
+    return (strong == 0) ? score : -score;
+}
+
+// ============= STATIC EVALUATION =============
+
+// Interpolates between the midgame and endgame scores by game phase,
+// scaling the endgame half down for drawish material
+int taper(Score score, const MaterialEntry& material) {
+    int eg = eg_value(score);
+    eg = eg * material.scale[eg > 0 ? 0 : 1] / SCALE_NORMAL;
+    int phase = material.phase;
+    return (mg_value(score) * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+}
+
+// Mobility, pawn structure, king safety and hanging pieces, all driven
+// by a single attack-map pass
+Score evaluate_expensive_terms(const uint64_t bb[12], const PawnEntry& pawns, 
+                               EvalTrace* trace = NULL) {
+    AttackInfo attacks;
+    compute_attacks(bb, attacks);
     
-    string to_pgn_notation(int from_row, int from_col, int to_row, int to_col, 
-                          char piece, bool is_capture, bool is_check, bool is_checkmate) {
-        string notation = "";
-        char piece_type = toupper(static_cast<unsigned char>(piece));
+    Score score = pawns.score;
+    
+    for (int c = 0; c < 2; c++) {
+        int base = c * 6;
+        Score side = 0;
         
-        if (piece_type == 'K' && abs(to_col - from_col) == 2) {
-            if (to_col > from_col) {
-                return is_checkmate ? "O-O#" : (is_check ? "O-O+" : "O-O");
-            } else {
-                return is_checkmate ? "O-O-O#" : (is_check ? "O-O-O+" : "O-O-O");
+        // Mobility: safe squares attacked by each minor and major piece
+        for (int p = 0; p < 4; p++) {
+            side += MOBILITY_WEIGHT[p] * attacks.safe_squares[c][p];
+            if (trace) trace->mobility[c][p] += attacks.safe_squares[c][p];
+        }
+        
+        // Rooks on open and semi-open files
+        for (uint64_t b = bb[base + 3]; b; b &= b - 1) {
+            int file_bit = 1 << (lsb(b) % 8);
+            if (pawns.open_files & file_bit) {
+                side += ROOK_OPEN_FILE;
+                if (trace) trace->rook_open[c]++;
+            } else if (pawns.semi_open_files[c] & file_bit) {
+                side += ROOK_SEMI_OPEN_FILE;
+                if (trace) trace->rook_semi_open[c]++;
             }
         }
         
-        if (piece_type != 'P') {
-            notation += piece_type;
+        // King safety: a king off its back rank, and enemy attacks on the
+        // squares around it (both fade out in the endgame)
+        uint64_t king = bb[base + 5];
+        if (king) {
+            uint64_t back_rank = (c == 0) ? 0xFFULL << 56 : 0xFFULL;
+            int zone_attacks = popcount(ATTACKS.king[lsb(king)] & attacks.by_color[c ^ 1]);
+            if (!(king & back_rank)) side += KING_EXPOSED;
+            side += KING_ZONE_ATTACK * zone_attacks;
+            if (trace) {
+                trace->king_exposed[c] += !(king & back_rank);
+                trace->king_zone[c] += zone_attacks;
+            }
         }
         
-        bool need_file = false;
-        bool need_rank = false;
+        // Hanging pieces: minors and majors attacked but not defended
+        uint64_t pieces = attacks.occupied[c] & ~bb[base] & ~king;
+        int hanging = popcount(pieces & attacks.by_color[c ^ 1] & ~attacks.by_color[c]);
+        side += HANGING_PIECE * hanging;
+        if (trace) trace->hanging[c] += hanging;
         
-        if (piece_type != 'P') {
-            for (int i = 0; i < 8; i++) {
-                for (int j = 0; j < 8; j++) {
-                    if (i == from_row && j == from_col) continue;
-                    if (toupper(static_cast<unsigned char>(board[i][j])) == piece_type &&
-                        get_piece_color(board[i][j]) == get_piece_color(piece)) {
-                        vector<Position> moves = get_piece_moves(i, j);
-                        for (size_t k = 0; k < moves.size(); k++) {
-                            if (moves[k].row == to_row && moves[k].col == to_col) {
-                                if (j != from_col) need_file = true;
-                                else need_rank = true;
-                            }
-                        }
-                    }
-                }
-            }
+        score += (c == 0) ? side : -side;
+    }
+    
+    return score;
+}
+
+// Material entry for the given piece counts, from the table when the counts
+// fit the material key
+const MaterialEntry& lookup_material(const int counts[2][6], MaterialEntry& scratch) {
+    int key = 0;
+    for (int index = 0; index < 12; index++) {
+        int count = counts[index / 6][index % 6];
+        if (count > MATERIAL_CAP[index % 6]) {
+            scratch = compute_material_entry(counts);
+            return scratch;
         }
-        
-        if (need_file || (piece_type == 'P' && is_capture)) {
-            notation += char('a' + from_col);
+        key += count * MATERIAL_KEY_WEIGHT[index];
+    }
+    return MATERIAL_TABLE[key];
+}
+
+// Everything after the material + PST sum: the same result as
+// Chess::evaluate_board() with a full window, without any caches
+int evaluate_from_material(const uint64_t bb[12], Score psq, const MaterialEntry& material) {
+    if (material.flags & MATERIAL_DRAW) return 0;
+    if (material.evaluator == EVAL_KXK_WHITE) return evaluate_kxk(bb, 0);
+    if (material.evaluator == EVAL_KXK_BLACK) return evaluate_kxk(bb, 1);
+    
+    PawnEntry pawns;
+    evaluate_pawn_structure(bb[0], bb[6], pawns);
+    return taper(psq + material.imbalance + evaluate_expensive_terms(bb, pawns), material);
+}
+
+// Classical evaluation of a position given only its piece bitboards
+int evaluate_position(const uint64_t bb[12]) {
+    int counts[2][6];
+    Score psq = 0;
+    for (int index = 0; index < 12; index++) {
+        counts[index / 6][index % 6] = popcount(bb[index]);
+        for (uint64_t b = bb[index]; b; b &= b - 1) {
+            psq += PSQ[index][lsb(b)];
         }
-        if (need_rank) {
-            notation += char('0' + (8 - from_row));
+    }
+    MaterialEntry scratch;
+    return evaluate_from_material(bb, psq, lookup_material(counts, scratch));
+}
+
+// Runs a batch of headless games on the cooperative scheduler (defined below)
+void run_headless_tournament(int white_difficulty, int black_difficulty);
+
+// Helper function to repeat a string
+string repeat_string(const string& str, int times) {
+    string result;
+    for (int i = 0; i < times; i++) {
+        result += str;
+    }
+    return result;
+}
+
+// ============= SIMD EVALUATION KERNEL =============
+
+// Material + piece-square score of a board given as 64 piece codes
+// (0 = empty, otherwise piece_index() + 1), for batch analysis of positions.
+// When bb is given the kernels also fill in the piece bitboards, which the
+// rest of the evaluation (mobility, pawns, king safety) runs on.
+
+Score psq_score_scalar(const uint8_t codes[64], uint64_t* bb = NULL) {
+    Score score = 0;
+    if (bb) memset(bb, 0, 12 * sizeof(uint64_t));
+    for (int sq = 0; sq < 64; sq++) {
+        if (!codes[sq]) continue;
+        score += PSQ[codes[sq] - 1][sq];
+        if (bb) bb[codes[sq] - 1] |= 1ULL << sq;
+    }
+    return score;
+}
+
+#ifdef CHESS_AVX2_KERNEL
+inline int horizontal_sum_avx2(__m256i v) __attribute__((target("avx2")));
+inline int horizontal_sum_avx2(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+// Gather-free lookup: for each piece type a byte compare against the codes
+// selects its squares, the byte mask is widened to 16-bit lanes and ANDed
+// with that piece's weights. Every square holds at most one piece, so the
+// 16-bit lanes cannot overflow; vpmaddwd widens them to 32 bits at the end.
+// The same byte masks, packed with vpmovmskb, are the piece bitboards.
+__attribute__((target("avx2")))
+Score psq_score_avx2(const uint8_t codes[64], uint64_t* bb = NULL) {
+    __m256i squares_lo = _mm256_loadu_si256((const __m256i*)codes);
+    __m256i squares_hi = _mm256_loadu_si256((const __m256i*)(codes + 32));
+    __m256i mg[4], eg[4];
+    for (int i = 0; i < 4; i++) {
+        mg[i] = _mm256_setzero_si256();
+        eg[i] = _mm256_setzero_si256();
+    }
+    
+    for (int p = 0; p < 12; p++) {
+        __m256i code = _mm256_set1_epi8((char)(p + 1));
+        __m256i mask_lo = _mm256_cmpeq_epi8(squares_lo, code);
+        __m256i mask_hi = _mm256_cmpeq_epi8(squares_hi, code);
+        if (bb) {
+            bb[p] = (uint64_t)(uint32_t)_mm256_movemask_epi8(mask_lo) | 
+                    ((uint64_t)(uint32_t)_mm256_movemask_epi8(mask_hi) << 32);
         }
+        if (_mm256_testz_si256(mask_lo, mask_lo) && _mm256_testz_si256(mask_hi, mask_hi)) continue;
         
-        if (is_capture) {
-            notation += 'x';
+        __m256i masks[4] = {
+            _mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask_lo)),
+            _mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask_lo, 1)),
+            _mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask_hi)),
+            _mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask_hi, 1))
+        };
+        const __m256i* weights_mg = (const __m256i*)PSQ_MG16[p];
+        const __m256i* weights_eg = (const __m256i*)PSQ_EG16[p];
+        for (int i = 0; i < 4; i++) {
+            mg[i] = _mm256_add_epi16(mg[i], _mm256_and_si256(masks[i], _mm256_load_si256(weights_mg + i)));
+            eg[i] = _mm256_add_epi16(eg[i], _mm256_and_si256(masks[i], _mm256_load_si256(weights_eg + i)));
         }
-        
-        notation += char('a' + to_col);
-        notation += char('0' + (8 - to_row));
-        
-        if (is_checkmate) {
-            notation += '#';
-        } else if (is_check) {
-            notation += '+';
+    }
+    
+    __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum_mg = _mm256_setzero_si256();
+    __m256i sum_eg = _mm256_setzero_si256();
+    for (int i = 0; i < 4; i++) {
+        sum_mg = _mm256_add_epi32(sum_mg, _mm256_madd_epi16(mg[i], ones));
+        sum_eg = _mm256_add_epi32(sum_eg, _mm256_madd_epi16(eg[i], ones));
+    }
+    return make_score(horizontal_sum_avx2(sum_mg), horizontal_sum_avx2(sum_eg));
+}
+#endif
+
+bool cpu_has_avx2() {
+#ifdef CHESS_AVX2_KERNEL
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+// Evaluates count boards stored back to back (64 codes each)
+void evaluate_psq_batch(const uint8_t* codes, size_t count, Score* out, bool allow_simd = true) {
+#ifdef CHESS_AVX2_KERNEL
+    if (allow_simd && cpu_has_avx2()) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = psq_score_avx2(codes + i * 64);
         }
-        
-        return notation;
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        out[i] = psq_score_scalar(codes + i * 64);
     }
+}
+
+// Full classical evaluation of a board of piece codes, the same as
+// evaluate_position(): the kernel supplies the piece-square sum and the
+// bitboards, the bitboard evaluator the material, mobility and pawn terms
+int evaluate_codes(const uint8_t codes[64], bool allow_simd = true) {
+    uint64_t bb[12];
+    Score psq;
+#ifdef CHESS_AVX2_KERNEL
+    if (allow_simd && cpu_has_avx2()) psq = psq_score_avx2(codes, bb);
+    else psq = psq_score_scalar(codes, bb);
+#else
+    (void)allow_simd;
+    psq = psq_score_scalar(codes, bb);
+#endif
+    int counts[2][6];
+    for (int index = 0; index < 12; index++) counts[index / 6][index % 6] = popcount(bb[index]);
+    MaterialEntry scratch;
+    return evaluate_from_material(bb, psq, lookup_material(counts, scratch));
+}
+
+// ============= NNUE EVALUATION =============
+
+// Optional HalfKP network: each side's half of the first layer sums the
+// weight rows of its (king square, piece, square) features and is updated
+// as pieces are added and removed. Both halves go through clipped ReLU into
+// two small int8 layers and one output. Black's half sees the board mirrored
+// with colours swapped, and the white half comes first, so the output is
+// from white's point of view like evaluate_board().
+const int NNUE_HALF_DIMS = 128;
+const int NNUE_INPUTS = 64 * 10 * 64;
+const int NNUE_L2 = 32;
+const int NNUE_L3 = 32;
+const int NNUE_WEIGHT_SHIFT = 6;
+const int NNUE_OUTPUT_SCALE = 16;
+const char NNUE_FILE_MAGIC[8] = {'C', 'H', 'N', 'N', 'U', 'E', '0', '1'};
+
+enum EvaluatorType { EVALUATOR_CLASSICAL, EVALUATOR_NNUE };
+
+EvaluatorType ACTIVE_EVALUATOR = EVALUATOR_CLASSICAL;
+
+struct NnueNetwork {
+    vector<int16_t> ft_biases;   // [NNUE_HALF_DIMS]
+    vector<int16_t> ft_weights;  // [NNUE_INPUTS][NNUE_HALF_DIMS]
+    int32_t l1_biases[NNUE_L2];
+    alignas(32) int8_t l1_weights[NNUE_L2][2 * NNUE_HALF_DIMS];
+    int32_t l2_biases[NNUE_L3];
+    alignas(32) int8_t l2_weights[NNUE_L3][NNUE_L2];
+    int32_t out_bias;
+    alignas(32) int8_t out_weights[NNUE_L3];
     
-    bool make_move(int from_row, int from_col, int to_row, int to_col) {
-        char piece = board[from_row][from_col];
-        
-        if (piece == ' ') return false;
-        if (get_piece_color(piece) != current_player) return false;
+    // File layout (little endian): the 8-byte magic, the four dimensions as
+    // uint32 (inputs, half dims, l2, l3), then every array above in order.
+    bool load(const string& path) {
+        ifstream in(path.c_str(), ios::binary);
+        if (!in) return false;
         
-        vector<Position> valid_moves = get_piece_moves(from_row, from_col);
-        bool found = false;
-        for (size_t i = 0; i < valid_moves.size(); i++) {
-            if (valid_moves[i].row == to_row && valid_moves[i].col == to_col) {
-                found = true;
-                break;
-            }
+        char magic[8];
+        uint32_t dims[4];
+        in.read(magic, sizeof(magic));
+        in.read((char*)dims, sizeof(dims));
+        if (!in || memcmp(magic, NNUE_FILE_MAGIC, sizeof(magic)) != 0) return false;
+        if (dims[0] != (uint32_t)NNUE_INPUTS || dims[1] != (uint32_t)NNUE_HALF_DIMS ||
+            dims[2] != (uint32_t)NNUE_L2 || dims[3] != (uint32_t)NNUE_L3) {
+            return false;
         }
-        if (!found) return false;
-        
-        GameState saved_state = save_state();
-        
-        char captured = board[to_row][to_col];
-        bool is_capture = (captured != ' ');
         
-        if (toupper(static_cast<unsigned char>(piece)) == 'P' && en_passant_target.has_value() && 
-            en_passant_target.row == to_row && en_passant_target.col == to_col) {
-            is_capture = true;
-            if (is_white_piece(piece)) {
-                captured = board[to_row + 1][to_col];
-                board[to_row + 1][to_col] = ' ';
-            } else {
-                captured = board[to_row - 1][to_col];
-                board[to_row - 1][to_col] = ' ';
-            }
+        ft_biases.resize(NNUE_HALF_DIMS);
+        ft_weights.resize((size_t)NNUE_INPUTS * NNUE_HALF_DIMS);
+        in.read((char*)&ft_biases[0], ft_biases.size() * sizeof(int16_t));
+        in.read((char*)&ft_weights[0], ft_weights.size() * sizeof(int16_t));
+        in.read((char*)l1_biases, sizeof(l1_biases));
+        in.read((char*)l1_weights, sizeof(l1_weights));
+        in.read((char*)l2_biases, sizeof(l2_biases));
+        in.read((char*)l2_weights, sizeof(l2_weights));
+        in.read((char*)&out_bias, sizeof(out_bias));
+        in.read((char*)out_weights, sizeof(out_weights));
+        if (!in || in.peek() != EOF) {
+            ft_weights.clear();
+            return false;
         }
-        
-        if (captured != ' ') {
-            captured_pieces[current_player].push_back(captured);
+        return true;
+    }
+    
+    bool loaded() const { return !ft_weights.empty(); }
+    
+    const int16_t* feature_row(int feature) const {
+        return &ft_weights[(size_t)feature * NNUE_HALF_DIMS];
+    }
+};
+
+NnueNetwork NNUE;
+
+inline bool nnue_active() {
+    return ACTIVE_EVALUATOR == EVALUATOR_NNUE;
+}
+
+// Feature of a non-king piece for the given side's half
+inline int nnue_feature(int perspective, int king_sq, int piece, int sq) {
+    if (perspective == 1) {
+        king_sq ^= 56;
+        sq ^= 56;
+        piece = (piece + 6) % 12;
+    }
+    int relative_piece = (piece / 6) * 5 + piece % 6;  // own P-Q 0-4, theirs 5-9
+    return (king_sq * 10 + relative_piece) * 64 + sq;
+}
+
+struct NnueAccumulator {
+    alignas(32) int16_t values[2][NNUE_HALF_DIMS];
+    int king_sq[2];
+    bool dirty[2];  // the half must be rebuilt before use
+};
+
+// Per-(side, king square) cache of an accumulator half and the pieces it was
+// built from: after a king move only the difference has to be applied.
+struct NnueFinnyEntry {
+    alignas(32) int16_t values[NNUE_HALF_DIMS];
+    uint64_t piece_bb[12];
+};
+
+#ifdef CHESS_AVX2_KERNEL
+__attribute__((target("avx2")))
+void nnue_update_row_avx2(int16_t* acc, const int16_t* row, bool add) {
+    for (int i = 0; i < NNUE_HALF_DIMS; i += 16) {
+        __m256i a = _mm256_load_si256((const __m256i*)(acc + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(row + i));
+        a = add ? _mm256_add_epi16(a, w) : _mm256_sub_epi16(a, w);
+        _mm256_store_si256((__m256i*)(acc + i), a);
+    }
+}
+
+// u8 x s8 dot product: vpmaddubsw multiplies and adds pairs to 16 bits
+// (at most 2 * 127 * 127, no saturation), vpmaddwd widens to 32 bits.
+__attribute__((target("avx2")))
+int32_t nnue_dot_avx2(const uint8_t* input, const int8_t* weights, int n) {
+    __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 32) {
+        __m256i x = _mm256_load_si256((const __m256i*)(input + i));
+        __m256i w = _mm256_load_si256((const __m256i*)(weights + i));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+    }
+    return horizontal_sum_avx2(sum);
+}
+#endif
+
+inline void nnue_update_row(int16_t* acc, int feature, bool add) {
+    const int16_t* row = NNUE.feature_row(feature);
+#ifdef CHESS_AVX2_KERNEL
+    if (cpu_has_avx2()) {
+        nnue_update_row_avx2(acc, row, add);
+        return;
+    }
+#endif
+    if (add) {
+        for (int i = 0; i < NNUE_HALF_DIMS; i++) acc[i] += row[i];
+    } else {
+        for (int i = 0; i < NNUE_HALF_DIMS; i++) acc[i] -= row[i];
+    }
+}
+
+inline int32_t nnue_dot(const uint8_t* input, const int8_t* weights, int n) {
+#ifdef CHESS_AVX2_KERNEL
+    if (cpu_has_avx2()) return nnue_dot_avx2(input, weights, n);
+#endif
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) sum += input[i] * weights[i];
+    return sum;
+}
+
+void nnue_clear_finny_entry(NnueFinnyEntry& entry) {
+    memcpy(entry.values, &NNUE.ft_biases[0], sizeof(entry.values));
+    memset(entry.piece_bb, 0, sizeof(entry.piece_bb));
+}
+
+// Brings the cached half for this king square up to the given pieces and
+// copies it into the accumulator
+void nnue_refresh_half(NnueAccumulator& acc, int perspective, const uint64_t piece_bb[12],
+                       NnueFinnyEntry& entry) {
+    int king_sq = lsb(piece_bb[perspective * 6 + 5]);
+    for (int piece = 0; piece < 12; piece++) {
+        if (piece % 6 == 5) continue;
+        uint64_t removed = entry.piece_bb[piece] & ~piece_bb[piece];
+        uint64_t added = piece_bb[piece] & ~entry.piece_bb[piece];
+        for (; removed; removed &= removed - 1) {
+            nnue_update_row(entry.values, nnue_feature(perspective, king_sq, piece, lsb(removed)), false);
         }
-        
-        board[to_row][to_col] = piece;
-        board[from_row][from_col] = ' ';
-        
-        if (piece == 'K') {
-            white_king_pos = Position(to_row, to_col);
-            if (from_col == 4 && to_col == 6) {
-                board[7][5] = 'R';
-                board[7][7] = ' ';
-            } else if (from_col == 4 && to_col == 2) {
-                board[7][3] = 'R';
-                board[7][0] = ' ';
-            }
-            white_can_castle_kingside = false;
-            white_can_castle_queenside = false;
-        } else if (piece == 'k') {
-            black_king_pos = Position(to_row, to_col);
-            if (from_col == 4 && to_col == 6) {
-                board[0][5] = 'r';
-                board[0][7] = ' ';
-            } else if (from_col == 4 && to_col == 2) {
-                board[0][3] = 'r';
-                board[0][0] = ' ';
-            }
-            black_can_castle_kingside = false;
-            black_can_castle_queenside = false;
+        for (; added; added &= added - 1) {
+            nnue_update_row(entry.values, nnue_feature(perspective, king_sq, piece, lsb(added)), true);
         }
-        
-        if (piece == 'R' && from_row == 7) {
-            if (from_col == 0) white_can_castle_queenside = false;
-            else if (from_col == 7) white_can_castle_kingside = false;
-        } else if (piece == 'r' && from_row == 0) {
-            if (from_col == 0) black_can_castle_queenside = false;
-            else if (from_col == 7) black_can_castle_kingside = false;
+        entry.piece_bb[piece] = piece_bb[piece];
+    }
+    memcpy(acc.values[perspective], entry.values, sizeof(entry.values));
+    acc.king_sq[perspective] = king_sq;
+    acc.dirty[perspective] = false;
+}
+
+// Dense layers on top of an up-to-date accumulator
+int nnue_forward(const NnueAccumulator& acc) {
+    alignas(32) uint8_t input[2 * NNUE_HALF_DIMS];
+    alignas(32) uint8_t hidden1[NNUE_L2];
+    alignas(32) uint8_t hidden2[NNUE_L3];
+    
+    for (int p = 0; p < 2; p++) {
+        for (int i = 0; i < NNUE_HALF_DIMS; i++) {
+            input[p * NNUE_HALF_DIMS + i] = (uint8_t)max(0, min(127, (int)acc.values[p][i]));
         }
+    }
+    for (int i = 0; i < NNUE_L2; i++) {
+        int32_t sum = NNUE.l1_biases[i] + nnue_dot(input, NNUE.l1_weights[i], 2 * NNUE_HALF_DIMS);
+        hidden1[i] = (uint8_t)max(0, min(127, sum >> NNUE_WEIGHT_SHIFT));
+    }
+    for (int i = 0; i < NNUE_L3; i++) {
+        int32_t sum = NNUE.l2_biases[i] + nnue_dot(hidden1, NNUE.l2_weights[i], NNUE_L2);
+        hidden2[i] = (uint8_t)max(0, min(127, sum >> NNUE_WEIGHT_SHIFT));
+    }
+    return (NNUE.out_bias + nnue_dot(hidden2, NNUE.out_weights, NNUE_L3)) / NNUE_OUTPUT_SCALE;
+}
+
+// ============= BATCH EVALUATION =============
+
+// Structure-of-arrays batch of positions: pieces[piece_index()][position].
+// The material and piece-square pass runs over the whole batch one piece
+// type at a time, streaming through contiguous arrays; the attack-map and
+// pawn-structure pass loads four consecutive positions into one register.
+struct PositionBatch {
+    size_t count;
+    vector<uint64_t> pieces[12];
+    
+    PositionBatch() : count(0) {}
+    
+    void resize(size_t n) {
+        count = n;
+        for (int index = 0; index < 12; index++) pieces[index].assign(n, 0);
+    }
+    
+    void set(size_t i, const uint64_t bb[12]) {
+        for (int index = 0; index < 12; index++) pieces[index][i] = bb[index];
+    }
+};
+
+#ifdef CHESS_AVX2_KERNEL
+// Population count of each of four bitboards (vpshufb nibble lookup +
+// vpsadbw), one count per 64-bit lane
+__attribute__((target("avx2")))
+inline __m256i lanes_popcount(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+    __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+void popcount_array_avx2(const uint64_t* in, size_t n, int32_t* out) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i counts = lanes_popcount(_mm256_loadu_si256((const __m256i*)(in + i)));
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256((__m256i*)lanes, counts);
+        for (int k = 0; k < 4; k++) out[i + k] = (int32_t)lanes[k];
+    }
+    for (; i < n; i++) out[i] = popcount(in[i]);
+}
+#endif
+
+void popcount_array(const uint64_t* in, size_t n, int32_t* out) {
+#ifdef CHESS_AVX2_KERNEL
+    if (cpu_has_avx2()) {
+        popcount_array_avx2(in, n, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) out[i] = popcount(in[i]);
+}
+
+// Weighted sum of the counts in a trace: the pawn-structure score plus
+// evaluate_expensive_terms() for the position the trace was taken from
+Score score_traced_terms(const EvalTrace& trace) {
+    Score score = 0;
+    for (int c = 0; c < 2; c++) {
+        int advance = trace.passed_ranks[c];
+        Score side = DOUBLED_PAWN * trace.doubled[c] + ISOLATED_PAWN * trace.isolated[c] + 
+                     BACKWARD_PAWN * trace.backward[c] + 
+                     make_score(advance * PASSED_PAWN_PER_RANK, advance * PASSED_PAWN_PER_RANK);
+        for (int p = 0; p < 4; p++) side += MOBILITY_WEIGHT[p] * trace.mobility[c][p];
+        side += ROOK_OPEN_FILE * trace.rook_open[c] + ROOK_SEMI_OPEN_FILE * trace.rook_semi_open[c];
+        side += KING_EXPOSED * trace.king_exposed[c] + KING_ZONE_ATTACK * trace.king_zone[c];
+        side += HANGING_PIECE * trace.hanging[c];
+        score += (c == 0) ? side : -side;
+    }
+    return score;
+}
+
+#ifdef CHESS_AVX2_KERNEL
+// Lane-wise forms of the bitboard helpers, four positions per register.
+// Each lane goes through the same shifts and masks as one scalar bitboard.
+
+// Shift towards higher squares (delta > 0) or lower ones, keeping only the
+// landing squares that cannot have wrapped around a board edge
+__attribute__((target("avx2")))
+inline __m256i lanes_step(__m256i b, int delta, uint64_t landing) {
+    __m256i shifted = (delta > 0) ? _mm256_sll_epi64(b, _mm_cvtsi32_si128(delta)) : 
+                                    _mm256_srl_epi64(b, _mm_cvtsi32_si128(-delta));
+    return _mm256_and_si256(shifted, _mm256_set1_epi64x((long long)landing));
+}
+
+__attribute__((target("avx2")))
+inline __m256i lanes_or(__m256i a, __m256i b) {
+    return _mm256_or_si256(a, b);
+}
+
+__attribute__((target("avx2")))
+inline __m256i lanes_and(__m256i a, __m256i b) {
+    return _mm256_and_si256(a, b);
+}
+
+__attribute__((target("avx2")))
+inline __m256i lanes_andnot(__m256i a, __m256i b) {   // a & ~b
+    return _mm256_andnot_si256(b, a);
+}
+
+__attribute__((target("avx2")))
+inline __m256i lanes_north_fill(__m256i b) {
+    b = lanes_or(b, _mm256_srli_epi64(b, 8));
+    b = lanes_or(b, _mm256_srli_epi64(b, 16));
+    return lanes_or(b, _mm256_srli_epi64(b, 32));
+}
+
+__attribute__((target("avx2")))
+inline __m256i lanes_south_fill(__m256i b) {
+    b = lanes_or(b, _mm256_slli_epi64(b, 8));
+    b = lanes_or(b, _mm256_slli_epi64(b, 16));
+    return lanes_or(b, _mm256_slli_epi64(b, 32));
+}
+
+__attribute__((target("avx2")))
+inline __m256i lanes_adjacent_files_of(__m256i b) {
+    return lanes_or(lanes_step(b, 1, ~FILE_A_BB), lanes_step(b, -1, ~FILE_H_BB));
+}
+
+__attribute__((target("avx2")))
+inline __m256i lanes_row_sum(__m256i b) {
+    __m256i sum = lanes_popcount(lanes_and(b, _mm256_set1_epi64x((long long)0xFF00FF00FF00FF00ULL)));
+    sum = _mm256_add_epi64(sum, _mm256_slli_epi64(
+        lanes_popcount(lanes_and(b, _mm256_set1_epi64x((long long)0xFFFF0000FFFF0000ULL))), 1));
+    return _mm256_add_epi64(sum, _mm256_slli_epi64(
+        lanes_popcount(lanes_and(b, _mm256_set1_epi64x((long long)0xFFFFFFFF00000000ULL))), 2));
+}
+
+// Square steps and wrap masks of the ray directions, in the ray tables' order
+const int RAY_STEP[8] = { -8, -1, -9, -7, 8, 1, 7, 9 };
+const uint64_t RAY_LANDING[8] = {
+    ~0ULL, ~FILE_H_BB, ~FILE_H_BB, ~FILE_A_BB, ~0ULL, ~FILE_A_BB, ~FILE_H_BB, ~FILE_A_BB
+};
+
+const int KNIGHT_STEP[8] = { -17, -15, -10, -6, 6, 10, 15, 17 };
+const uint64_t KNIGHT_LANDING[8] = {
+    ~FILE_H_BB, ~FILE_A_BB, ~(FILE_H_BB | (FILE_H_BB >> 1)), ~(FILE_A_BB | (FILE_A_BB << 1)),
+    ~(FILE_H_BB | (FILE_H_BB >> 1)), ~(FILE_A_BB | (FILE_A_BB << 1)), ~FILE_H_BB, ~FILE_A_BB
+};
+
+// Squares the sliders attack along one ray direction, blockers included
+// (a Kogge-Stone occluded fill through the empty squares). Two sliders on
+// the same line never share squares in the same direction, since the rear
+// one stops at the front one, so the count of the union is the sum of the
+// sliders' own counts.
+__attribute__((target("avx2")))
+inline __m256i lanes_ray_attacks(__m256i sliders, __m256i empty, int dir) {
+    int step = RAY_STEP[dir];
+    uint64_t landing = RAY_LANDING[dir];
+    __m256i propagate = lanes_and(empty, _mm256_set1_epi64x((long long)landing));
+    __m256i gen = sliders;
+    gen = lanes_or(gen, lanes_and(propagate, lanes_step(gen, step, ~0ULL)));
+    propagate = lanes_and(propagate, lanes_step(propagate, step, ~0ULL));
+    gen = lanes_or(gen, lanes_and(propagate, lanes_step(gen, 2 * step, ~0ULL)));
+    propagate = lanes_and(propagate, lanes_step(propagate, 2 * step, ~0ULL));
+    gen = lanes_or(gen, lanes_and(propagate, lanes_step(gen, 4 * step, ~0ULL)));
+    return lanes_step(gen, step, landing);
+}
+
+// Writes four lane counts to one field of four traces; field points into
+// traces[0]
+__attribute__((target("avx2")))
+inline void store_lane_counts(__m256i counts, int* field) {
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, counts);
+    for (int k = 0; k < 4; k++) field[k * (sizeof(EvalTrace) / sizeof(int))] = (int)lanes[k];
+}
+
+// Traces evaluate_pawn_structure() and evaluate_expensive_terms() for four
+// consecutive positions of the batch at once. Mobility is counted per
+// direction rather than per piece: the knights' (or one slider type's)
+// attacks in a direction land on distinct squares, so the totals match.
+__attribute__((target("avx2")))
+void trace_batch_terms_avx2(const PositionBatch& batch, size_t first, EvalTrace traces[4]) {
+    __m256i bb[12];
+    for (int index = 0; index < 12; index++) {
+        bb[index] = _mm256_loadu_si256((const __m256i*)&batch.pieces[index][first]);
+    }
+    
+    __m256i occupied[2];
+    for (int c = 0; c < 2; c++) {
+        occupied[c] = bb[c * 6];
+        for (int p = 1; p < 6; p++) occupied[c] = lanes_or(occupied[c], bb[c * 6 + p]);
+    }
+    __m256i empty = lanes_andnot(_mm256_set1_epi64x(-1), lanes_or(occupied[0], occupied[1]));
+    __m256i pawn_attacks[2] = {
+        lanes_or(lanes_step(bb[0], -9, ~FILE_H_BB), lanes_step(bb[0], -7, ~FILE_A_BB)),
+        lanes_or(lanes_step(bb[6], 7, ~FILE_H_BB), lanes_step(bb[6], 9, ~FILE_A_BB))
+    };
+    
+    // Attack maps and mobility
+    __m256i by_color[2];
+    __m256i king_attacks[2];
+    for (int c = 0; c < 2; c++) {
+        int base = c * 6;
+        __m256i safe = lanes_andnot(lanes_andnot(_mm256_set1_epi64x(-1), occupied[c]), 
+                                    pawn_attacks[c ^ 1]);
+        __m256i attacked = pawn_attacks[c];
         
-        en_passant_target = Position();
-        if (toupper(static_cast<unsigned char>(piece)) == 'P' && abs(to_row - from_row) == 2) {
-            en_passant_target = Position((from_row + to_row) / 2, from_col);
+        king_attacks[c] = _mm256_setzero_si256();
+        __m256i knight_count = _mm256_setzero_si256();
+        for (int d = 0; d < 8; d++) {
+            __m256i k = lanes_step(bb[base + 5], RAY_STEP[d], RAY_LANDING[d]);
+            king_attacks[c] = lanes_or(king_attacks[c], k);
+            __m256i a = lanes_step(bb[base + 1], KNIGHT_STEP[d], KNIGHT_LANDING[d]);
+            attacked = lanes_or(attacked, a);
+            knight_count = _mm256_add_epi64(knight_count, lanes_popcount(lanes_and(a, safe)));
         }
+        attacked = lanes_or(attacked, king_attacks[c]);
+        store_lane_counts(knight_count, &traces[0].mobility[c][0]);
         
-        if (is_in_check(current_player)) {
-            restore_state(saved_state);
-            if (captured != ' ') {
-                captured_pieces[current_player].pop_back();
+        // Bishops use directions 2-3 and 6-7, rooks 0-1 and 4-5, queens all
+        for (int p = 1; p < 4; p++) {
+            __m256i count = _mm256_setzero_si256();
+            for (int d = 0; d < 8; d++) {
+                bool diagonal = (d & 2) != 0;
+                if ((p == 1 && !diagonal) || (p == 2 && diagonal)) continue;
+                __m256i a = lanes_ray_attacks(bb[base + 1 + p], empty, d);
+                attacked = lanes_or(attacked, a);
+                count = _mm256_add_epi64(count, lanes_popcount(lanes_and(a, safe)));
             }
-            return false;
+            store_lane_counts(count, &traces[0].mobility[c][p]);
         }
+        by_color[c] = attacked;
+    }
+    
+    __m256i file_span[2];
+    for (int c = 0; c < 2; c++) {
+        file_span[c] = lanes_or(lanes_north_fill(bb[c * 6]), lanes_south_fill(bb[c * 6]));
+    }
+    __m256i open_files = lanes_andnot(lanes_andnot(_mm256_set1_epi64x(-1), file_span[0]), file_span[1]);
+    
+    for (int c = 0; c < 2; c++) {
+        int base = c * 6;
+        __m256i own = bb[base];
+        __m256i enemy = bb[base ^ 6];
         
-        if (piece == 'P' && to_row == 0) {
-            board[to_row][to_col] = 'Q';
-        } else if (piece == 'p' && to_row == 7) {
-            board[to_row][to_col] = 'q';
+        // Pawn structure, as in evaluate_pawn_structure()
+        __m256i own_files = lanes_and(file_span[c], _mm256_set1_epi64x(0xFF));
+        store_lane_counts(_mm256_sub_epi64(lanes_popcount(own), lanes_popcount(own_files)), 
+                          &traces[0].doubled[c]);
+        
+        __m256i enemy_span = lanes_or(enemy, lanes_adjacent_files_of(enemy));
+        __m256i guarded = (c == 0) ? lanes_south_fill(_mm256_slli_epi64(enemy_span, 8)) : 
+                                     lanes_north_fill(_mm256_srli_epi64(enemy_span, 8));
+        __m256i passed = lanes_andnot(own, guarded);
+        __m256i advance = lanes_row_sum(passed);
+        if (c == 0) {
+            __m256i passed_count = lanes_popcount(passed);
+            __m256i seven_times = _mm256_sub_epi64(_mm256_slli_epi64(passed_count, 3), passed_count);
+            advance = _mm256_sub_epi64(seven_times, advance);
         }
+        store_lane_counts(advance, &traces[0].passed_ranks[c]);
         
-        string opponent = (current_player == "white") ? "black" : "white";
-        bool gives_check = is_in_check(opponent);
-        bool is_checkmate_move = gives_check && is_checkmate(opponent);
+        __m256i neighbour_files = lanes_adjacent_files_of(file_span[c]);
+        store_lane_counts(lanes_popcount(lanes_andnot(own, neighbour_files)), &traces[0].isolated[c]);
         
-        string pgn_move = to_pgn_notation(from_row, from_col, to_row, to_col, 
-                                         piece, is_capture, gives_check, is_checkmate_move);
-        pgn_moves.push_back(pgn_move);
+        __m256i supported = (c == 0) ? lanes_north_fill(lanes_adjacent_files_of(own)) : 
+                                       lanes_south_fill(lanes_adjacent_files_of(own));
+        __m256i stop_attacked = (c == 0) ? _mm256_slli_epi64(pawn_attacks[1], 8) : 
+                                           _mm256_srli_epi64(pawn_attacks[0], 8);
+        __m256i backward = lanes_andnot(lanes_and(own, neighbour_files), supported);
+        backward = lanes_and(backward, stop_attacked);
+        store_lane_counts(lanes_popcount(backward), &traces[0].backward[c]);
         
-        string from_pos = string(1, char('a' + from_col)) + char('0' + (8 - from_row));
-        string to_pos = string(1, char('a' + to_col)) + char('0' + (8 - to_row));
-        string move_notation = string(1, char(toupper(static_cast<unsigned char>(piece)))) + from_pos + "-" + to_pos;
-        move_history.push_back(move_notation);
+        // Rooks on open and semi-open files
+        __m256i rooks = bb[base + 3];
+        __m256i semi_open = lanes_andnot(_mm256_set1_epi64x(-1), file_span[c]);
+        store_lane_counts(lanes_popcount(lanes_and(rooks, open_files)), &traces[0].rook_open[c]);
+        store_lane_counts(lanes_popcount(lanes_andnot(lanes_and(rooks, semi_open), open_files)), 
+                          &traces[0].rook_semi_open[c]);
         
-        return true;
+        // King safety and hanging pieces
+        __m256i king = bb[base + 5];
+        uint64_t back_rank = (c == 0) ? 0xFFULL << 56 : 0xFFULL;
+        store_lane_counts(lanes_popcount(lanes_andnot(king, _mm256_set1_epi64x((long long)back_rank))), 
+                          &traces[0].king_exposed[c]);
+        store_lane_counts(lanes_popcount(lanes_and(king_attacks[c], by_color[c ^ 1])), 
+                          &traces[0].king_zone[c]);
+        __m256i pieces = lanes_andnot(lanes_andnot(occupied[c], own), king);
+        __m256i hanging = lanes_andnot(lanes_and(pieces, by_color[c ^ 1]), by_color[c]);
+        store_lane_counts(lanes_popcount(hanging), &traces[0].hanging[c]);
     }
+}
+#endif
+
+// Classical evaluation of every position in the batch, identical to
+// evaluate_position() (and so to evaluate_board() with a full window).
+// The material and piece-square pass streams over each piece type; with
+// AVX2 the attack maps, mobility and pawn structure are then found for four
+// positions at a time, leaving only the weighting and tapering per position.
+void evaluate_batch(const PositionBatch& batch, int* out) {
+    size_t n = batch.count;
+    if (n == 0) return;
+    vector<int32_t> counts(n);
+    vector<int32_t> material_key(n, 0);
+    vector<int32_t> overflow(n, 0);
+    vector<Score> psq(n, 0);
     
-    vector<Move> get_all_valid_moves(const string& color) {
-        vector<Move> moves;
-        
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                char piece = board[i][j];
-                if (piece != ' ' && get_piece_color(piece) == color) {
-                    vector<Position> piece_moves = get_piece_moves(i, j);
-                    for (size_t k = 0; k < piece_moves.size(); k++) {
-                        Position pos = piece_moves[k];
-                        GameState saved_state = save_state();
-                        
-                        board[pos.row][pos.col] = piece;
-                        board[i][j] = ' ';
-                        if (piece == 'K') {
-                            white_king_pos = Position(pos.row, pos.col);
-                        } else if (piece == 'k') {
-                            black_king_pos = Position(pos.row, pos.col);
-                        }
-                        
-                        if (!is_in_check(color)) {
-                            moves.push_back(Move(i, j, pos.row, pos.col));
-                        }
-                        
-                        restore_state(saved_state);
-                    }
-                }
-            }
+    // Material key and piece-square sum, one piece type at a time
+    for (int index = 0; index < 12; index++) {
+        const uint64_t* pieces = &batch.pieces[index][0];
+        popcount_array(pieces, n, &counts[0]);
+        int weight = MATERIAL_KEY_WEIGHT[index];
+        int cap = MATERIAL_CAP[index % 6];
+        for (size_t i = 0; i < n; i++) {
+            material_key[i] += counts[i] * weight;
+            overflow[i] += counts[i] > cap;
         }
         
-        return moves;
+        const Score* table = PSQ[index];
+        for (size_t i = 0; i < n; i++) {
+            Score sum = 0;
+            for (uint64_t b = pieces[i]; b; b &= b - 1) sum += table[lsb(b)];
+            psq[i] += sum;
+        }
     }
     
-    bool is_checkmate(const string& color) {
-        if (!is_in_check(color)) return false;
+    // Attack maps and pawn structure, four positions at a time
+    vector<Score> terms(n);
+    size_t traced = 0;
+#ifdef CHESS_AVX2_KERNEL
+    if (cpu_has_avx2()) {
+        for (; traced + 4 <= n; traced += 4) {
+            EvalTrace traces[4];
+            trace_batch_terms_avx2(batch, traced, traces);
+            for (int k = 0; k < 4; k++) terms[traced + k] = score_traced_terms(traces[k]);
+        }
+    }
+#endif
+
+    // Tapering per position; the rest of the batch, and positions the
+    // endgame rules score, go through the one-position evaluator
+    for (size_t i = 0; i < n; i++) {
+        uint64_t bb[12];
+        for (int index = 0; index < 12; index++) bb[index] = batch.pieces[index][i];
+        
+        MaterialEntry material;
+        if (overflow[i] == 0) {
+            material = MATERIAL_TABLE[material_key[i]];
+        } else {
+            int piece_counts[2][6];
+            for (int index = 0; index < 12; index++) {
+                piece_counts[index / 6][index % 6] = popcount(bb[index]);
+            }
+            material = compute_material_entry(piece_counts);
+        }
+        
+        bool generic = !(material.flags & MATERIAL_DRAW) && material.evaluator == EVAL_GENERIC;
+        if (i < traced && generic) {
+            out[i] = taper(psq[i] + material.imbalance + terms[i], material);
+        } else {
+            out[i] = evaluate_from_material(bb, psq[i], material);
+        }
+    }
+}
+
+// ============= EVALUATION PARAMETERS =============
+
+// Every tunable evaluation weight, in parameter-file order. Score weights
+// are midgame/endgame pairs; the other weights count towards both phases,
+// except the two king tables.
+enum ParamPhase { PARAM_BOTH, PARAM_MG, PARAM_EG, PARAM_SCORE };
+
+struct EvalParamGroup {
+    const char* name;
+    int size;
+    ParamPhase phase;
+};
+
+enum EvalParamGroupId {
+    PARAM_PIECE_VALUES, PARAM_PAWN_TABLE, PARAM_KNIGHT_TABLE, PARAM_BISHOP_TABLE,
+    PARAM_ROOK_TABLE, PARAM_QUEEN_TABLE, PARAM_KING_MIDDLE_TABLE, PARAM_KING_END_TABLE,
+    PARAM_DOUBLED_PAWN, PARAM_ISOLATED_PAWN, PARAM_BACKWARD_PAWN, PARAM_PASSED_PAWN_PER_RANK,
+    PARAM_MOBILITY, PARAM_KING_EXPOSED, PARAM_KING_ZONE_ATTACK, PARAM_HANGING_PIECE,
+    PARAM_ROOK_OPEN_FILE, PARAM_ROOK_SEMI_OPEN_FILE, PARAM_BISHOP_PAIR,
+    PARAM_KNIGHT_PAWN_ADJUST, PARAM_ROOK_PAWN_ADJUST,
+    NUM_EVAL_PARAM_GROUPS
+};
+
+const EvalParamGroup EVAL_PARAM_GROUPS[NUM_EVAL_PARAM_GROUPS] = {
+    {"piece_values", 5, PARAM_BOTH},        // P, N, B, R, Q
+    {"pawn_table", 64, PARAM_BOTH},
+    {"knight_table", 64, PARAM_BOTH},
+    {"bishop_table", 64, PARAM_BOTH},
+    {"rook_table", 64, PARAM_BOTH},
+    {"queen_table", 64, PARAM_BOTH},
+    {"king_middle_table", 64, PARAM_MG},
+    {"king_end_table", 64, PARAM_EG},
+    {"doubled_pawn", 2, PARAM_SCORE},
+    {"isolated_pawn", 2, PARAM_SCORE},
+    {"backward_pawn", 2, PARAM_SCORE},
+    {"passed_pawn_per_rank", 1, PARAM_BOTH},
+    {"mobility", 8, PARAM_SCORE},           // N, B, R, Q
+    {"king_exposed", 2, PARAM_SCORE},
+    {"king_zone_attack", 2, PARAM_SCORE},
+    {"hanging_piece", 2, PARAM_SCORE},
+    {"rook_open_file", 2, PARAM_SCORE},
+    {"rook_semi_open_file", 2, PARAM_SCORE},
+    {"bishop_pair", 2, PARAM_SCORE},
+    {"knight_pawn_adjust", 1, PARAM_BOTH},
+    {"rook_pawn_adjust", 1, PARAM_BOTH}
+};
+
+// Offset of each group in the flat parameter vector
+struct EvalParamLayout {
+    int offset[NUM_EVAL_PARAM_GROUPS];
+    int total;
+};
+
+constexpr EvalParamLayout build_eval_param_layout() {
+    EvalParamLayout layout{};
+    for (int g = 0; g < NUM_EVAL_PARAM_GROUPS; g++) {
+        layout.offset[g] = layout.total;
+        layout.total += EVAL_PARAM_GROUPS[g].size;
+    }
+    return layout;
+}
+
+constexpr EvalParamLayout EVAL_PARAM_LAYOUT = build_eval_param_layout();
+
+// Piece-square tables in the order of their parameter groups
+int (*eval_param_table(int group))[8] {
+    static int (*const tables[7])[8] = {
+        PAWN_TABLE, KNIGHT_TABLE, BISHOP_TABLE, ROOK_TABLE, QUEEN_TABLE,
+        KING_MIDDLE_TABLE, KING_END_TABLE
+    };
+    return tables[group - PARAM_PAWN_TABLE];
+}
+
+// Whether a flat parameter counts towards the midgame (bit 0) and endgame (bit 1)
+int eval_param_phase_mask(int group, int index) {
+    switch (EVAL_PARAM_GROUPS[group].phase) {
+        case PARAM_MG: return 1;
+        case PARAM_EG: return 2;
+        case PARAM_SCORE: return (index % 2 == 0) ? 1 : 2;
+        default: return 3;
+    }
+}
+
+void put_score_param(vector<int>& values, int group, int index, Score score) {
+    values[EVAL_PARAM_LAYOUT.offset[group] + 2 * index] = mg_value(score);
+    values[EVAL_PARAM_LAYOUT.offset[group] + 2 * index + 1] = eg_value(score);
+}
+
+// The weights currently in use, as a flat parameter vector
+void read_eval_params(vector<int>& values) {
+    values.assign(EVAL_PARAM_LAYOUT.total, 0);
+    for (int t = 0; t < 5; t++) {
+        values[EVAL_PARAM_LAYOUT.offset[PARAM_PIECE_VALUES] + t] = PieceValues::get("PNBRQ"[t]);
+    }
+    for (int g = PARAM_PAWN_TABLE; g <= PARAM_KING_END_TABLE; g++) {
+        int (*table)[8] = eval_param_table(g);
+        for (int sq = 0; sq < 64; sq++) {
+            values[EVAL_PARAM_LAYOUT.offset[g] + sq] = table[sq / 8][sq % 8];
+        }
+    }
+    put_score_param(values, PARAM_DOUBLED_PAWN, 0, DOUBLED_PAWN);
+    put_score_param(values, PARAM_ISOLATED_PAWN, 0, ISOLATED_PAWN);
+    put_score_param(values, PARAM_BACKWARD_PAWN, 0, BACKWARD_PAWN);
+    values[EVAL_PARAM_LAYOUT.offset[PARAM_PASSED_PAWN_PER_RANK]] = PASSED_PAWN_PER_RANK;
+    for (int p = 0; p < 4; p++) {
+        put_score_param(values, PARAM_MOBILITY, p, MOBILITY_WEIGHT[p]);
+    }
+    put_score_param(values, PARAM_KING_EXPOSED, 0, KING_EXPOSED);
+    put_score_param(values, PARAM_KING_ZONE_ATTACK, 0, KING_ZONE_ATTACK);
+    put_score_param(values, PARAM_HANGING_PIECE, 0, HANGING_PIECE);
+    put_score_param(values, PARAM_ROOK_OPEN_FILE, 0, ROOK_OPEN_FILE);
+    put_score_param(values, PARAM_ROOK_SEMI_OPEN_FILE, 0, ROOK_SEMI_OPEN_FILE);
+    put_score_param(values, PARAM_BISHOP_PAIR, 0, BISHOP_PAIR);
+    values[EVAL_PARAM_LAYOUT.offset[PARAM_KNIGHT_PAWN_ADJUST]] = KNIGHT_PAWN_ADJUST;
+    values[EVAL_PARAM_LAYOUT.offset[PARAM_ROOK_PAWN_ADJUST]] = ROOK_PAWN_ADJUST;
+}
+
+// Text parameter file: each group's name followed by its values. Tables are
+// written eight to a line in the same orientation as the source tables.
+bool write_eval_params(const string& path, const vector<int>& values) {
+    ofstream out(path.c_str());
+    if (!out) return false;
+    
+    out << "# Chess AI evaluation parameters (scores are midgame endgame pairs)" << endl;
+    for (int g = 0; g < NUM_EVAL_PARAM_GROUPS; g++) {
+        const EvalParamGroup& group = EVAL_PARAM_GROUPS[g];
+        out << group.name;
+        for (int i = 0; i < group.size; i++) {
+            if (group.size == 64 && i % 8 == 0) out << "\n   ";
+            out << " " << values[EVAL_PARAM_LAYOUT.offset[g] + i];
+        }
+        out << endl;
+    }
+    return (bool)out;
+}
+
+void get_score_param(const vector<int>& values, int group, int index, Score& score) {
+    score = make_score(values[EVAL_PARAM_LAYOUT.offset[group] + 2 * index],
+                       values[EVAL_PARAM_LAYOUT.offset[group] + 2 * index + 1]);
+}
+
+// Installs a flat parameter vector, re-bakes the piece-square and material
+// tables from it and rescales the lazy evaluation margin. Must run before
+// any game: cached evaluations would otherwise mix the old and new weights.
+void apply_eval_params(const vector<int>& values) {
+    static const int default_weight = expensive_term_weight();
+    
+    for (int t = 0; t < 5; t++) {
+        PieceValues::set("PNBRQ"[t], values[EVAL_PARAM_LAYOUT.offset[PARAM_PIECE_VALUES] + t]);
+    }
+    for (int g = PARAM_PAWN_TABLE; g <= PARAM_KING_END_TABLE; g++) {
+        int (*table)[8] = eval_param_table(g);
+        for (int sq = 0; sq < 64; sq++) {
+            table[sq / 8][sq % 8] = values[EVAL_PARAM_LAYOUT.offset[g] + sq];
+        }
+    }
+    get_score_param(values, PARAM_DOUBLED_PAWN, 0, DOUBLED_PAWN);
+    get_score_param(values, PARAM_ISOLATED_PAWN, 0, ISOLATED_PAWN);
+    get_score_param(values, PARAM_BACKWARD_PAWN, 0, BACKWARD_PAWN);
+    PASSED_PAWN_PER_RANK = values[EVAL_PARAM_LAYOUT.offset[PARAM_PASSED_PAWN_PER_RANK]];
+    for (int p = 0; p < 4; p++) {
+        get_score_param(values, PARAM_MOBILITY, p, MOBILITY_WEIGHT[p]);
+    }
+    get_score_param(values, PARAM_KING_EXPOSED, 0, KING_EXPOSED);
+    get_score_param(values, PARAM_KING_ZONE_ATTACK, 0, KING_ZONE_ATTACK);
+    get_score_param(values, PARAM_HANGING_PIECE, 0, HANGING_PIECE);
+    get_score_param(values, PARAM_ROOK_OPEN_FILE, 0, ROOK_OPEN_FILE);
+    get_score_param(values, PARAM_ROOK_SEMI_OPEN_FILE, 0, ROOK_SEMI_OPEN_FILE);
+    get_score_param(values, PARAM_BISHOP_PAIR, 0, BISHOP_PAIR);
+    KNIGHT_PAWN_ADJUST = values[EVAL_PARAM_LAYOUT.offset[PARAM_KNIGHT_PAWN_ADJUST]];
+    ROOK_PAWN_ADJUST = values[EVAL_PARAM_LAYOUT.offset[PARAM_ROOK_PAWN_ADJUST]];
+    
+    // Heavier expensive terms can swing the score further than the default
+    // margin allows for, which would make lazy exits return wrong bounds
+    int weight = expensive_term_weight();
+    LAZY_EVAL_MARGIN = (int)(((int64_t)DEFAULT_LAZY_EVAL_MARGIN * weight + default_weight - 1) / 
+                             default_weight);
+    
+    init_piece_square_tables();
+    init_material_table();
+}
+
+// Largest weight magnitude accepted from a file, leaving room for a piece's
+// value plus its table bonus in a 16-bit score half
+const int MAX_EVAL_PARAM = 10000;
+
+// Reads a parameter file as written by write_eval_params(). Groups may come
+// in any order and may be left out (keeping the current values), but each
+// one present must have exactly its expected number of values. On failure
+// error describes the first problem.
+bool load_eval_params(const string& path, vector<int>& values, string& error) {
+    ifstream in(path.c_str());
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    read_eval_params(values);
+    
+    int group = -1;
+    int filled = 0;
+    string line;
+    for (int line_number = 1; getline(in, line); line_number++) {
+        size_t comment = line.find('#');
+        if (comment != string::npos) line.erase(comment);
+        istringstream tokens(line);
+        string token;
+        while (tokens >> token) {
+            ostringstream where;
+            where << path << ":" << line_number << ": ";
+            if (isalpha(static_cast<unsigned char>(token[0]))) {
+                if (group >= 0 && filled != EVAL_PARAM_GROUPS[group].size) {
+                    error = where.str() + EVAL_PARAM_GROUPS[group].name + " is incomplete";
+                    return false;
+                }
+                group = -1;
+                for (int g = 0; g < NUM_EVAL_PARAM_GROUPS; g++) {
+                    if (token == EVAL_PARAM_GROUPS[g].name) group = g;
+                }
+                if (group < 0) {
+                    error = where.str() + "unknown parameter " + token;
+                    return false;
+                }
+                filled = 0;
+                continue;
+            }
+            
+            char* end = NULL;
+            long value = strtol(token.c_str(), &end, 10);
+            if (*end != '\0' || labs(value) > MAX_EVAL_PARAM) {
+                error = where.str() + "bad value " + token;
+                return false;
+            }
+            if (group < 0 || filled >= EVAL_PARAM_GROUPS[group].size) {
+                error = where.str() + "unexpected value " + token;
+                return false;
+            }
+            values[EVAL_PARAM_LAYOUT.offset[group] + filled++] = (int)value;
+        }
+    }
+    if (group >= 0 && filled != EVAL_PARAM_GROUPS[group].size) {
+        error = path + ": " + EVAL_PARAM_GROUPS[group].name + " is incomplete";
+        return false;
+    }
+    return true;
+}
+
+// ============= FEN / EPD =============
+
+const char STANDARD_START_FEN[] = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+const size_t FEN_BUFFER_SIZE = 128;   // longer than any valid FEN record
+
+inline bool is_fen_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Next space-separated field of a record, advancing pos past it
+string_view next_fen_field(string_view record, size_t& pos) {
+    while (pos < record.size() && is_fen_space(record[pos])) pos++;
+    size_t start = pos;
+    while (pos < record.size() && !is_fen_space(record[pos])) pos++;
+    return string_view(record.data() + start, pos - start);
+}
+
+// Piece placement field into squares[row * 8 + col] (' ' for empty), with
+// exactly one king per side
+bool parse_fen_board(string_view placement, char squares[64]) {
+    memset(squares, ' ', 64);
+    int row = 0;
+    int col = 0;
+    int kings[2] = { 0, 0 };
+    for (size_t i = 0; i < placement.size(); i++) {
+        char c = placement[i];
+        if (c == '/') {
+            if (col != 8 || row == 7) return false;
+            row++;
+            col = 0;
+        } else if (c >= '1' && c <= '8') {
+            col += c - '0';
+        } else {
+            int index = piece_index(c);
+            if (index < 0 || col >= 8) return false;
+            if (index % 6 == 5) kings[index / 6]++;
+            squares[row * 8 + col] = c;
+            col++;
+        }
+        if (col > 8) return false;
+    }
+    return row == 7 && col == 8 && kings[0] == 1 && kings[1] == 1;
+}
+
+// Piece placement field of a FEN record into bitboards
+bool parse_fen_placement(string_view placement, uint64_t bb[12]) {
+    char squares[64];
+    if (!parse_fen_board(placement, squares)) return false;
+    memset(bb, 0, 12 * sizeof(uint64_t));
+    for (int sq = 0; sq < 64; sq++) {
+        int index = piece_index(squares[sq]);
+        if (index >= 0) bb[index] |= 1ULL << sq;
+    }
+    return true;
+}
+
+// Non-negative decimal number filling the whole field
+bool parse_fen_number(string_view field, int& value) {
+    if (field.empty() || field.size() > 6) return false;
+    value = 0;
+    for (size_t i = 0; i < field.size(); i++) {
+        if (field[i] < '0' || field[i] > '9') return false;
+        value = value * 10 + (field[i] - '0');
+    }
+    return true;
+}
+
+// Writes " <value>" at out + n and returns the new length
+size_t append_fen_number(char* out, size_t n, int value) {
+    char digits[12];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    out[n++] = ' ';
+    while (count > 0) out[n++] = digits[--count];
+    return n;
+}
+
+// ============= TEXEL TUNING =============
+
+// The evaluation is linear in its weights once the phase and endgame scale
+// are fixed, so each labelled position is reduced to sparse coefficients
+// (white count minus black count) of the parameters it touches.
+struct TuneCoefficient {
+    uint16_t index;
+    int16_t count;
+};
+
+struct TunePosition {
+    float result;      // 1 white win, 0.5 draw, 0 black win
+    uint8_t phase;
+    uint8_t scale[2];
+    uint32_t first;    // into TuneData::coefficients
+    uint16_t count;
+};
+
+struct TuneData {
+    vector<TunePosition> positions;
+    vector<TuneCoefficient> coefficients;
+};
+
+// Game result anywhere in a dataset line: "1-0", "0-1", "1/2-1/2" or [1.0],
+// [0.5], [0.0]
+bool parse_tune_result(string_view line, float& result) {
+    if (line.find("1/2-1/2") != string_view::npos || line.find("[0.5]") != string_view::npos) {
+        result = 0.5f;
+    } else if (line.find("1-0") != string_view::npos || line.find("[1.0]") != string_view::npos) {
+        result = 1.0f;
+    } else if (line.find("0-1") != string_view::npos || line.find("[0.0]") != string_view::npos) {
+        result = 0.0f;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Adds a position's coefficients to data; positions the endgame rules
+// score instead of the weights are skipped
+bool add_tune_position(const uint64_t bb[12], float result, TuneData& data) {
+    int counts[2][6];
+    for (int index = 0; index < 12; index++) {
+        counts[index / 6][index % 6] = popcount(bb[index]);
+    }
+    MaterialEntry scratch;
+    const MaterialEntry& material = lookup_material(counts, scratch);
+    if ((material.flags & MATERIAL_DRAW) || material.evaluator != EVAL_GENERIC) return false;
+    
+    EvalTrace trace;
+    memset(&trace, 0, sizeof(trace));
+    PawnEntry pawns;
+    evaluate_pawn_structure(bb[0], bb[6], pawns, &trace);
+    evaluate_expensive_terms(bb, pawns, &trace);
+    
+    int coef[EVAL_PARAM_LAYOUT.total];
+    memset(coef, 0, sizeof(coef));
+    const int* offset = EVAL_PARAM_LAYOUT.offset;
+    
+    for (int index = 0; index < 12; index++) {
+        int c = index / 6;
+        int t = index % 6;
+        int sign = (c == 0) ? 1 : -1;
+        if (t < 5) coef[offset[PARAM_PIECE_VALUES] + t] += sign * counts[c][t];
+        for (uint64_t b = bb[index]; b; b &= b - 1) {
+            int sq = lsb(b);
+            int table_sq = (c == 0) ? (7 - sq / 8) * 8 + sq % 8 : sq;
+            if (t < 5) {
+                coef[offset[PARAM_PAWN_TABLE + t] + table_sq] += sign;
+            } else {
+                coef[offset[PARAM_KING_MIDDLE_TABLE] + table_sq] += sign;
+                coef[offset[PARAM_KING_END_TABLE] + table_sq] += sign;
+            }
+        }
+    }
+    
+    // Score terms move both halves of their pair
+    int score_terms[][2] = {
+        {PARAM_DOUBLED_PAWN, trace.doubled[0] - trace.doubled[1]},
+        {PARAM_ISOLATED_PAWN, trace.isolated[0] - trace.isolated[1]},
+        {PARAM_BACKWARD_PAWN, trace.backward[0] - trace.backward[1]},
+        {PARAM_KING_EXPOSED, trace.king_exposed[0] - trace.king_exposed[1]},
+        {PARAM_KING_ZONE_ATTACK, trace.king_zone[0] - trace.king_zone[1]},
+        {PARAM_HANGING_PIECE, trace.hanging[0] - trace.hanging[1]},
+        {PARAM_ROOK_OPEN_FILE, trace.rook_open[0] - trace.rook_open[1]},
+        {PARAM_ROOK_SEMI_OPEN_FILE, trace.rook_semi_open[0] - trace.rook_semi_open[1]},
+        {PARAM_BISHOP_PAIR, (counts[0][2] >= 2) - (counts[1][2] >= 2)}
+    };
+    for (size_t i = 0; i < sizeof(score_terms) / sizeof(score_terms[0]); i++) {
+        coef[offset[score_terms[i][0]]] += score_terms[i][1];
+        coef[offset[score_terms[i][0]] + 1] += score_terms[i][1];
+    }
+    for (int p = 0; p < 4; p++) {
+        coef[offset[PARAM_MOBILITY] + 2 * p] += trace.mobility[0][p] - trace.mobility[1][p];
+        coef[offset[PARAM_MOBILITY] + 2 * p + 1] += trace.mobility[0][p] - trace.mobility[1][p];
+    }
+    coef[offset[PARAM_PASSED_PAWN_PER_RANK]] += trace.passed_ranks[0] - trace.passed_ranks[1];
+    coef[offset[PARAM_KNIGHT_PAWN_ADJUST]] += 
+        counts[0][1] * (counts[0][0] - 5) - counts[1][1] * (counts[1][0] - 5);
+    coef[offset[PARAM_ROOK_PAWN_ADJUST]] += 
+        counts[0][3] * (counts[0][0] - 5) - counts[1][3] * (counts[1][0] - 5);
+    
+    TunePosition pos;
+    pos.result = result;
+    pos.phase = material.phase;
+    pos.scale[0] = material.scale[0];
+    pos.scale[1] = material.scale[1];
+    pos.first = (uint32_t)data.coefficients.size();
+    for (int i = 0; i < EVAL_PARAM_LAYOUT.total; i++) {
+        if (coef[i] == 0) continue;
+        TuneCoefficient c;
+        c.index = (uint16_t)i;
+        c.count = (int16_t)coef[i];
+        data.coefficients.push_back(c);
+    }
+    pos.count = (uint16_t)(data.coefficients.size() - pos.first);
+    data.positions.push_back(pos);
+    return true;
+}
+
+// Parses one slice of the dataset's lines on a worker thread
+struct TuneLoader {
+    const string* text;
+    size_t begin, end;   // byte range; lines starting inside it belong to this loader
+    TuneData data;
+    long skipped;
+    
+    void run() {
+        skipped = 0;
+        size_t pos = begin;
+        if (pos > 0 && (*text)[pos - 1] != '\n') {
+            pos = text->find('\n', pos);
+            pos = (pos == string::npos) ? text->size() : pos + 1;
+        }
+        while (pos < end) {
+            size_t line_end = text->find('\n', pos);
+            if (line_end == string::npos) line_end = text->size();
+            string_view line(text->data() + pos, line_end - pos);
+            pos = line_end + 1;
+            
+            size_t field_end = line.find(' ');
+            uint64_t bb[12];
+            float result;
+            if (line.empty() || line[0] == '#') continue;
+            if (field_end == string_view::npos || !parse_fen_placement(line.substr(0, field_end), bb) ||
+                !parse_tune_result(line.substr(field_end), result) ||
+                !add_tune_position(bb, result, data)) {
+                skipped++;
+            }
+        }
+    }
+};
+
+bool load_tune_data(const string& path, int num_threads, TuneData& data, long& skipped) {
+    ifstream in(path.c_str(), ios::binary);
+    if (!in) return false;
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    
+    vector<TuneLoader> loaders(num_threads);
+    vector<thread> workers;
+    for (int t = 0; t < num_threads; t++) {
+        loaders[t].text = &text;
+        loaders[t].begin = text.size() * t / num_threads;
+        loaders[t].end = text.size() * (t + 1) / num_threads;
+        workers.push_back(thread(&TuneLoader::run, &loaders[t]));
+    }
+    
+    skipped = 0;
+    for (int t = 0; t < num_threads; t++) {
+        workers[t].join();
+        uint32_t base = (uint32_t)data.coefficients.size();
+        for (size_t i = 0; i < loaders[t].data.positions.size(); i++) {
+            TunePosition pos = loaders[t].data.positions[i];
+            pos.first += base;
+            data.positions.push_back(pos);
+        }
+        data.coefficients.insert(data.coefficients.end(), loaders[t].data.coefficients.begin(),
+                                 loaders[t].data.coefficients.end());
+        skipped += loaders[t].skipped;
+        loaders[t].data = TuneData();
+    }
+    return true;
+}
+
+// Error (and optionally its gradient) over one slice of the positions,
+// with the win probability 1 / (1 + 10^(-k * eval / 400))
+struct TuneWorker {
+    const TuneData* data;
+    size_t begin, end;
+    const double* weights_mg;     // parameter value where it counts for the midgame, else 0
+    const double* weights_eg;
+    const uint8_t* phase_mask;    // eval_param_phase_mask() per parameter
+    double k;
+    bool want_gradient;
+    double error;
+    vector<double> gradient;
+    
+    void run() {
+        error = 0;
+        if (want_gradient) gradient.assign(EVAL_PARAM_LAYOUT.total, 0.0);
+        for (size_t p = begin; p < end; p++) {
+            const TunePosition& pos = data->positions[p];
+            const TuneCoefficient* coef = &data->coefficients[pos.first];
+            double mg = 0;
+            double eg = 0;
+            for (int i = 0; i < pos.count; i++) {
+                mg += coef[i].count * weights_mg[coef[i].index];
+                eg += coef[i].count * weights_eg[coef[i].index];
+            }
+            double mg_factor = pos.phase / (double)MAX_PHASE;
+            double eg_factor = pos.scale[eg > 0 ? 0 : 1] / (double)SCALE_NORMAL *
+                               (MAX_PHASE - pos.phase) / MAX_PHASE;
+            double sigmoid = 1.0 / (1.0 + pow(10.0, -k * (mg * mg_factor + eg * eg_factor) / 400.0));
+            double diff = pos.result - sigmoid;
+            error += diff * diff;
+            if (!want_gradient) continue;
+            
+            double slope = -2.0 * diff * sigmoid * (1.0 - sigmoid) * k * log(10.0) / 400.0;
+            double factor[4] = { 0, mg_factor, eg_factor, mg_factor + eg_factor };
+            for (int i = 0; i < pos.count; i++) {
+                int index = coef[i].index;
+                gradient[index] += slope * coef[i].count * factor[phase_mask[index]];
+            }
+        }
+    }
+};
+
+// Mean error over all positions, split across num_threads threads; fills
+// gradient with the mean gradient when given one
+double tune_error(const TuneData& data, const vector<double>& params, double k, 
+                  int num_threads, vector<double>* gradient) {
+    int total = EVAL_PARAM_LAYOUT.total;
+    vector<double> weights_mg(total);
+    vector<double> weights_eg(total);
+    vector<uint8_t> phase_mask(total);
+    for (int g = 0; g < NUM_EVAL_PARAM_GROUPS; g++) {
+        for (int i = 0; i < EVAL_PARAM_GROUPS[g].size; i++) {
+            int index = EVAL_PARAM_LAYOUT.offset[g] + i;
+            phase_mask[index] = (uint8_t)eval_param_phase_mask(g, i);
+            weights_mg[index] = (phase_mask[index] & 1) ? params[index] : 0.0;
+            weights_eg[index] = (phase_mask[index] & 2) ? params[index] : 0.0;
+        }
+    }
+    
+    size_t n = data.positions.size();
+    vector<TuneWorker> slices(num_threads);
+    vector<thread> workers;
+    for (int t = 0; t < num_threads; t++) {
+        TuneWorker& slice = slices[t];
+        slice.data = &data;
+        slice.begin = n * t / num_threads;
+        slice.end = n * (t + 1) / num_threads;
+        slice.weights_mg = &weights_mg[0];
+        slice.weights_eg = &weights_eg[0];
+        slice.phase_mask = &phase_mask[0];
+        slice.k = k;
+        slice.want_gradient = (gradient != NULL);
+        workers.push_back(thread(&TuneWorker::run, &slice));
+    }
+    
+    double error = 0;
+    if (gradient) gradient->assign(total, 0.0);
+    for (int t = 0; t < num_threads; t++) {
+        workers[t].join();
+        error += slices[t].error;
+        if (!gradient) continue;
+        for (int i = 0; i < total; i++) (*gradient)[i] += slices[t].gradient[i] / n;
+    }
+    return error / n;
+}
+
+// Scaling constant of the logistic mapping that best fits the current weights
+double fit_tune_k(const TuneData& data, const vector<double>& params, int num_threads) {
+    double k = 1.0;
+    double best = tune_error(data, params, k, num_threads, NULL);
+    for (double step = 0.1; step >= 0.001; step /= 10) {
+        for (int dir = -1; dir <= 1; dir += 2) {
+            while (k + dir * step > 0) {
+                double error = tune_error(data, params, k + dir * step, num_threads, NULL);
+                if (error >= best) break;
+                best = error;
+                k += dir * step;
+            }
+        }
+    }
+    return k;
+}
+
+// Texel tuning: fits every evaluation weight to the game results of a
+// labelled position set (one position per line, FEN placement first and
+// the result anywhere after it) with Adam gradient descent, then writes the
+// rounded weights as a parameter file.
+int run_texel_tuning(const string& data_path, const string& out_path, int iterations) {
+    int num_threads = max(1, (int)thread::hardware_concurrency());
+    TuneData data;
+    long skipped = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (!load_tune_data(data_path, num_threads, data, skipped)) {
+        cerr << "Cannot read tuning positions from " << data_path << endl;
+        return 1;
+    }
+    if (data.positions.empty()) {
+        cerr << "No usable positions in " << data_path << endl;
+        return 1;
+    }
+    cout << "Loaded " << data.positions.size() << " positions (" << skipped << " skipped) in "
+         << fixed << setprecision(2) 
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << "s" << endl;
+    
+    vector<int> initial;
+    read_eval_params(initial);
+    vector<double> params(initial.begin(), initial.end());
+    double k = fit_tune_k(data, params, num_threads);
+    cout << setprecision(6) << "K = " << k << ", initial error " 
+         << tune_error(data, params, k, num_threads, NULL) << endl;
+    
+    const double learning_rate = 1.0;
+    const double beta1 = 0.9;
+    const double beta2 = 0.999;
+    vector<double> gradient;
+    vector<double> momentum(params.size(), 0.0);
+    vector<double> velocity(params.size(), 0.0);
+    for (int it = 1; it <= iterations; it++) {
+        double error = tune_error(data, params, k, num_threads, &gradient);
+        for (size_t i = 0; i < params.size(); i++) {
+            momentum[i] = beta1 * momentum[i] + (1 - beta1) * gradient[i];
+            velocity[i] = beta2 * velocity[i] + (1 - beta2) * gradient[i] * gradient[i];
+            double m = momentum[i] / (1 - pow(beta1, it));
+            double v = velocity[i] / (1 - pow(beta2, it));
+            params[i] -= learning_rate * m / (sqrt(v) + 1e-8);
+        }
+        if (it % 10 == 0 || it == iterations) {
+            cout << "Iteration " << it << ": error " << error << endl;
+        }
+    }
+    
+    vector<int> tuned(params.size());
+    for (size_t i = 0; i < params.size(); i++) tuned[i] = (int)lround(params[i]);
+    vector<double> rounded(tuned.begin(), tuned.end());
+    cout << "Final error " << tune_error(data, rounded, k, num_threads, NULL) << endl;
+    
+    if (!write_eval_params(out_path, tuned)) {
+        cerr << "Cannot write parameters to " << out_path << endl;
+        return 1;
+    }
+    cout << "Wrote tuned parameters to " << out_path << endl;
+    return 0;
+}
+
+// ============= GAME RECORDS =============
+
+// Binary game record file: "CHGAMES1", then one record per game, appended
+// as games finish:
+//   uint8  result (0 white wins, 1 black wins, 2 draw)
+//   uint8  white difficulty
+//   uint8  black difficulty
+//   uint8  reserved, 0
+//   uint32 seed (little-endian)
+//   uint16 plies (little-endian)
+//   plies bytes, each the index of the move played in the sorted list of
+//   legal move keys (see Chess::get_sorted_move_keys)
+// Games always start from the standard position.
+const char GAME_RECORD_MAGIC[] = "CHGAMES1";
+const size_t GAME_RECORD_MAGIC_SIZE = 8;
+const size_t GAME_RECORD_HEADER_SIZE = 10;
+const char GAME_RECORD_PROMOTIONS[] = "QRBN";
+
+enum GameRecordResult { RECORD_WHITE_WINS = 0, RECORD_BLACK_WINS = 1, RECORD_DRAW = 2 };
+
+struct GameRecord {
+    uint8_t result;
+    uint8_t white_difficulty;
+    uint8_t black_difficulty;
+    uint32_t seed;
+    vector<uint8_t> moves;
+    
+    GameRecord() : result(RECORD_DRAW), white_difficulty(0), black_difficulty(0), seed(0) {}
+};
+
+void append_game_record(string& out, const GameRecord& record) {
+    size_t plies = record.moves.size();
+    char header[GAME_RECORD_HEADER_SIZE] = {
+        (char)record.result, (char)record.white_difficulty, (char)record.black_difficulty, 0,
+        (char)(record.seed & 0xFF), (char)((record.seed >> 8) & 0xFF),
+        (char)((record.seed >> 16) & 0xFF), (char)(record.seed >> 24),
+        (char)(plies & 0xFF), (char)(plies >> 8)
+    };
+    out.append(header, GAME_RECORD_HEADER_SIZE);
+    if (plies > 0) out.append((const char*)&record.moves[0], plies);
+}
+
+inline size_t game_record_plies(const unsigned char* header) {
+    return header[8] | ((size_t)header[9] << 8);
+}
+
+// Read-only view of a whole file: memory-mapped where available, read into
+// memory otherwise
+class MappedFile {
+private:
+    const char* bytes;
+    size_t length;
+    string buffer;
+    bool mapped;
+
+public:
+    MappedFile() : bytes(NULL), length(0), mapped(false) {}
+    
+    ~MappedFile() {
+        close();
+    }
+    
+    bool open(const string& path) {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t)st.st_size;
+        if (length > 0) {
+            void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (addr == MAP_FAILED) {
+                length = 0;
+                return false;
+            }
+            madvise(addr, length, MADV_SEQUENTIAL);
+            bytes = (const char*)addr;
+            mapped = true;
+        } else {
+            ::close(fd);
+        }
+        return true;
+#else
+        ifstream in(path.c_str(), ios::binary);
+        if (!in) return false;
+        buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+        return true;
+#endif
+    }
+    
+    void close() {
+#ifndef _WIN32
+        if (mapped) munmap((void*)bytes, length);
+#endif
+        mapped = false;
+        bytes = NULL;
+        length = 0;
+        buffer.clear();
+    }
+    
+    string_view view() const { return string_view(bytes ? bytes : "", length); }
+};
+
+// Random access to the records of a game record file through a memory map.
+// A torn record at the end (from an interrupted writer) is ignored.
+class GameRecordReader {
+private:
+    MappedFile file;
+    vector<size_t> offsets;
+    size_t end;   // end of the last complete record
+
+public:
+    GameRecordReader() : end(0) {}
+    
+    bool open(const string& path) {
+        offsets.clear();
+        end = 0;
+        if (!file.open(path)) return false;
+        string_view data = file.view();
+        if (data.size() < GAME_RECORD_MAGIC_SIZE || 
+            data.substr(0, GAME_RECORD_MAGIC_SIZE) != string_view(GAME_RECORD_MAGIC, GAME_RECORD_MAGIC_SIZE)) {
+            return false;
+        }
+        
+        size_t pos = GAME_RECORD_MAGIC_SIZE;
+        while (pos + GAME_RECORD_HEADER_SIZE <= data.size()) {
+            size_t plies = game_record_plies((const unsigned char*)data.data() + pos);
+            if (pos + GAME_RECORD_HEADER_SIZE + plies > data.size()) break;
+            offsets.push_back(pos);
+            pos += GAME_RECORD_HEADER_SIZE + plies;
+        }
+        end = pos;
+        return true;
+    }
+    
+    size_t size() const { return offsets.size(); }
+    size_t get_end() const { return end; }
+    size_t get_file_size() const { return file.view().size(); }
+    
+    void read(size_t index, GameRecord& record) const {
+        const unsigned char* header = (const unsigned char*)file.view().data() + offsets[index];
+        record.result = header[0];
+        record.white_difficulty = header[1];
+        record.black_difficulty = header[2];
+        record.seed = header[4] | ((uint32_t)header[5] << 8) | 
+                      ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+        const unsigned char* moves = header + GAME_RECORD_HEADER_SIZE;
+        record.moves.assign(moves, moves + game_record_plies(header));
+    }
+};
+
+// Appends records to a game record file. Records are buffered and written
+// in large blocks; append() may be called from several threads.
+class GameRecordWriter {
+private:
+    ofstream file;
+    string buffer;
+    mutex lock;
+    long count;
+    long bytes;
+    
+    bool flush_buffer() {
+        if (!buffer.empty()) {
+            file.write(buffer.data(), buffer.size());
+            bytes += buffer.size();
+            buffer.clear();
+        }
+        return !file.fail();
+    }
+
+public:
+    static const size_t BUFFER_SIZE = 1 << 20;
+    
+    GameRecordWriter() : count(0), bytes(0) {}
+    
+    ~GameRecordWriter() {
+        close();
+    }
+    
+    // Opens path for appending, creating it if needed. An existing file
+    // must already be a game record file; a torn record at its end is cut
+    // off so new records follow the last complete one.
+    bool open(const string& path) {
+        bool empty = true;
+        size_t end = 0, file_size = 0;
+        {
+            GameRecordReader existing;
+            if (existing.open(path)) {
+                empty = false;
+                end = existing.get_end();
+                file_size = existing.get_file_size();
+            } else {
+                ifstream probe(path.c_str(), ios::binary | ios::ate);
+                if (probe && probe.tellg() > 0) return false;
+            }
+        }
+        if (end < file_size) {
+            error_code error;
+            filesystem::resize_file(path, end, error);
+            if (error) return false;
+        }
+        
+        file.open(path.c_str(), ios::binary | ios::app);
+        if (!file.is_open()) return false;
+        if (empty) buffer.append(GAME_RECORD_MAGIC, GAME_RECORD_MAGIC_SIZE);
+        buffer.reserve(BUFFER_SIZE + GAME_RECORD_HEADER_SIZE + 65536);
+        return true;
+    }
+    
+    void append(const GameRecord& record) {
+        lock_guard<mutex> guard(lock);
+        append_game_record(buffer, record);
+        count++;
+        if (buffer.size() >= BUFFER_SIZE) flush_buffer();
+    }
+    
+    bool close() {
+        lock_guard<mutex> guard(lock);
+        if (!file.is_open()) return true;
+        bool ok = flush_buffer();
+        file.close();
+        return ok && !file.fail();
+    }
+    
+    long get_count() const { return count; }
+    long get_bytes() const { return bytes; }
+};
+
+// ============= PGN OUTPUT =============
+
+const char ENGINE_VERSION[] = "chess-ai v4";
+
+// "<prefix>_YYYYMMDD_HHMMSS<extension>", with "_2", "_3", ... appended when
+// an earlier file from the same second already has that name
+string timestamped_filename(const string& prefix, const string& extension) {
+    time_t now = time(0);
+    tm* ltm = localtime(&now);
+    char stamp[80];
+    snprintf(stamp, sizeof(stamp), "_%04d%02d%02d_%02d%02d%02d",
+            1900 + ltm->tm_year, 1 + ltm->tm_mon, ltm->tm_mday,
+            ltm->tm_hour, ltm->tm_min, ltm->tm_sec);
+    
+    string base = prefix + stamp;
+    string name = base + extension;
+    for (int n = 2; filesystem::exists(name) || filesystem::exists(name + ".part"); n++) {
+        name = base + "_" + to_string(n) + extension;
+    }
+    return name;
+}
+
+// Streams many games into large PGN files. Games are collected in a
+// user-space buffer; a background thread writes each full buffer with a
+// single write while the next one fills.
+//
+// Output goes to "<name>.part" and is renamed to <name> only once it has
+// been synced and closed, so a crash never leaves a finished-looking file
+// with a torn game in it. With a rotation size, a new file is started
+// after whichever buffer write takes the current one past that size.
+class PgnStreamWriter {
+private:
+    string base;           // path without its ".pgn" extension
+    size_t rotate_bytes;   // 0 for a single file
+    size_t flush_bytes;    // buffer size that triggers a write
+    int segment;
+    FILE* file;
+    string segment_path;
+    size_t segment_bytes;
+    vector<string> finished;
+    
+    string filling;        // games being added
+    string flushing;       // buffer handed to the flush thread
+    bool flush_pending;
+    bool stopping;
+    bool failed;
+    mutex lock;
+    condition_variable flush_ready;
+    condition_variable flush_done;
+    thread flusher;
+    long games;
+    long bytes;
+    
+    string next_segment_path() {
+        while (true) {
+            string path = base;
+            if (rotate_bytes > 0) {
+                char suffix[16];
+                snprintf(suffix, sizeof(suffix), "_%04d", ++segment);
+                path += suffix;
+            }
+            path += ".pgn";
+            if (!filesystem::exists(path) && !filesystem::exists(path + ".part")) return path;
+            if (rotate_bytes == 0) return string();
+        }
+    }
+    
+    bool open_segment() {
+        segment_path = next_segment_path();
+        if (segment_path.empty()) return false;
+        file = fopen((segment_path + ".part").c_str(), "wb");
+        if (!file) return false;
+        setvbuf(file, NULL, _IONBF, 0);
+        segment_bytes = 0;
+        return true;
+    }
+    
+    bool finish_segment() {
+        if (!file) return true;
+        bool ok = fflush(file) == 0;
+#ifndef _WIN32
+        ok = fsync(fileno(file)) == 0 && ok;
+#endif
+        ok = fclose(file) == 0 && ok;
+        file = NULL;
+        ok = ok && rename((segment_path + ".part").c_str(), segment_path.c_str()) == 0;
+        if (ok) finished.push_back(segment_path);
+        return ok;
+    }
+    
+    // Writes one buffer; runs on the flush thread only
+    bool write_buffer(const string& data) {
+        if (data.empty()) return true;
+        if (!file && !open_segment()) return false;
+        if (fwrite(data.data(), 1, data.size(), file) != data.size()) return false;
+        segment_bytes += data.size();
+        if (rotate_bytes > 0 && segment_bytes >= rotate_bytes) return finish_segment();
+        return true;
+    }
+    
+    // Hands the filling buffer to the flush thread; lock must be held
+    void queue_flush(unique_lock<mutex>& guard) {
+        while (flush_pending) flush_done.wait(guard);
+        swap(filling, flushing);
+        flush_pending = true;
+        flush_ready.notify_one();
+    }
+
+public:
+    static const size_t BUFFER_SIZE = 4 << 20;
+    
+    PgnStreamWriter() 
+        : rotate_bytes(0), flush_bytes(BUFFER_SIZE), segment(0), file(NULL), segment_bytes(0), 
+          flush_pending(false), stopping(false), failed(false), games(0), bytes(0) {}
+    
+    ~PgnStreamWriter() {
+        close();
+    }
+    
+    // Starts writing to path (or path's numbered segments when rotating).
+    // A single output file must not already exist.
+    bool open(const string& path, size_t rotate_size) {
+        base = path;
+        if (base.size() > 4 && base.compare(base.size() - 4, 4, ".pgn") == 0) {
+            base.resize(base.size() - 4);
+        }
+        rotate_bytes = rotate_size;
+        flush_bytes = (rotate_bytes > 0 && rotate_bytes < BUFFER_SIZE) ? rotate_bytes : BUFFER_SIZE;
+        if (!open_segment()) return false;
+        
+        filling.reserve(BUFFER_SIZE + 65536);
+        flushing.reserve(BUFFER_SIZE + 65536);
+        flusher = thread(&PgnStreamWriter::run, this);
+        return true;
+    }
+    
+    void run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            while (!flush_pending && !stopping) flush_ready.wait(guard);
+            if (!flush_pending) break;
+            
+            guard.unlock();
+            bool ok = write_buffer(flushing);
+            bytes += flushing.size();
+            flushing.clear();
+            guard.lock();
+            
+            if (!ok) failed = true;
+            flush_pending = false;
+            flush_done.notify_all();
+        }
+    }
+    
+    // Adds a game's PGN; may be called from several threads
+    void append(const string& pgn) {
+        unique_lock<mutex> guard(lock);
+        filling += pgn;
+        filling += '\n';
+        games++;
+        if (filling.size() >= flush_bytes) queue_flush(guard);
+    }
+    
+    // Writes out everything buffered and closes the current file. Returns
+    // false if any write failed.
+    bool close() {
+        if (!flusher.joinable()) return !failed;
+        {
+            unique_lock<mutex> guard(lock);
+            if (!filling.empty()) queue_flush(guard);
+            while (flush_pending) flush_done.wait(guard);
+            stopping = true;
+            flush_ready.notify_one();
+        }
+        flusher.join();
+        if (!finish_segment()) failed = true;
+        return !failed;
+    }
+    
+    long get_games() const { return games; }
+    long get_bytes() const { return bytes; }
+    const vector<string>& get_files() const { return finished; }
+};
+
+// ============= POSITION INDEX =============
+
+// Position index file, built from a game collection by --build-index:
+//   PositionIndexHeader
+//   PositionIndexEntry[positions]   sorted by Zobrist key
+//   MoveIndexEntry[moves]           each position's next moves, by move
+//   uint32_t[game_ids]              each position's games, ascending
+// Moves are packed as in Chess::move_log. Results count occurrences and
+// are from white's point of view.
+const char POSITION_INDEX_MAGIC[] = "CHPIDX01";
+
+struct PositionIndexHeader {
+    char magic[8];
+    uint32_t positions;
+    uint32_t moves;
+    uint32_t game_ids;
+    uint32_t max_plies;
+};
+
+struct PositionIndexEntry {
+    uint64_t key;
+    uint32_t white_wins;
+    uint32_t draws;
+    uint32_t black_wins;
+    uint32_t first_move;
+    uint32_t first_game;
+    uint16_t move_count;
+    uint16_t reserved;
+    
+    uint32_t games() const { return white_wins + draws + black_wins; }
+};
+
+struct MoveIndexEntry {
+    uint16_t move;
+    uint16_t reserved;
+    uint32_t white_wins;
+    uint32_t draws;
+    uint32_t black_wins;
+    
+    uint32_t games() const { return white_wins + draws + black_wins; }
+};
+
+// Positions need this many games before get_ai_move trusts their moves
+const uint32_t POSITION_INDEX_MIN_GAMES = 4;
+
+// One position reached in one game, and the move played from it
+struct IndexOccurrence {
+    uint64_t key;
+    uint32_t game;
+    uint16_t move;
+    uint8_t result;
+    uint8_t reserved;
+};
+
+bool compare_occurrences(const IndexOccurrence& a, const IndexOccurrence& b) {
+    if (a.key != b.key) return a.key < b.key;
+    if (a.move != b.move) return a.move < b.move;
+    return a.game < b.game;
+}
+
+bool compare_index_key(const PositionIndexEntry& entry, uint64_t key) {
+    return entry.key < key;
+}
+
+// Memory-mapped, read-only view of a position index
+class PositionIndex {
+private:
+    MappedFile file;
+    PositionIndexHeader header;
+    const PositionIndexEntry* positions;
+    const MoveIndexEntry* moves;
+    const uint32_t* game_ids;
+
+public:
+    PositionIndex() : positions(NULL), moves(NULL), game_ids(NULL) {
+        memset(&header, 0, sizeof(header));
+    }
+    
+    bool open(const string& path) {
+        positions = NULL;
+        if (!file.open(path)) return false;
+        string_view data = file.view();
+        if (data.size() < sizeof(header)) return false;
+        memcpy(&header, data.data(), sizeof(header));
+        if (memcmp(header.magic, POSITION_INDEX_MAGIC, sizeof(header.magic)) != 0) return false;
+        
+        size_t expected = sizeof(header) + (size_t)header.positions * sizeof(PositionIndexEntry) + 
+                          (size_t)header.moves * sizeof(MoveIndexEntry) + 
+                          (size_t)header.game_ids * sizeof(uint32_t);
+        if (data.size() != expected) return false;
+        
+        const char* base = data.data() + sizeof(header);
+        positions = (const PositionIndexEntry*)base;
+        moves = (const MoveIndexEntry*)(base + header.positions * sizeof(PositionIndexEntry));
+        game_ids = (const uint32_t*)((const char*)moves + header.moves * sizeof(MoveIndexEntry));
+        return true;
+    }
+    
+    bool is_open() const { return positions != NULL; }
+    uint32_t size() const { return header.positions; }
+    uint32_t max_plies() const { return header.max_plies; }
+    
+    // Binary search by key; NULL if the position is not in the index
+    const PositionIndexEntry* find(uint64_t key) const {
+        if (!positions) return NULL;
+        const PositionIndexEntry* end = positions + header.positions;
+        const PositionIndexEntry* entry = lower_bound(positions, end, key, compare_index_key);
+        return (entry != end && entry->key == key) ? entry : NULL;
+    }
+    
+    const MoveIndexEntry* get_moves(const PositionIndexEntry& entry) const {
+        return moves + entry.first_move;
+    }
+    
+    const uint32_t* get_games(const PositionIndexEntry& entry, uint32_t& count) const {
+        uint32_t end = (&entry + 1 < positions + header.positions) ? (&entry + 1)->first_game 
+                                                                   : header.game_ids;
+        count = end - entry.first_game;
+        return game_ids + entry.first_game;
+    }
+    
+    // The best scoring next move, for the side to move, among those played
+    // in at least POSITION_INDEX_MIN_GAMES games
+    bool best_move(uint64_t key, bool white_to_move, uint16_t& move) const {
+        const PositionIndexEntry* entry = find(key);
+        if (!entry) return false;
+        
+        const MoveIndexEntry* candidates = get_moves(*entry);
+        double best_score = -1.0;
+        for (uint16_t i = 0; i < entry->move_count; i++) {
+            uint32_t games = candidates[i].games();
+            if (games < POSITION_INDEX_MIN_GAMES) continue;
+            uint32_t wins = white_to_move ? candidates[i].white_wins : candidates[i].black_wins;
+            double score = (wins + 0.5 * candidates[i].draws) / games;
+            if (score > best_score) {
+                best_score = score;
+                move = candidates[i].move;
+            }
+        }
+        return best_score >= 0.0;
+    }
+};
+
+PositionIndex POSITION_INDEX;
+
+// ============= POLYGLOT BOOK =============
+
+// Polyglot opening books (.bin): 16-byte big-endian entries sorted by
+// position key, each a key, a move, a weight and a learn value. Keys
+// XOR values from Polyglot's Random64 table: 768 piece-square keys (for
+// each of bp, wp, bn, wn, ... bk, wk, then a1..h8), 4 castling keys, 8 en
+// passant file keys and the white-to-move key.
+const int POLYGLOT_RANDOM_COUNT = 781;
+const int POLYGLOT_CASTLE_OFFSET = 768;
+const int POLYGLOT_EN_PASSANT_OFFSET = 772;
+const int POLYGLOT_TURN_OFFSET = 780;
+const uint64_t POLYGLOT_START_KEY = 0x463B96181691FC9CULL;
+const size_t POLYGLOT_ENTRY_SIZE = 16;
+
+constexpr uint64_t POLYGLOT_RANDOM64[POLYGLOT_RANDOM_COUNT] = {
+    0x9D39247E33776D41ULL, 0x2AF7398005AAA5C7ULL, 0x44DB015024623547ULL, 0x9C15F73E62A76AE2ULL,
+    0x75834465489C0C89ULL, 0x3290AC3A203001BFULL, 0x0FBBAD1F61042279ULL, 0xE83A908FF2FB60CAULL,
+    0x0D7E765D58755C10ULL, 0x1A083822CEAFE02DULL, 0x9605D5F0E25EC3B0ULL, 0xD021FF5CD13A2ED5ULL,
+    0x40BDF15D4A672E32ULL, 0x011355146FD56395ULL, 0x5DB4832046F3D9E5ULL, 0x239F8B2D7FF719CCULL,
+    0x05D1A1AE85B49AA1ULL, 0x679F848F6E8FC971ULL, 0x7449BBFF801FED0BULL, 0x7D11CDB1C3B7ADF0ULL,
+    0x82C7709E781EB7CCULL, 0xF3218F1C9510786CULL, 0x331478F3AF51BBE6ULL, 0x4BB38DE5E7219443ULL,
+    0xAA649C6EBCFD50FCULL, 0x8DBD98A352AFD40BULL, 0x87D2074B81D79217ULL, 0x19F3C751D3E92AE1ULL,
+    0xB4AB30F062B19ABFULL, 0x7B0500AC42047AC4ULL, 0xC9452CA81A09D85DULL, 0x24AA6C514DA27500ULL,
+    0x4C9F34427501B447ULL, 0x14A68FD73C910841ULL, 0xA71B9B83461CBD93ULL, 0x03488B95B0F1850FULL,
+    0x637B2B34FF93C040ULL, 0x09D1BC9A3DD90A94ULL, 0x3575668334A1DD3BULL, 0x735E2B97A4C45A23ULL,
+    0x18727070F1BD400BULL, 0x1FCBACD259BF02E7ULL, 0xD310A7C2CE9B6555ULL, 0xBF983FE0FE5D8244ULL,
+    0x9F74D14F7454A824ULL, 0x51EBDC4AB9BA3035ULL, 0x5C82C505DB9AB0FAULL, 0xFCF7FE8A3430B241ULL,
+    0x3253A729B9BA3DDEULL, 0x8C74C368081B3075ULL, 0xB9BC6C87167C33E7ULL, 0x7EF48F2B83024E20ULL,
+    0x11D505D4C351BD7FULL, 0x6568FCA92C76A243ULL, 0x4DE0B0F40F32A7B8ULL, 0x96D693460CC37E5DULL,
+    0x42E240CB63689F2FULL, 0x6D2BDCDAE2919661ULL, 0x42880B0236E4D951ULL, 0x5F0F4A5898171BB6ULL,
+    0x39F890F579F92F88ULL, 0x93C5B5F47356388BULL, 0x63DC359D8D231B78ULL, 0xEC16CA8AEA98AD76ULL,
+    0x5355F900C2A82DC7ULL, 0x07FB9F855A997142ULL, 0x5093417AA8A7ED5EULL, 0x7BCBC38DA25A7F3CULL,
+    0x19FC8A768CF4B6D4ULL, 0x637A7780DECFC0D9ULL, 0x8249A47AEE0E41F7ULL, 0x79AD695501E7D1E8ULL,
+    0x14ACBAF4777D5776ULL, 0xF145B6BECCDEA195ULL, 0xDABF2AC8201752FCULL, 0x24C3C94DF9C8D3F6ULL,
+    0xBB6E2924F03912EAULL, 0x0CE26C0B95C980D9ULL, 0xA49CD132BFBF7CC4ULL, 0xE99D662AF4243939ULL,
+    0x27E6AD7891165C3FULL, 0x8535F040B9744FF1ULL, 0x54B3F4FA5F40D873ULL, 0x72B12C32127FED2BULL,
+    0xEE954D3C7B411F47ULL, 0x9A85AC909A24EAA1ULL, 0x70AC4CD9F04F21F5ULL, 0xF9B89D3E99A075C2ULL,
+    0x87B3E2B2B5C907B1ULL, 0xA366E5B8C54F48B8ULL, 0xAE4A9346CC3F7CF2ULL, 0x1920C04D47267BBDULL,
+    0x87BF02C6B49E2AE9ULL, 0x092237AC237F3859ULL, 0xFF07F64EF8ED14D0ULL, 0x8DE8DCA9F03CC54EULL,
+    0x9C1633264DB49C89ULL, 0xB3F22C3D0B0B38EDULL, 0x390E5FB44D01144BULL, 0x5BFEA5B4712768E9ULL,
+    0x1E1032911FA78984ULL, 0x9A74ACB964E78CB3ULL, 0x4F80F7A035DAFB04ULL, 0x6304D09A0B3738C4ULL,
+    0x2171E64683023A08ULL, 0x5B9B63EB9CEFF80CULL, 0x506AACF489889342ULL, 0x1881AFC9A3A701D6ULL,
+    0x6503080440750644ULL, 0xDFD395339CDBF4A7ULL, 0xEF927DBCF00C20F2ULL, 0x7B32F7D1E03680ECULL,
+    0xB9FD7620E7316243ULL, 0x05A7E8A57DB91B77ULL, 0xB5889C6E15630A75ULL, 0x4A750A09CE9573F7ULL,
+    0xCF464CEC899A2F8AULL, 0xF538639CE705B824ULL, 0x3C79A0FF5580EF7FULL, 0xEDE6C87F8477609DULL,
+    0x799E81F05BC93F31ULL, 0x86536B8CF3428A8CULL, 0x97D7374C60087B73ULL, 0xA246637CFF328532ULL,
+    0x043FCAE60CC0EBA0ULL, 0x920E449535DD359EULL, 0x70EB093B15B290CCULL, 0x73A1921916591CBDULL,
+    0x56436C9FE1A1AA8DULL, 0xEFAC4B70633B8F81ULL, 0xBB215798D45DF7AFULL, 0x45F20042F24F1768ULL,
+    0x930F80F4E8EB7462ULL, 0xFF6712FFCFD75EA1ULL, 0xAE623FD67468AA70ULL, 0xDD2C5BC84BC8D8FCULL,
+    0x7EED120D54CF2DD9ULL, 0x22FE545401165F1CULL, 0xC91800E98FB99929ULL, 0x808BD68E6AC10365ULL,
+    0xDEC468145B7605F6ULL, 0x1BEDE3A3AEF53302ULL, 0x43539603D6C55602ULL, 0xAA969B5C691CCB7AULL,
+    0xA87832D392EFEE56ULL, 0x65942C7B3C7E11AEULL, 0xDED2D633CAD004F6ULL, 0x21F08570F420E565ULL,
+    0xB415938D7DA94E3CULL, 0x91B859E59ECB6350ULL, 0x10CFF333E0ED804AULL, 0x28AED140BE0BB7DDULL,
+    0xC5CC1D89724FA456ULL, 0x5648F680F11A2741ULL, 0x2D255069F0B7DAB3ULL, 0x9BC5A38EF729ABD4ULL,
+    0xEF2F054308F6A2BCULL, 0xAF2042F5CC5C2858ULL, 0x480412BAB7F5BE2AULL, 0xAEF3AF4A563DFE43ULL,
+    0x19AFE59AE451497FULL, 0x52593803DFF1E840ULL, 0xF4F076E65F2CE6F0ULL, 0x11379625747D5AF3ULL,
+    0xBCE5D2248682C115ULL, 0x9DA4243DE836994FULL, 0x066F70B33FE09017ULL, 0x4DC4DE189B671A1CULL,
+    0x51039AB7712457C3ULL, 0xC07A3F80C31FB4B4ULL, 0xB46EE9C5E64A6E7CULL, 0xB3819A42ABE61C87ULL,
+    0x21A007933A522A20ULL, 0x2DF16F761598AA4FULL, 0x763C4A1371B368FDULL, 0xF793C46702E086A0ULL,
+    0xD7288E012AEB8D31ULL, 0xDE336A2A4BC1C44BULL, 0x0BF692B38D079F23ULL, 0x2C604A7A177326B3ULL,
+    0x4850E73E03EB6064ULL, 0xCFC447F1E53C8E1BULL, 0xB05CA3F564268D99ULL, 0x9AE182C8BC9474E8ULL,
+    0xA4FC4BD4FC5558CAULL, 0xE755178D58FC4E76ULL, 0x69B97DB1A4C03DFEULL, 0xF9B5B7C4ACC67C96ULL,
+    0xFC6A82D64B8655FBULL, 0x9C684CB6C4D24417ULL, 0x8EC97D2917456ED0ULL, 0x6703DF9D2924E97EULL,
+    0xC547F57E42A7444EULL, 0x78E37644E7CAD29EULL, 0xFE9A44E9362F05FAULL, 0x08BD35CC38336615ULL,
+    0x9315E5EB3A129ACEULL, 0x94061B871E04DF75ULL, 0xDF1D9F9D784BA010ULL, 0x3BBA57B68871B59DULL,
+    0xD2B7ADEEDED1F73FULL, 0xF7A255D83BC373F8ULL, 0xD7F4F2448C0CEB81ULL, 0xD95BE88CD210FFA7ULL,
+    0x336F52F8FF4728E7ULL, 0xA74049DAC312AC71ULL, 0xA2F61BB6E437FDB5ULL, 0x4F2A5CB07F6A35B3ULL,
+    0x87D380BDA5BF7859ULL, 0x16B9F7E06C453A21ULL, 0x7BA2484C8A0FD54EULL, 0xF3A678CAD9A2E38CULL,
+    0x39B0BF7DDE437BA2ULL, 0xFCAF55C1BF8A4424ULL, 0x18FCF680573FA594ULL, 0x4C0563B89F495AC3ULL,
+    0x40E087931A00930DULL, 0x8CFFA9412EB642C1ULL, 0x68CA39053261169FULL, 0x7A1EE967D27579E2ULL,
+    0x9D1D60E5076F5B6FULL, 0x3810E399B6F65BA2ULL, 0x32095B6D4AB5F9B1ULL, 0x35CAB62109DD038AULL,
+    0xA90B24499FCFAFB1ULL, 0x77A225A07CC2C6BDULL, 0x513E5E634C70E331ULL, 0x4361C0CA3F692F12ULL,
+    0xD941ACA44B20A45BULL, 0x528F7C8602C5807BULL, 0x52AB92BEB9613989ULL, 0x9D1DFA2EFC557F73ULL,
+    0x722FF175F572C348ULL, 0x1D1260A51107FE97ULL, 0x7A249A57EC0C9BA2ULL, 0x04208FE9E8F7F2D6ULL,
+    0x5A110C6058B920A0ULL, 0x0CD9A497658A5698ULL, 0x56FD23C8F9715A4CULL, 0x284C847B9D887AAEULL,
+    0x04FEABFBBDB619CBULL, 0x742E1E651C60BA83ULL, 0x9A9632E65904AD3CULL, 0x881B82A13B51B9E2ULL,
+    0x506E6744CD974924ULL, 0xB0183DB56FFC6A79ULL, 0x0ED9B915C66ED37EULL, 0x5E11E86D5873D484ULL,
+    0xF678647E3519AC6EULL, 0x1B85D488D0F20CC5ULL, 0xDAB9FE6525D89021ULL, 0x0D151D86ADB73615ULL,
+    0xA865A54EDCC0F019ULL, 0x93C42566AEF98FFBULL, 0x99E7AFEABE000731ULL, 0x48CBFF086DDF285AULL,
+    0x7F9B6AF1EBF78BAFULL, 0x58627E1A149BBA21ULL, 0x2CD16E2ABD791E33ULL, 0xD363EFF5F0977996ULL,
+    0x0CE2A38C344A6EEDULL, 0x1A804AADB9CFA741ULL, 0x907F30421D78C5DEULL, 0x501F65EDB3034D07ULL,
+    0x37624AE5A48FA6E9ULL, 0x957BAF61700CFF4EULL, 0x3A6C27934E31188AULL, 0xD49503536ABCA345ULL,
+    0x088E049589C432E0ULL, 0xF943AEE7FEBF21B8ULL, 0x6C3B8E3E336139D3ULL, 0x364F6FFA464EE52EULL,
+    0xD60F6DCEDC314222ULL, 0x56963B0DCA418FC0ULL, 0x16F50EDF91E513AFULL, 0xEF1955914B609F93ULL,
+    0x565601C0364E3228ULL, 0xECB53939887E8175ULL, 0xBAC7A9A18531294BULL, 0xB344C470397BBA52ULL,
+    0x65D34954DAF3CEBDULL, 0xB4B81B3FA97511E2ULL, 0xB422061193D6F6A7ULL, 0x071582401C38434DULL,
+    0x7A13F18BBEDC4FF5ULL, 0xBC4097B116C524D2ULL, 0x59B97885E2F2EA28ULL, 0x99170A5DC3115544ULL,
+    0x6F423357E7C6A9F9ULL, 0x325928EE6E6F8794ULL, 0xD0E4366228B03343ULL, 0x565C31F7DE89EA27ULL,
+    0x30F5611484119414ULL, 0xD873DB391292ED4FULL, 0x7BD94E1D8E17DEBCULL, 0xC7D9F16864A76E94ULL,
+    0x947AE053EE56E63CULL, 0xC8C93882F9475F5FULL, 0x3A9BF55BA91F81CAULL, 0xD9A11FBB3D9808E4ULL,
+    0x0FD22063EDC29FCAULL, 0xB3F256D8ACA0B0B9ULL, 0xB03031A8B4516E84ULL, 0x35DD37D5871448AFULL,
+    0xE9F6082B05542E4EULL, 0xEBFAFA33D7254B59ULL, 0x9255ABB50D532280ULL, 0xB9AB4CE57F2D34F3ULL,
+    0x693501D628297551ULL, 0xC62C58F97DD949BFULL, 0xCD454F8F19C5126AULL, 0xBBE83F4ECC2BDECBULL,
+    0xDC842B7E2819E230ULL, 0xBA89142E007503B8ULL, 0xA3BC941D0A5061CBULL, 0xE9F6760E32CD8021ULL,
+    0x09C7E552BC76492FULL, 0x852F54934DA55CC9ULL, 0x8107FCCF064FCF56ULL, 0x098954D51FFF6580ULL,
+    0x23B70EDB1955C4BFULL, 0xC330DE426430F69DULL, 0x4715ED43E8A45C0AULL, 0xA8D7E4DAB780A08DULL,
+    0x0572B974F03CE0BBULL, 0xB57D2E985E1419C7ULL, 0xE8D9ECBE2CF3D73FULL, 0x2FE4B17170E59750ULL,
+    0x11317BA87905E790ULL, 0x7FBF21EC8A1F45ECULL, 0x1725CABFCB045B00ULL, 0x964E915CD5E2B207ULL,
+    0x3E2B8BCBF016D66DULL, 0xBE7444E39328A0ACULL, 0xF85B2B4FBCDE44B7ULL, 0x49353FEA39BA63B1ULL,
+    0x1DD01AAFCD53486AULL, 0x1FCA8A92FD719F85ULL, 0xFC7C95D827357AFAULL, 0x18A6A990C8B35EBDULL,
+    0xCCCB7005C6B9C28DULL, 0x3BDBB92C43B17F26ULL, 0xAA70B5B4F89695A2ULL, 0xE94C39A54A98307FULL,
+    0xB7A0B174CFF6F36EULL, 0xD4DBA84729AF48ADULL, 0x2E18BC1AD9704A68ULL, 0x2DE0966DAF2F8B1CULL,
+    0xB9C11D5B1E43A07EULL, 0x64972D68DEE33360ULL, 0x94628D38D0C20584ULL, 0xDBC0D2B6AB90A559ULL,
+    0xD2733C4335C6A72FULL, 0x7E75D99D94A70F4DULL, 0x6CED1983376FA72BULL, 0x97FCAACBF030BC24ULL,
+    0x7B77497B32503B12ULL, 0x8547EDDFB81CCB94ULL, 0x79999CDFF70902CBULL, 0xCFFE1939438E9B24ULL,
+    0x829626E3892D95D7ULL, 0x92FAE24291F2B3F1ULL, 0x63E22C147B9C3403ULL, 0xC678B6D860284A1CULL,
+    0x5873888850659AE7ULL, 0x0981DCD296A8736DULL, 0x9F65789A6509A440ULL, 0x9FF38FED72E9052FULL,
+    0xE479EE5B9930578CULL, 0xE7F28ECD2D49EECDULL, 0x56C074A581EA17FEULL, 0x5544F7D774B14AEFULL,
+    0x7B3F0195FC6F290FULL, 0x12153635B2C0CF57ULL, 0x7F5126DBBA5E0CA7ULL, 0x7A76956C3EAFB413ULL,
+    0x3D5774A11D31AB39ULL, 0x8A1B083821F40CB4ULL, 0x7B4A38E32537DF62ULL, 0x950113646D1D6E03ULL,
+    0x4DA8979A0041E8A9ULL, 0x3BC36E078F7515D7ULL, 0x5D0A12F27AD310D1ULL, 0x7F9D1A2E1EBE1327ULL,
+    0xDA3A361B1C5157B1ULL, 0xDCDD7D20903D0C25ULL, 0x36833336D068F707ULL, 0xCE68341F79893389ULL,
+    0xAB9090168DD05F34ULL, 0x43954B3252DC25E5ULL, 0xB438C2B67F98E5E9ULL, 0x10DCD78E3851A492ULL,
+    0xDBC27AB5447822BFULL, 0x9B3CDB65F82CA382ULL, 0xB67B7896167B4C84ULL, 0xBFCED1B0048EAC50ULL,
+    0xA9119B60369FFEBDULL, 0x1FFF7AC80904BF45ULL, 0xAC12FB171817EEE7ULL, 0xAF08DA9177DDA93DULL,
+    0x1B0CAB936E65C744ULL, 0xB559EB1D04E5E932ULL, 0xC37B45B3F8D6F2BAULL, 0xC3A9DC228CAAC9E9ULL,
+    0xF3B8B6675A6507FFULL, 0x9FC477DE4ED681DAULL, 0x67378D8ECCEF96CBULL, 0x6DD856D94D259236ULL,
+    0xA319CE15B0B4DB31ULL, 0x073973751F12DD5EULL, 0x8A8E849EB32781A5ULL, 0xE1925C71285279F5ULL,
+    0x74C04BF1790C0EFEULL, 0x4DDA48153C94938AULL, 0x9D266D6A1CC0542CULL, 0x7440FB816508C4FEULL,
+    0x13328503DF48229FULL, 0xD6BF7BAEE43CAC40ULL, 0x4838D65F6EF6748FULL, 0x1E152328F3318DEAULL,
+    0x8F8419A348F296BFULL, 0x72C8834A5957B511ULL, 0xD7A023A73260B45CULL, 0x94EBC8ABCFB56DAEULL,
+    0x9FC10D0F989993E0ULL, 0xDE68A2355B93CAE6ULL, 0xA44CFE79AE538BBEULL, 0x9D1D84FCCE371425ULL,
+    0x51D2B1AB2DDFB636ULL, 0x2FD7E4B9E72CD38CULL, 0x65CA5B96B7552210ULL, 0xDD69A0D8AB3B546DULL,
+    0x604D51B25FBF70E2ULL, 0x73AA8A564FB7AC9EULL, 0x1A8C1E992B941148ULL, 0xAAC40A2703D9BEA0ULL,
+    0x764DBEAE7FA4F3A6ULL, 0x1E99B96E70A9BE8BULL, 0x2C5E9DEB57EF4743ULL, 0x3A938FEE32D29981ULL,
+    0x26E6DB8FFDF5ADFEULL, 0x469356C504EC9F9DULL, 0xC8763C5B08D1908CULL, 0x3F6C6AF859D80055ULL,
+    0x7F7CC39420A3A545ULL, 0x9BFB227EBDF4C5CEULL, 0x89039D79D6FC5C5CULL, 0x8FE88B57305E2AB6ULL,
+    0xA09E8C8C35AB96DEULL, 0xFA7E393983325753ULL, 0xD6B6D0ECC617C699ULL, 0xDFEA21EA9E7557E3ULL,
+    0xB67C1FA481680AF8ULL, 0xCA1E3785A9E724E5ULL, 0x1CFC8BED0D681639ULL, 0xD18D8549D140CAEAULL,
+    0x4ED0FE7E9DC91335ULL, 0xE4DBF0634473F5D2ULL, 0x1761F93A44D5AEFEULL, 0x53898E4C3910DA55ULL,
+    0x734DE8181F6EC39AULL, 0x2680B122BAA28D97ULL, 0x298AF231C85BAFABULL, 0x7983EED3740847D5ULL,
+    0x66C1A2A1A60CD889ULL, 0x9E17E49642A3E4C1ULL, 0xEDB454E7BADC0805ULL, 0x50B704CAB602C329ULL,
+    0x4CC317FB9CDDD023ULL, 0x66B4835D9EAFEA22ULL, 0x219B97E26FFC81BDULL, 0x261E4E4C0A333A9DULL,
+    0x1FE2CCA76517DB90ULL, 0xD7504DFA8816EDBBULL, 0xB9571FA04DC089C8ULL, 0x1DDC0325259B27DEULL,
+    0xCF3F4688801EB9AAULL, 0xF4F5D05C10CAB243ULL, 0x38B6525C21A42B0EULL, 0x36F60E2BA4FA6800ULL,
+    0xEB3593803173E0CEULL, 0x9C4CD6257C5A3603ULL, 0xAF0C317D32ADAA8AULL, 0x258E5A80C7204C4BULL,
+    0x8B889D624D44885DULL, 0xF4D14597E660F855ULL, 0xD4347F66EC8941C3ULL, 0xE699ED85B0DFB40DULL,
+    0x2472F6207C2D0484ULL, 0xC2A1E7B5B459AEB5ULL, 0xAB4F6451CC1D45ECULL, 0x63767572AE3D6174ULL,
+    0xA59E0BD101731A28ULL, 0x116D0016CB948F09ULL, 0x2CF9C8CA052F6E9FULL, 0x0B090A7560A968E3ULL,
+    0xABEEDDB2DDE06FF1ULL, 0x58EFC10B06A2068DULL, 0xC6E57A78FBD986E0ULL, 0x2EAB8CA63CE802D7ULL,
+    0x14A195640116F336ULL, 0x7C0828DD624EC390ULL, 0xD74BBE77E6116AC7ULL, 0x804456AF10F5FB53ULL,
+    0xEBE9EA2ADF4321C7ULL, 0x03219A39EE587A30ULL, 0x49787FEF17AF9924ULL, 0xA1E9300CD8520548ULL,
+    0x5B45E522E4B1B4EFULL, 0xB49C3B3995091A36ULL, 0xD4490AD526F14431ULL, 0x12A8F216AF9418C2ULL,
+    0x001F837CC7350524ULL, 0x1877B51E57A764D5ULL, 0xA2853B80F17F58EEULL, 0x993E1DE72D36D310ULL,
+    0xB3598080CE64A656ULL, 0x252F59CF0D9F04BBULL, 0xD23C8E176D113600ULL, 0x1BDA0492E7E4586EULL,
+    0x21E0BD5026C619BFULL, 0x3B097ADAF088F94EULL, 0x8D14DEDB30BE846EULL, 0xF95CFFA23AF5F6F4ULL,
+    0x3871700761B3F743ULL, 0xCA672B91E9E4FA16ULL, 0x64C8E531BFF53B55ULL, 0x241260ED4AD1E87DULL,
+    0x106C09B972D2E822ULL, 0x7FBA195410E5CA30ULL, 0x7884D9BC6CB569D8ULL, 0x0647DFEDCD894A29ULL,
+    0x63573FF03E224774ULL, 0x4FC8E9560F91B123ULL, 0x1DB956E450275779ULL, 0xB8D91274B9E9D4FBULL,
+    0xA2EBEE47E2FBFCE1ULL, 0xD9F1F30CCD97FB09ULL, 0xEFED53D75FD64E6BULL, 0x2E6D02C36017F67FULL,
+    0xA9AA4D20DB084E9BULL, 0xB64BE8D8B25396C1ULL, 0x70CB6AF7C2D5BCF0ULL, 0x98F076A4F7A2322EULL,
+    0xBF84470805E69B5FULL, 0x94C3251F06F90CF3ULL, 0x3E003E616A6591E9ULL, 0xB925A6CD0421AFF3ULL,
+    0x61BDD1307C66E300ULL, 0xBF8D5108E27E0D48ULL, 0x240AB57A8B888B20ULL, 0xFC87614BAF287E07ULL,
+    0xEF02CDD06FFDB432ULL, 0xA1082C0466DF6C0AULL, 0x8215E577001332C8ULL, 0xD39BB9C3A48DB6CFULL,
+    0x2738259634305C14ULL, 0x61CF4F94C97DF93DULL, 0x1B6BACA2AE4E125BULL, 0x758F450C88572E0BULL,
+    0x959F587D507A8359ULL, 0xB063E962E045F54DULL, 0x60E8ED72C0DFF5D1ULL, 0x7B64978555326F9FULL,
+    0xFD080D236DA814BAULL, 0x8C90FD9B083F4558ULL, 0x106F72FE81E2C590ULL, 0x7976033A39F7D952ULL,
+    0xA4EC0132764CA04BULL, 0x733EA705FAE4FA77ULL, 0xB4D8F77BC3E56167ULL, 0x9E21F4F903B33FD9ULL,
+    0x9D765E419FB69F6DULL, 0xD30C088BA61EA5EFULL, 0x5D94337FBFAF7F5BULL, 0x1A4E4822EB4D7A59ULL,
+    0x6FFE73E81B637FB3ULL, 0xDDF957BC36D8B9CAULL, 0x64D0E29EEA8838B3ULL, 0x08DD9BDFD96B9F63ULL,
+    0x087E79E5A57D1D13ULL, 0xE328E230E3E2B3FBULL, 0x1C2559E30F0946BEULL, 0x720BF5F26F4D2EAAULL,
+    0xB0774D261CC609DBULL, 0x443F64EC5A371195ULL, 0x4112CF68649A260EULL, 0xD813F2FAB7F5C5CAULL,
+    0x660D3257380841EEULL, 0x59AC2C7873F910A3ULL, 0xE846963877671A17ULL, 0x93B633ABFA3469F8ULL,
+    0xC0C0F5A60EF4CDCFULL, 0xCAF21ECD4377B28CULL, 0x57277707199B8175ULL, 0x506C11B9D90E8B1DULL,
+    0xD83CC2687A19255FULL, 0x4A29C6465A314CD1ULL, 0xED2DF21216235097ULL, 0xB5635C95FF7296E2ULL,
+    0x22AF003AB672E811ULL, 0x52E762596BF68235ULL, 0x9AEBA33AC6ECC6B0ULL, 0x944F6DE09134DFB6ULL,
+    0x6C47BEC883A7DE39ULL, 0x6AD047C430A12104ULL, 0xA5B1CFDBA0AB4067ULL, 0x7C45D833AFF07862ULL,
+    0x5092EF950A16DA0BULL, 0x9338E69C052B8E7BULL, 0x455A4B4CFE30E3F5ULL, 0x6B02E63195AD0CF8ULL,
+    0x6B17B224BAD6BF27ULL, 0xD1E0CCD25BB9C169ULL, 0xDE0C89A556B9AE70ULL, 0x50065E535A213CF6ULL,
+    0x9C1169FA2777B874ULL, 0x78EDEFD694AF1EEDULL, 0x6DC93D9526A50E68ULL, 0xEE97F453F06791EDULL,
+    0x32AB0EDB696703D3ULL, 0x3A6853C7E70757A7ULL, 0x31865CED6120F37DULL, 0x67FEF95D92607890ULL,
+    0x1F2B1D1F15F6DC9CULL, 0xB69E38A8965C6B65ULL, 0xAA9119FF184CCCF4ULL, 0xF43C732873F24C13ULL,
+    0xFB4A3D794A9A80D2ULL, 0x3550C2321FD6109CULL, 0x371F77E76BB8417EULL, 0x6BFA9AAE5EC05779ULL,
+    0xCD04F3FF001A4778ULL, 0xE3273522064480CAULL, 0x9F91508BFFCFC14AULL, 0x049A7F41061A9E60ULL,
+    0xFCB6BE43A9F2FE9BULL, 0x08DE8A1C7797DA9BULL, 0x8F9887E6078735A1ULL, 0xB5B4071DBFC73A66ULL,
+    0x230E343DFBA08D33ULL, 0x43ED7F5A0FAE657DULL, 0x3A88A0FBBCB05C63ULL, 0x21874B8B4D2DBC4FULL,
+    0x1BDEA12E35F6A8C9ULL, 0x53C065C6C8E63528ULL, 0xE34A1D250E7A8D6BULL, 0xD6B04D3B7651DD7EULL,
+    0x5E90277E7CB39E2DULL, 0x2C046F22062DC67DULL, 0xB10BB459132D0A26ULL, 0x3FA9DDFB67E2F199ULL,
+    0x0E09B88E1914F7AFULL, 0x10E8B35AF3EEAB37ULL, 0x9EEDECA8E272B933ULL, 0xD4C718BC4AE8AE5FULL,
+    0x81536D601170FC20ULL, 0x91B534F885818A06ULL, 0xEC8177F83F900978ULL, 0x190E714FADA5156EULL,
+    0xB592BF39B0364963ULL, 0x89C350C893AE7DC1ULL, 0xAC042E70F8B383F2ULL, 0xB49B52E587A1EE60ULL,
+    0xFB152FE3FF26DA89ULL, 0x3E666E6F69AE2C15ULL, 0x3B544EBE544C19F9ULL, 0xE805A1E290CF2456ULL,
+    0x24B33C9D7ED25117ULL, 0xE74733427B72F0C1ULL, 0x0A804D18B7097475ULL, 0x57E3306D881EDB4FULL,
+    0x4AE7D6A36EB5DBCBULL, 0x2D8D5432157064C8ULL, 0xD1E649DE1E7F268BULL, 0x8A328A1CEDFE552CULL,
+    0x07A3AEC79624C7DAULL, 0x84547DDC3E203C94ULL, 0x990A98FD5071D263ULL, 0x1A4FF12616EEFC89ULL,
+    0xF6F7FD1431714200ULL, 0x30C05B1BA332F41CULL, 0x8D2636B81555A786ULL, 0x46C9FEB55D120902ULL,
+    0xCCEC0A73B49C9921ULL, 0x4E9D2827355FC492ULL, 0x19EBB029435DCB0FULL, 0x4659D2B743848A2CULL,
+    0x963EF2C96B33BE31ULL, 0x74F85198B05A2E7DULL, 0x5A0F544DD2B1FB18ULL, 0x03727073C2E134B1ULL,
+    0xC7F6AA2DE59AEA61ULL, 0x352787BAA0D7C22FULL, 0x9853EAB63B5E0B35ULL, 0xABBDCDD7ED5C0860ULL,
+    0xCF05DAF5AC8D77B0ULL, 0x49CAD48CEBF4A71EULL, 0x7A4C10EC2158C4A6ULL, 0xD9E92AA246BF719EULL,
+    0x13AE978D09FE5557ULL, 0x730499AF921549FFULL, 0x4E4B705B92903BA4ULL, 0xFF577222C14F0A3AULL,
+    0x55B6344CF97AAFAEULL, 0xB862225B055B6960ULL, 0xCAC09AFBDDD2CDB4ULL, 0xDAF8E9829FE96B5FULL,
+    0xB5FDFC5D3132C498ULL, 0x310CB380DB6F7503ULL, 0xE87FBB46217A360EULL, 0x2102AE466EBB1148ULL,
+    0xF8549E1A3AA5E00DULL, 0x07A69AFDCC42261AULL, 0xC4C118BFE78FEAAEULL, 0xF9F4892ED96BD438ULL,
+    0x1AF3DBE25D8F45DAULL, 0xF5B4B0B0D2DEEEB4ULL, 0x962ACEEFA82E1C84ULL, 0x046E3ECAAF453CE9ULL,
+    0xF05D129681949A4CULL, 0x964781CE734B3C84ULL, 0x9C2ED44081CE5FBDULL, 0x522E23F3925E319EULL,
+    0x177E00F9FC32F791ULL, 0x2BC60A63A6F3B3F2ULL, 0x222BBFAE61725606ULL, 0x486289DDCC3D6780ULL,
+    0x7DC7785B8EFDFC80ULL, 0x8AF38731C02BA980ULL, 0x1FAB64EA29A2DDF7ULL, 0xE4D9429322CD065AULL,
+    0x9DA058C67844F20CULL, 0x24C0E332B70019B0ULL, 0x233003B5A6CFE6ADULL, 0xD586BD01C5C217F6ULL,
+    0x5E5637885F29BC2BULL, 0x7EBA726D8C94094BULL, 0x0A56A5F0BFE39272ULL, 0xD79476A84EE20D06ULL,
+    0x9E4C1269BAA4BF37ULL, 0x17EFEE45B0DEE640ULL, 0x1D95B0A5FCF90BC6ULL, 0x93CBE0B699C2585DULL,
+    0x65FA4F227A2B6D79ULL, 0xD5F9E858292504D5ULL, 0xC2B5A03F71471A6FULL, 0x59300222B4561E00ULL,
+    0xCE2F8642CA0712DCULL, 0x7CA9723FBB2E8988ULL, 0x2785338347F2BA08ULL, 0xC61BB3A141E50E8CULL,
+    0x150F361DAB9DEC26ULL, 0x9F6A419D382595F4ULL, 0x64A53DC924FE7AC9ULL, 0x142DE49FFF7A7C3DULL,
+    0x0C335248857FA9E7ULL, 0x0A9C32D5EAE45305ULL, 0xE6C42178C4BBB92EULL, 0x71F1CE2490D20B07ULL,
+    0xF1BCC3D275AFE51AULL, 0xE728E8C83C334074ULL, 0x96FBF83A12884624ULL, 0x81A1549FD6573DA5ULL,
+    0x5FA7867CAF35E149ULL, 0x56986E2EF3ED091BULL, 0x917F1DD5F8886C61ULL, 0xD20D8C88C8FFE65FULL,
+    0x31D71DCE64B2C310ULL, 0xF165B587DF898190ULL, 0xA57E6339DD2CF3A0ULL, 0x1EF6E6DBB1961EC9ULL,
+    0x70CC73D90BC26E24ULL, 0xE21A6B35DF0C3AD7ULL, 0x003A93D8B2806962ULL, 0x1C99DED33CB890A1ULL,
+    0xCF3145DE0ADD4289ULL, 0xD0E4427A5514FB72ULL, 0x77C621CC9FB3A483ULL, 0x67A34DAC4356550BULL,
+    0xF8D626AAAF278509ULL
+};
+
+// Key of the start position computed from the table alone
+constexpr uint64_t polyglot_start_key() {
+    const char* placement = "rnbqkbnrpppppppp................................PPPPPPPPRNBQKBNR";
+    uint64_t key = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        for (int type = 0; type < 6; type++) {
+            int kind = -1;
+            if (placement[sq] == "pnbrqk"[type]) kind = 2 * type;
+            else if (placement[sq] == "PNBRQK"[type]) kind = 2 * type + 1;
+            if (kind >= 0) key ^= POLYGLOT_RANDOM64[64 * kind + 8 * (7 - sq / 8) + sq % 8];
+        }
+    }
+    for (int i = 0; i < 4; i++) key ^= POLYGLOT_RANDOM64[POLYGLOT_CASTLE_OFFSET + i];
+    return key ^ POLYGLOT_RANDOM64[POLYGLOT_TURN_OFFSET];
+}
+
+static_assert(polyglot_start_key() == POLYGLOT_START_KEY, 
+              "POLYGLOT_RANDOM64 does not give the standard start position key");
+
+inline uint64_t read_be64(const unsigned char* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) value = (value << 8) | p[i];
+    return value;
+}
+
+// Plies from the start of the game during which the Polyglot book is
+// consulted (--book-depth)
+int BOOK_DEPTH = 20;
+
+class PolyglotBook {
+private:
+    MappedFile file;
+    const unsigned char* entries;
+    size_t count;
+    
+    uint64_t entry_key(size_t i) const { return read_be64(entries + i * POLYGLOT_ENTRY_SIZE); }
+    uint16_t entry_move(size_t i) const {
+        const unsigned char* p = entries + i * POLYGLOT_ENTRY_SIZE + 8;
+        return (uint16_t)((p[0] << 8) | p[1]);
+    }
+    uint16_t entry_weight(size_t i) const {
+        const unsigned char* p = entries + i * POLYGLOT_ENTRY_SIZE + 10;
+        return (uint16_t)((p[0] << 8) | p[1]);
+    }
+
+public:
+    PolyglotBook() : entries(NULL), count(0) {}
+    
+    bool open(const string& path, string& error) {
+        entries = NULL;
+        count = 0;
+        if (!file.open(path)) {
+            error = "cannot read " + path;
+            return false;
+        }
+        string_view data = file.view();
+        if (data.empty() || data.size() % POLYGLOT_ENTRY_SIZE != 0) {
+            error = path + " is not a Polyglot book";
+            return false;
+        }
+        entries = (const unsigned char*)data.data();
+        count = data.size() / POLYGLOT_ENTRY_SIZE;
+        return true;
+    }
+    
+    bool is_open() const { return entries != NULL; }
+    size_t size() const { return count; }
+    
+    // Index of the first entry for key (binary search), count if none
+    size_t find(uint64_t key) const {
+        size_t low = 0, high = count;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (entry_key(mid) < key) low = mid + 1;
+            else high = mid;
+        }
+        return (low < count && entry_key(low) == key) ? low : count;
+    }
+    
+    // All moves and weights for key
+    void get_moves(uint64_t key, vector<pair<uint16_t, uint16_t> >& moves) const {
+        moves.clear();
+        for (size_t i = find(key); i < count && entry_key(i) == key; i++) {
+            moves.push_back(make_pair(entry_move(i), entry_weight(i)));
+        }
+    }
+    
+    // A book move for key, chosen with probability proportional to weight
+    bool pick(uint64_t key, mt19937& gen, uint16_t& move) const {
+        size_t first = find(key);
+        uint32_t total = 0;
+        size_t end = first;
+        for (; end < count && entry_key(end) == key; end++) total += entry_weight(end);
+        if (total == 0) return false;
+        
+        uniform_int_distribution<uint32_t> dis(0, total - 1);
+        uint32_t target = dis(gen);
+        for (size_t i = first; i < end; i++) {
+            uint32_t weight = entry_weight(i);
+            if (target < weight) {
+                move = entry_move(i);
+                return true;
+            }
+            target -= weight;
+        }
+        return false;
+    }
+};
+
+PolyglotBook POLYGLOT_BOOK;
+
+// ============= LEARNED BOOK =============
+
+// Opening book learned from our own games, built by --build-book and
+// updated by --learn-book:
+//   LearnedBookHeader
+//   LearnedBookEntry[entries]   sorted by Zobrist key, then move
+// Moves are packed as in Chess::move_log. Results count games and are from
+// white's point of view. Every move played within the first max_plies
+// plies is kept with its full counts, so later merges keep adding to them;
+// only those played in at least min_games games are ever picked.
+// CHBOOK01 books predate the playable count and are not read.
+const char LEARNED_BOOK_MAGIC[] = "CHBOOK02";
+
+struct LearnedBookHeader {
+    char magic[8];
+    uint32_t entries;
+    uint32_t playable;   // entries played in at least min_games games
+    uint32_t min_games;
+    uint32_t max_plies;
+    uint32_t games;      // games the book was learned from
+};
+
+struct LearnedBookEntry {
+    uint64_t key;
+    uint16_t move;
+    uint16_t reserved;
+    uint32_t white_wins;
+    uint32_t draws;
+    uint32_t black_wins;
+    
+    uint32_t games() const { return white_wins + draws + black_wins; }
+};
+
+// Games a move needs before it goes into a learned book
+int BOOK_MIN_GAMES = 3;
+
+// Plies of each game a new learned book learns from (--learn-book-depth);
+// an existing book keeps the depth it was built with
+int LEARNED_BOOK_DEPTH = 20;
+
+bool compare_book_key(const LearnedBookEntry& entry, uint64_t key) {
+    return entry.key < key;
+}
+
+// Memory-mapped, read-only view of a learned book
+class LearnedBook {
+private:
+    MappedFile file;
+    LearnedBookHeader header;
+    const LearnedBookEntry* entries;
+
+public:
+    LearnedBook() : entries(NULL) {
+        memset(&header, 0, sizeof(header));
+    }
+    
+    bool open(const string& path) {
+        entries = NULL;
+        if (!file.open(path)) return false;
+        string_view data = file.view();
+        if (data.size() < sizeof(header)) return false;
+        memcpy(&header, data.data(), sizeof(header));
+        if (memcmp(header.magic, LEARNED_BOOK_MAGIC, sizeof(header.magic)) != 0 || 
+            data.size() != sizeof(header) + (size_t)header.entries * sizeof(LearnedBookEntry)) {
+            return false;
+        }
+        entries = (const LearnedBookEntry*)(data.data() + sizeof(header));
+        return true;
+    }
+    
+    bool is_open() const { return entries != NULL; }
+    const LearnedBookHeader& get_header() const { return header; }
+    const LearnedBookEntry* begin() const { return entries; }
+    const LearnedBookEntry* end() const { return entries ? entries + header.entries : NULL; }
+    
+    // Entries for key as [first, last); empty if the position is not in
+    // the book
+    const LearnedBookEntry* find(uint64_t key, const LearnedBookEntry*& last) const {
+        const LearnedBookEntry* first = lower_bound(begin(), end(), key, compare_book_key);
+        last = first;
+        while (last != end() && last->key == key) last++;
+        return first;
+    }
+    
+    bool is_playable(const LearnedBookEntry& entry) const {
+        return entry.games() >= header.min_games;
+    }
+    
+    // Points a playable move scored for the side to move: two per win, one
+    // per draw
+    uint32_t weight(const LearnedBookEntry& entry, bool white_to_move) const {
+        if (!is_playable(entry)) return 0;
+        return 2 * (white_to_move ? entry.white_wins : entry.black_wins) + entry.draws;
+    }
+    
+    // A book move for the side to move, chosen with probability
+    // proportional to its weight()
+    bool pick(uint64_t key, bool white_to_move, mt19937& gen, uint16_t& move) const {
+        if (!entries) return false;
+        const LearnedBookEntry* last;
+        const LearnedBookEntry* first = find(key, last);
+        uint32_t total = 0;
+        for (const LearnedBookEntry* entry = first; entry != last; entry++) {
+            total += weight(*entry, white_to_move);
+        }
+        if (total == 0) return false;
+        
+        uniform_int_distribution<uint32_t> dis(0, total - 1);
+        uint32_t target = dis(gen);
+        for (const LearnedBookEntry* entry = first; entry != last; entry++) {
+            uint32_t weight = this->weight(*entry, white_to_move);
+            if (target < weight) {
+                move = entry->move;
+                return true;
+            }
+            target -= weight;
+        }
+        return false;
+    }
+};
+
+LearnedBook LEARNED_BOOK;
+
+// ============= SYZYGY TABLEBASES =============
+
+// Probing of Syzygy endgame tables (KQvK.rtbw, KQvK.rtbz, ...): a .rtbw
+// file holds the win/draw/loss of every position of its material, a .rtbz
+// file the distance in plies to the next capture or pawn move (DTZ) along
+// the best line. The decoder follows the reference probing code (Fathom,
+// Stockfish's tbprobe): a table is a set of index functions, one per side
+// to move and, with pawns, per file of the leading pawn, each mapping a
+// position to an offset into a Huffman-coded stream of values.
+//
+// Squares inside the tables are numbered a1 = 0 ... h8 = 63, the board's
+// own numbering flipped top to bottom (sq ^ 56); pieces are coded white
+// PNBRQK = 1-6 and black = 9-14.
+const int TB_MAX_PIECES = 7;
+const int TB_WIN = 20000;   // below search mates, above any evaluation
+const uint8_t SYZYGY_WDL_MAGIC[4] = { 0x71, 0xE8, 0x23, 0x5D };
+const uint8_t SYZYGY_DTZ_MAGIC[4] = { 0xD7, 0x66, 0x0C, 0xA5 };
+
+// Flags byte of a pair stream; the DTZ ones say how the stored values map
+// to plies
+enum SyzygyFlag {
+    SYZYGY_STM = 1, SYZYGY_MAPPED = 2, SYZYGY_WIN_PLIES = 4, SYZYGY_LOSS_PLIES = 8,
+    SYZYGY_WIDE = 16, SYZYGY_SINGLE_VALUE = 128
+};
+
+// Index tables of the position encoding
+struct SyzygyIndexTables {
+    int map_b1h1h7[64];            // squares below the a1-h8 diagonal, 0-27
+    int map_a1d1d4[64];            // the a1-d1-d4 triangle, diagonal last, 0-9
+    int map_kk[10][64];            // both kings, 0-461
+    int map_pawns[64];             // pawn squares, edge files and low ranks highest
+    uint64_t binomial[7][64];      // binomial[k][n]: ways to choose k of n
+    int lead_pawn_idx[6][64];
+    int lead_pawns_size[6][4];     // [leading pawns][file a-d]
+};
+
+constexpr int off_a1h8(int sq) {
+    return (sq >> 3) - (sq & 7);
+}
+
+constexpr bool kings_touch(int a, int b) {
+    return (a >> 3) - (b >> 3) <= 1 && (b >> 3) - (a >> 3) <= 1 &&
+           (a & 7) - (b & 7) <= 1 && (b & 7) - (a & 7) <= 1;
+}
+
+constexpr SyzygyIndexTables build_syzygy_index_tables() {
+    SyzygyIndexTables t = {};
+    int code = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (off_a1h8(sq) < 0) t.map_b1h1h7[sq] = code++;
+    }
+    
+    code = 0;
+    int diagonal[4] = {};
+    int diagonal_count = 0;
+    for (int sq = 0; sq <= 27; sq++) {
+        if ((sq & 7) > 3) continue;
+        if (off_a1h8(sq) < 0) t.map_a1d1d4[sq] = code++;
+        else if (off_a1h8(sq) == 0) diagonal[diagonal_count++] = sq;
+    }
+    for (int i = 0; i < diagonal_count; i++) t.map_a1d1d4[diagonal[i]] = code++;
+    
+    // The first king in the triangle, the second anywhere not touching it;
+    // with both on the diagonal the second is kept below or on it, and
+    // those pairs are coded last
+    int both_idx[64] = {}, both_sq[64] = {};
+    int both = 0;
+    code = 0;
+    for (int idx = 0; idx < 10; idx++) {
+        for (int s1 = 0; s1 <= 27; s1++) {
+            if (t.map_a1d1d4[s1] != idx || (idx == 0 && s1 != 1)) continue;
+            for (int s2 = 0; s2 < 64; s2++) {
+                if (kings_touch(s1, s2)) continue;
+                if (off_a1h8(s1) == 0 && off_a1h8(s2) > 0) continue;
+                if (off_a1h8(s1) == 0 && off_a1h8(s2) == 0) {
+                    both_idx[both] = idx;
+                    both_sq[both++] = s2;
+                } else {
+                    t.map_kk[idx][s2] = code++;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < both; i++) t.map_kk[both_idx[i]][both_sq[i]] = code++;
+    
+    for (int n = 0; n < 64; n++) {
+        for (int k = 0; k < 7; k++) {
+            if (k == 0) t.binomial[k][n] = 1;
+            else t.binomial[k][n] = n == 0 ? 0 : t.binomial[k - 1][n - 1] + t.binomial[k][n - 1];
+        }
+    }
+    
+    int available = 47;
+    for (int lead = 1; lead <= 5; lead++) {
+        for (int file = 0; file < 4; file++) {
+            int idx = 0;
+            for (int rank = 1; rank <= 6; rank++) {
+                int sq = rank * 8 + file;
+                if (lead == 1) {
+                    t.map_pawns[sq] = available--;
+                    t.map_pawns[sq ^ 7] = available--;
+                }
+                t.lead_pawn_idx[lead][sq] = idx;
+                idx += (int)t.binomial[lead - 1][t.map_pawns[sq]];
+            }
+            t.lead_pawns_size[lead][file] = idx;
+        }
+    }
+    return t;
+}
+
+constexpr SyzygyIndexTables SYZYGY = build_syzygy_index_tables();
+
+static_assert(SYZYGY.map_kk[9][63] == 461, "the king pairs must code to 0-461");
+
+inline bool syzygy_pawn_less(int a, int b) {
+    return SYZYGY.map_pawns[a] < SYZYGY.map_pawns[b];
+}
+
+inline uint16_t read_le16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t read_le32(const uint8_t* p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// One index function and its compressed value stream. Values are coded as
+// Huffman symbols, each standing for a run of values built by pairing
+// (btree), in blocks of block_size bytes; the sparse index points into the
+// blocks every span positions.
+struct SyzygyPairs {
+    uint8_t flags;
+    int min_sym_len;                   // or the value, for SINGLE_VALUE
+    size_t block_size;
+    size_t span;
+    uint32_t num_blocks;
+    const uint8_t* lowest_sym;         // uint16 per symbol length
+    const uint8_t* btree;              // 3 bytes per symbol: 12-bit left, right
+    const uint8_t* sparse_index;       // 6 bytes per entry: block, offset
+    size_t sparse_index_size;
+    const uint8_t* block_length;       // uint16 per block: values - 1
+    size_t block_length_size;
+    const uint8_t* data;
+    vector<uint64_t> base64;           // lowest code of each length, left-aligned
+    vector<uint8_t> symlen;            // values per symbol - 1
+    int pieces[TB_MAX_PIECES];
+    uint64_t group_idx[TB_MAX_PIECES + 1];
+    int group_len[TB_MAX_PIECES + 1];  // zero-terminated
+    uint16_t map_idx[4];               // DTZ value maps, by WDL
+    
+    int left(int sym) const {
+        return ((btree[3 * sym + 1] & 0xF) << 8) | btree[3 * sym];
+    }
+    
+    int right(int sym) const {
+        return (btree[3 * sym + 2] << 4) | (btree[3 * sym + 1] >> 4);
+    }
+    
+    void set_symlen(int sym, vector<bool>& visited) {
+        visited[sym] = true;
+        int r = right(sym);
+        if (r == 0xFFF) return;
+        int l = left(sym);
+        if (!visited[l]) set_symlen(l, visited);
+        if (!visited[r]) set_symlen(r, visited);
+        symlen[sym] = (uint8_t)(symlen[l] + symlen[r] + 1);
+    }
+    
+    // Reads the stream header at p; returns the byte after it
+    const uint8_t* set_sizes(const uint8_t* p, uint64_t table_size) {
+        flags = *p++;
+        if (flags & SYZYGY_SINGLE_VALUE) {
+            num_blocks = 0;
+            span = block_size = 0;
+            sparse_index_size = block_length_size = 0;
+            min_sym_len = *p++;
+            return p;
+        }
+        block_size = (size_t)1 << *p++;
+        span = (size_t)1 << *p++;
+        sparse_index_size = (size_t)((table_size + span - 1) / span);
+        int padding = *p++;
+        num_blocks = read_le32(p);
+        p += 4;
+        block_length_size = num_blocks + padding;
+        int max_sym_len = *p++;
+        min_sym_len = *p++;
+        lowest_sym = p;
+        
+        // Canonical code: longer codes have lower values, so the lowest code
+        // of each length follows from the next longer one
+        base64.assign(max_sym_len - min_sym_len + 1, 0);
+        for (int i = (int)base64.size() - 2; i >= 0; i--) {
+            base64[i] = (base64[i + 1] + read_le16(lowest_sym + 2 * i) -
+                         read_le16(lowest_sym + 2 * (i + 1))) / 2;
+        }
+        for (size_t i = 0; i < base64.size(); i++) base64[i] <<= 64 - i - min_sym_len;
+        p += 2 * base64.size();
+        
+        symlen.assign(read_le16(p), 0);
+        p += 2;
+        btree = p;
+        vector<bool> visited(symlen.size());
+        for (size_t sym = 0; sym < symlen.size(); sym++) {
+            if (!visited[sym]) set_symlen((int)sym, visited);
+        }
+        return p + 3 * symlen.size() + (symlen.size() & 1);
+    }
+    
+    // Value at position index idx
+    int value(uint64_t idx) const {
+        if (flags & SYZYGY_SINGLE_VALUE) return min_sym_len;
+        
+        // The sparse entry for idx / span locates the value in the middle of
+        // its span; walk from there to idx
+        size_t k = (size_t)(idx / span);
+        const uint8_t* entry = sparse_index + 6 * k;
+        uint32_t block = read_le32(entry);
+        int offset = read_le16(entry + 4);
+        offset += (int)(idx % span) - (int)(span / 2);
+        while (offset < 0) offset += read_le16(block_length + 2 * --block) + 1;
+        while (offset > read_le16(block_length + 2 * block)) {
+            offset -= read_le16(block_length + 2 * block++) + 1;
+        }
+        
+        // Decode symbols until the one covering offset
+        const uint8_t* ptr = data + (uint64_t)block * block_size;
+        uint64_t buf64 = ((uint64_t)read_be32(ptr) << 32) | read_be32(ptr + 4);
+        ptr += 8;
+        int buf64_size = 64;
+        int sym;
+        while (true) {
+            int len = 0;
+            while (buf64 < base64[len]) len++;
+            sym = (int)((buf64 - base64[len]) >> (64 - len - min_sym_len));
+            sym += read_le16(lowest_sym + 2 * len);
+            if (offset < symlen[sym] + 1) break;
+            offset -= symlen[sym] + 1;
+            len += min_sym_len;
+            buf64 <<= len;
+            buf64_size -= len;
+            if (buf64_size <= 32) {
+                buf64_size += 32;
+                buf64 |= (uint64_t)read_be32(ptr) << (64 - buf64_size);
+                ptr += 4;
+            }
+        }
+        
+        // Expand the symbol's pairs down to the single value at offset
+        while (symlen[sym]) {
+            int l = left(sym);
+            if (offset < symlen[l] + 1) {
+                sym = l;
+            } else {
+                offset -= symlen[l] + 1;
+                sym = right(sym);
+            }
+        }
+        return left(sym);
+    }
+};
+
+// Material of a table or position: 4-bit counts of P, N, B, R and Q for
+// each side, white's in the low bits
+inline uint64_t syzygy_material_key(const int counts[2][6]) {
+    uint64_t key = 0;
+    for (int side = 0; side < 2; side++) {
+        for (int type = 0; type < 5; type++) {
+            key |= (uint64_t)counts[side][type] << (side * 20 + type * 4);
+        }
+    }
+    return key;
+}
+
+// The tables of one material, named for the stronger side first: KQvK
+// also answers for KvKQ, with the colours swapped
+struct SyzygyTable {
+    string name;
+    uint64_t key;
+    uint64_t key2;               // the colours swapped; key for symmetric material
+    int piece_count;
+    bool has_pawns;
+    bool has_unique_pieces;      // some side has exactly one of a piece type
+    int pawn_count[2];           // the leading colour's pawns first
+    MappedFile wdl_file;
+    MappedFile dtz_file;
+    bool has_dtz;
+    SyzygyPairs wdl[2][4];       // [side to move][leading pawn file]
+    SyzygyPairs dtz[4];          // one side to move only
+    const uint8_t* dtz_map;
+};
+
+// Parses a table name like "KRPvKB" into piece counts
+inline bool parse_syzygy_name(const string& name, int counts[2][6]) {
+    static const char TYPES[] = "PNBRQK";
+    memset(counts, 0, sizeof(int) * 12);
+    int side = 0;
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == 'v' && side == 0 && i > 0) {
+            side = 1;
+            continue;
+        }
+        const char* found = name[i] ? strchr(TYPES, name[i]) : NULL;
+        if (!found) return false;
+        counts[side][found - TYPES]++;
+    }
+    return side == 1 && counts[0][5] == 1 && counts[1][5] == 1;
+}
+
+// Syzygy tables from one directory, memory-mapped
+class SyzygyTables {
+private:
+    deque<SyzygyTable> tables;
+    map<uint64_t, const SyzygyTable*> by_key;
+    int largest;
+    
+    // Groups of the encoding: the leading pawns or pieces, then runs of
+    // like pieces, and their index multipliers in the order the file gives
+    static void set_groups(const SyzygyTable& e, SyzygyPairs& d, const int order[2], int file) {
+        int n = 0;
+        int first_len = e.has_pawns ? 0 : e.has_unique_pieces ? 3 : 2;
+        d.group_len[n] = 1;
+        for (int i = 1; i < e.piece_count; i++) {
+            if (--first_len > 0 || d.pieces[i] == d.pieces[i - 1]) d.group_len[n]++;
+            else d.group_len[++n] = 1;
+        }
+        d.group_len[++n] = 0;
+        
+        bool both_pawns = e.has_pawns && e.pawn_count[1];
+        int next = both_pawns ? 2 : 1;
+        int free_squares = 64 - d.group_len[0] - (both_pawns ? d.group_len[1] : 0);
+        uint64_t idx = 1;
+        for (int k = 0; next < n || k == order[0] || k == order[1]; k++) {
+            if (k == order[0]) {
+                d.group_idx[0] = idx;
+                idx *= e.has_pawns ? SYZYGY.lead_pawns_size[d.group_len[0]][file] :
+                       e.has_unique_pieces ? 31332 : 462;
+            } else if (k == order[1]) {
+                d.group_idx[1] = idx;
+                idx *= SYZYGY.binomial[d.group_len[1]][48 - d.group_len[0]];
+            } else {
+                d.group_idx[next] = idx;
+                idx *= SYZYGY.binomial[d.group_len[next]][free_squares];
+                free_squares -= d.group_len[next++];
+            }
+        }
+        d.group_idx[n] = idx;
+    }
+    
+    static uint64_t table_size(const SyzygyPairs& d) {
+        int n = 0;
+        while (d.group_len[n]) n++;
+        return d.group_idx[n];
+    }
+    
+    // Lays the streams of a mapped .rtbw or .rtbz file over their pairs;
+    // fails on a file too short for what its headers describe
+    static bool set(SyzygyTable& e, const MappedFile& file, bool dtz) {
+        string_view view = file.view();
+        const uint8_t* base = (const uint8_t*)view.data();
+        const uint8_t* p = base + 4;
+        if (view.size() < 16 || ((*p & 2) != 0) != e.has_pawns) return false;
+        p++;
+        
+        int sides = !dtz && e.key != e.key2 ? 2 : 1;
+        int files = e.has_pawns ? 4 : 1;
+        bool both_pawns = e.has_pawns && e.pawn_count[1];
+        for (int f = 0; f < files; f++) {
+            int order[2][2] = { { *p & 0xF, both_pawns ? *(p + 1) & 0xF : 0xF },
+                                { *p >> 4, both_pawns ? *(p + 1) >> 4 : 0xF } };
+            p += 1 + both_pawns;
+            for (int k = 0; k < e.piece_count; k++, p++) {
+                for (int i = 0; i < sides; i++) {
+                    SyzygyPairs& d = dtz ? e.dtz[f] : e.wdl[i][f];
+                    d.pieces[k] = i ? *p >> 4 : *p & 0xF;
+                }
+            }
+            for (int i = 0; i < sides; i++) {
+                set_groups(e, dtz ? e.dtz[f] : e.wdl[i][f], order[i], f);
+            }
+        }
+        p += (p - base) & 1;
+
+        for (int f = 0; f < files; f++) {
+            for (int i = 0; i < sides; i++) {
+                SyzygyPairs& d = dtz ? e.dtz[f] : e.wdl[i][f];
+                p = d.set_sizes(p, table_size(d));
+            }
+        }
+        
+        // DTZ value maps: per file, four runs (by WDL) of byte or uint16
+        // values, located by map_idx relative to dtz_map
+        if (dtz) {
+            e.dtz_map = p;
+            for (int f = 0; f < files; f++) {
+                SyzygyPairs& d = e.dtz[f];
+                if (!(d.flags & SYZYGY_MAPPED)) continue;
+                if (d.flags & SYZYGY_WIDE) {
+                    p += (p - base) & 1;
+                    for (int i = 0; i < 4; i++) {
+                        d.map_idx[i] = (uint16_t)((p - e.dtz_map) / 2 + 1);
+                        p += 2 * read_le16(p) + 2;
+                    }
+                } else {
+                    for (int i = 0; i < 4; i++) {
+                        d.map_idx[i] = (uint16_t)(p - e.dtz_map + 1);
+                        p += *p + 1;
+                    }
+                }
+            }
+            p += (p - base) & 1;
+        }
+        
+        for (int f = 0; f < files; f++) {
+            for (int i = 0; i < sides; i++) {
+                SyzygyPairs& d = dtz ? e.dtz[f] : e.wdl[i][f];
+                d.sparse_index = p;
+                p += 6 * d.sparse_index_size;
+            }
+        }
+        for (int f = 0; f < files; f++) {
+            for (int i = 0; i < sides; i++) {
+                SyzygyPairs& d = dtz ? e.dtz[f] : e.wdl[i][f];
+                d.block_length = p;
+                p += 2 * d.block_length_size;
+            }
+        }
+        for (int f = 0; f < files; f++) {
+            for (int i = 0; i < sides; i++) {
+                SyzygyPairs& d = dtz ? e.dtz[f] : e.wdl[i][f];
+                p = base + (((p - base) + 0x3F) & ~(ptrdiff_t)0x3F);
+                d.data = p;
+                p += (size_t)d.num_blocks * d.block_size;
+            }
+        }
+        return p <= base + view.size();
+    }
+    
+    static bool open_file(SyzygyTable& e, MappedFile& file, const string& path,
+                          const uint8_t magic[4], bool dtz, string& error) {
+        if (!file.open(path)) {
+            error = "cannot read " + path;
+            return false;
+        }
+        string_view view = file.view();
+        if (view.size() % 64 != 16 || memcmp(view.data(), magic, 4) != 0 || !set(e, file, dtz)) {
+            error = path + " is not a Syzygy table";
+            return false;
+        }
+        return true;
+    }
+    
+    // DTZ value stored for a WDL, in plies
+    static int map_score(const SyzygyTable& e, const SyzygyPairs& d, int value, int wdl) {
+        static const int WDL_MAP[] = { 1, 3, 0, 2, 0 };
+        if (d.flags & SYZYGY_MAPPED) {
+            int idx = d.map_idx[WDL_MAP[wdl + 2]] + value;
+            value = (d.flags & SYZYGY_WIDE) ? read_le16(e.dtz_map + 2 * idx) : e.dtz_map[idx];
+        }
+        if ((wdl == 2 && !(d.flags & SYZYGY_WIN_PLIES)) || (wdl == -2 && !(d.flags & SYZYGY_LOSS_PLIES)) ||
+            wdl == 1 || wdl == -1) {
+            value *= 2;
+        }
+        return value + 1;
+    }
+
+public:
+    SyzygyTables() : largest(0) {}
+    
+    // Maps every .rtbw table in dir, with its .rtbz where there is one;
+    // fails if there is none, or one is not a valid table
+    bool open(const string& dir, string& error) {
+        tables.clear();
+        by_key.clear();
+        largest = 0;
+        error_code failure;
+        for (filesystem::directory_iterator it(dir, failure), end; !failure && it != end; it.increment(failure)) {
+            filesystem::path path = it->path();
+            int counts[2][6];
+            if (path.extension() != ".rtbw" || !parse_syzygy_name(path.stem().string(), counts)) continue;
+            
+            tables.emplace_back();
+            SyzygyTable& e = tables.back();
+            e.name = path.stem().string();
+            e.key = syzygy_material_key(counts);
+            int swapped[2][6];
+            memcpy(swapped[0], counts[1], sizeof(swapped[0]));
+            memcpy(swapped[1], counts[0], sizeof(swapped[1]));
+            e.key2 = syzygy_material_key(swapped);
+            e.piece_count = 0;
+            e.has_unique_pieces = false;
+            for (int side = 0; side < 2; side++) {
+                for (int type = 0; type < 6; type++) {
+                    e.piece_count += counts[side][type];
+                    if (type < 5 && counts[side][type] == 1) e.has_unique_pieces = true;
+                }
+            }
+            if (e.piece_count > TB_MAX_PIECES) {
+                tables.pop_back();
+                continue;
+            }
+            // With pawns on both sides the one with fewer leads
+            e.has_pawns = counts[0][0] + counts[1][0] > 0;
+            bool white_leads = !counts[1][0] || (counts[0][0] && counts[1][0] >= counts[0][0]);
+            e.pawn_count[0] = counts[white_leads ? 0 : 1][0];
+            e.pawn_count[1] = counts[white_leads ? 1 : 0][0];
+            
+            if (!open_file(e, e.wdl_file, path.string(), SYZYGY_WDL_MAGIC, false, error)) return false;
+            filesystem::path dtz_path = path;
+            dtz_path.replace_extension(".rtbz");
+            e.has_dtz = filesystem::exists(dtz_path);
+            if (e.has_dtz && !open_file(e, e.dtz_file, dtz_path.string(), SYZYGY_DTZ_MAGIC, true, error)) {
+                return false;
+            }
+            by_key[e.key] = &e;
+            by_key[e.key2] = &e;
+            largest = max(largest, e.piece_count);
+        }
+        if (failure) {
+            error = "cannot read " + dir;
+            return false;
+        }
+        if (tables.empty()) {
+            error = "no Syzygy tables in " + dir;
+            return false;
+        }
+        return true;
+    }
+    
+    bool is_open() const { return !tables.empty(); }
+    
+    int max_pieces() const { return largest; }
+    
+    // Value stored for a position with no castling rights, no pawn on the
+    // first or last rank and no en passant capture, the side to move given:
+    // its WDL (-2 loss, -1 loss saved by the fifty-move rule, 0 draw, 1 win
+    // spoilt by it, 2 win), or with dtz its DTZ in plies given its WDL.
+    // Fails without a table for the material; other_side is set when the
+    // DTZ table only holds the other side to move. The stored value can be
+    // wrong where a capture is best: callers resolve captures first.
+    bool probe(const uint64_t bb[12], bool white_to_move, bool dtz, int wdl, int& value, bool& other_side) const {
+        other_side = false;
+        int counts[2][6];
+        int total = 0;
+        uint64_t occupied = 0;
+        for (int index = 0; index < 12; index++) {
+            counts[index / 6][index % 6] = popcount(bb[index]);
+            total += counts[index / 6][index % 6];
+            occupied |= bb[index];
+        }
+        if (total == 2) {
+            value = 0;
+            return true;
+        }
+        map<uint64_t, const SyzygyTable*>::const_iterator found = by_key.find(syzygy_material_key(counts));
+        if (found == by_key.end() || (dtz && !found->second->has_dtz)) return false;
+        const SyzygyTable& e = *found->second;
+        
+        // Tables hold white as the stronger side, and symmetric ones white to
+        // move only: otherwise swap the colours and flip the board
+        bool flip = (e.key == e.key2 && !white_to_move) || syzygy_material_key(counts) != e.key;
+        int flip_color = flip ? 8 : 0;
+        int flip_squares = flip ? 56 : 0;
+        int stm = (flip ? 1 : 0) ^ (white_to_move ? 0 : 1);
+        
+        // Table squares, before flipping, are the board's byte-swapped
+        int squares[TB_MAX_PIECES] = {}, pieces[TB_MAX_PIECES] = {};
+        int size = 0, lead_count = 0, file = 0;
+        uint64_t lead = 0;
+        if (e.has_pawns) {
+            int color = ((dtz ? e.dtz[0] : e.wdl[0][0]).pieces[0] ^ flip_color) >> 3;
+            lead = __builtin_bswap64(bb[color * 6]);
+            for (uint64_t b = lead; b; b &= b - 1) squares[size++] = lsb(b) ^ flip_squares;
+            lead_count = size;
+            swap(squares[0], *max_element(squares, squares + lead_count, syzygy_pawn_less));
+            file = min(squares[0] & 7, 7 - (squares[0] & 7));
+        }
+        
+        const SyzygyPairs& d = dtz ? e.dtz[file] : e.wdl[stm][file];
+        if (dtz && (d.flags & SYZYGY_STM) != stm && !(e.key == e.key2 && !e.has_pawns)) {
+            other_side = true;
+            return true;
+        }
+        
+        for (uint64_t b = __builtin_bswap64(occupied) & ~lead; b; b &= b - 1) {
+            int sq = lsb(b);
+            uint64_t board_bit = 1ULL << (sq ^ 56);
+            int index = 0;
+            while (!(bb[index] & board_bit)) index++;
+            squares[size] = sq ^ flip_squares;
+            pieces[size++] = ((index / 6) * 8 + index % 6 + 1) ^ flip_color;
+        }
+        
+        // Put the pieces in the table's order
+        for (int i = lead_count; i < size - 1; i++) {
+            for (int j = i + 1; j < size; j++) {
+                if (d.pieces[i] == pieces[j]) {
+                    swap(pieces[i], pieces[j]);
+                    swap(squares[i], squares[j]);
+                    break;
+                }
+            }
+        }
+        
+        // Mirror the leading piece into files a-d
+        if ((squares[0] & 7) > 3) {
+            for (int i = 0; i < size; i++) squares[i] ^= 7;
+        }
+        
+        uint64_t idx;
+        if (e.has_pawns) {
+            idx = SYZYGY.lead_pawn_idx[lead_count][squares[0]];
+            stable_sort(squares + 1, squares + lead_count, syzygy_pawn_less);
+            for (int i = 1; i < lead_count; i++) idx += SYZYGY.binomial[i][SYZYGY.map_pawns[squares[i]]];
+        } else {
+            // Without pawns the board also mirrors to ranks 1-4, and across
+            // the a1-h8 diagonal to put the first leading piece off it below
+            if ((squares[0] >> 3) > 3) {
+                for (int i = 0; i < size; i++) squares[i] ^= 56;
+            }
+            for (int i = 0; i < d.group_len[0]; i++) {
+                if (!off_a1h8(squares[i])) continue;
+                if (off_a1h8(squares[i]) > 0) {
+                    for (int j = i; j < size; j++) squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+                }
+                break;
+            }
+            
+            if (e.has_unique_pieces) {
+                int adjust1 = squares[1] > squares[0];
+                int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+                if (off_a1h8(squares[0])) {
+                    idx = ((uint64_t)SYZYGY.map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 +
+                          squares[2] - adjust2;
+                } else if (off_a1h8(squares[1])) {
+                    idx = ((uint64_t)6 * 63 + (squares[0] >> 3) * 28 + SYZYGY.map_b1h1h7[squares[1]]) * 62 +
+                          squares[2] - adjust2;
+                } else if (off_a1h8(squares[2])) {
+                    idx = 6 * 63 * 62 + 4 * 28 * 62 + (squares[0] >> 3) * 7 * 28 +
+                          ((squares[1] >> 3) - adjust1) * 28 + SYZYGY.map_b1h1h7[squares[2]];
+                } else {
+                    idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (squares[0] >> 3) * 7 * 6 +
+                          ((squares[1] >> 3) - adjust1) * 6 + (squares[2] >> 3) - adjust2;
+                }
+            } else {
+                idx = SYZYGY.map_kk[SYZYGY.map_a1d1d4[squares[0]]][squares[1]];
+            }
+        }
+        idx *= d.group_idx[0];
+        
+        // The other groups, each as a combination of the squares left free,
+        // counted down past the squares of the groups before it
+        int* group = squares + d.group_len[0];
+        bool remaining_pawns = e.has_pawns && e.pawn_count[1];
+        for (int next = 1; d.group_len[next]; next++) {
+            stable_sort(group, group + d.group_len[next]);
+            uint64_t n = 0;
+            for (int i = 0; i < d.group_len[next]; i++) {
+                int adjust = 0;
+                for (int* s = squares; s != group; s++) adjust += group[i] > *s;
+                n += SYZYGY.binomial[i + 1][group[i] - adjust - 8 * remaining_pawns];
+            }
+            remaining_pawns = false;
+            idx += n * d.group_idx[next];
+            group += d.group_len[next];
+        }
+        
+        value = d.value(idx);
+        value = dtz ? map_score(e, d, value, wdl) : value - 2;
+        return true;
+    }
+};
+
+// Most pieces, kings included, a position may have for the search to
+// probe the tables; 0 turns probing off. Also capped by the largest table
+// loaded.
+int TB_PROBE_LIMIT = TB_MAX_PIECES;
+
+SyzygyTables TABLEBASE;
+
+// How a tablebase search ended: the position's best move is a capture or
+// pawn move whose value is already known (ZEROING), or the DTZ table holds
+// only the other side to move (CHANGE_STM)
+enum TablebaseProbeState { TB_PROBE_FAIL, TB_PROBE_OK, TB_PROBE_ZEROING, TB_PROBE_CHANGE_STM };
+
+// DTZ, in plies, of a position whose best move zeroes the move counter
+inline int dtz_before_zeroing(int wdl) {
+    return wdl == 2 ? 1 : wdl == 1 ? 101 : wdl == -1 ? -101 : wdl == -2 ? -1 : 0;
+}
+
+// Direct-mapped cache of the search's WDL probes keyed by the position's
+// Zobrist key; value TB_NOT_COVERED marks a position the tables miss
+const int TB_NOT_COVERED = 99;
+
+struct TablebaseCacheEntry {
+    uint64_t key;
+    int value;
+};
+
+class TablebaseCache {
+private:
+    vector<TablebaseCacheEntry> entries;
+
+public:
+    static const size_t SIZE = 4096;
+    
+    TablebaseCache() : entries(SIZE) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            entries[i].key = ~0ULL;
+        }
+    }
+    
+    TablebaseCacheEntry& slot(uint64_t key) {
+        return entries[key & (SIZE - 1)];
+    }
+};
+
+thread_local TablebaseCache TB_CACHE;
+
+class Chess {
+private:
+    vector<vector<char> > board;
+    string current_player;
+    // Moves played, packed by log_move(); SAN is rendered from this only
+    // when a PGN is actually needed
+    vector<uint16_t> move_log;
+    map<string, vector<char> > captured_pieces;
+    string winner;
+    int difficulty_ai1;
+    int difficulty_ai2;
+    
+    Position white_king_pos;
+    Position black_king_pos;
+    bool white_can_castle_kingside;
+    bool white_can_castle_queenside;
+    bool black_can_castle_kingside;
+    bool black_can_castle_queenside;
+    Position en_passant_target;
+    int halfmove_clock;     // plies since the last capture or pawn move
+    int fullmove_number;
+    
+    // Position the game started from when it was not the standard one, for
+    // the PGN FEN tag
+    char start_fen[FEN_BUFFER_SIZE];
+    size_t start_fen_length;
+    int start_fullmove;
+    bool start_white_to_move;
+    
+    int white_wins;
+    int black_wins;
+    int draws;
+    int total_games;
+    
+    mt19937 gen;
+    
+    string last_game_pgn;
+    bool pgn_pending;   // the last game's PGN has not been rendered yet
+    
+    // Running material + piece-square score (white minus black), game phase
+    // and Zobrist key of the piece placement, maintained by set_square()
+    Score psq_score;
+    int material_key;       // index into MATERIAL_TABLE
+    int material_overflow;  // piece types above their material-key cap
+    uint64_t piece_hash;
+    uint64_t pawn_hash;
+    uint64_t piece_bb[12];  // one bitboard per piece_index()
+    
+    // NNUE accumulator, maintained by set_square() when NNUE is selected
+    NnueAccumulator nnue_acc;
+    vector<NnueFinnyEntry> nnue_finny;  // [side * 64 + king square]
+    
+    // AI search statistics
+    int nodes_searched;
+    int tt_hits;
+    long pawn_probes;
+    long pawn_hits;
+    long eval_cache_hits;
+    long eval_cache_misses;
+    long eval_cheap_tier;  // evaluations that computed the cheap tier
+    long eval_full_tier;   // ... and went on to the expensive tier
+    long tb_probes;        // endgame table lookups
+    long tb_cache_hits;    // ... answered by TB_CACHE
+    
+    // Moves played so far in a headless game
+    int headless_move_count;
+    
+    // Seed of the current headless game, reported in its PGN
+    unsigned int game_seed;
+    bool seeded_game;
+    
+    // Time spent playing the current headless game's moves (other games
+    // sharing the thread excluded), reported in its PGN
+    double game_seconds;
+    bool timed_game;
+    
+    // Round tag of the current game's PGN when set by a tournament (its job
+    // number), 0 to number games by this object's own count
+    int game_round;
+
+public:
+    static const int MAX_GAME_MOVES = 200;
+    
+    Chess() {
+        random_device rd;
+        gen.seed(rd());
+        
+        board = init_board();
+        refresh_incremental_state();
+        current_player = "white";
+        winner = "";
+        difficulty_ai1 = 2;
+        difficulty_ai2 = 2;
+        
+        white_king_pos = Position(7, 4);
+        black_king_pos = Position(0, 4);
+        white_can_castle_kingside = true;
+        white_can_castle_queenside = true;
+        black_can_castle_kingside = true;
+        black_can_castle_queenside = true;
+        
+        white_wins = 0;
+        black_wins = 0;
+        draws = 0;
+        total_games = 0;
+        reset_search_stats();
+        headless_move_count = 0;
+        game_seed = 0;
+        seeded_game = false;
+        pgn_pending = false;
+        game_seconds = 0.0;
+        timed_game = false;
+        game_round = 0;
+        halfmove_clock = 0;
+        fullmove_number = 1;
+        start_fen_length = 0;
+        start_fullmove = 1;
+        start_white_to_move = true;
+        
+        captured_pieces["white"] = vector<char>();
+        captured_pieces["black"] = vector<char>();
+    }
+    
+    vector<vector<char> > init_board() {
+        vector<vector<char> > b(8, vector<char>(8, ' '));
+        
+        char black_back[] = {'r', 'n', 'b', 'q', 'k', 'b', 'n', 'r'};
+        char black_pawns[] = {'p', 'p', 'p', 'p', 'p', 'p', 'p', 'p'};
+        for (int i = 0; i < 8; i++) {
+            b[0][i] = black_back[i];
+            b[1][i] = black_pawns[i];
+        }
+        
+        char white_pawns[] = {'P', 'P', 'P', 'P', 'P', 'P', 'P', 'P'};
+        char white_back[] = {'R', 'N', 'B', 'Q', 'K', 'B', 'N', 'R'};
+        for (int i = 0; i < 8; i++) {
+            b[6][i] = white_pawns[i];
+            b[7][i] = white_back[i];
+        }
+        
+        return b;
+    }
+    
+    void clear_screen() {
+        #ifdef _WIN32
+            system("cls");
+        #else
+            system("clear");
+        #endif
+    }
+    
+    string get_piece_symbol(char piece) {
+        static map<char, string> symbols;
+        if (symbols.empty()) {
+            symbols['K'] = "♔"; symbols['Q'] = "♕"; symbols['R'] = "♖";
+            symbols['B'] = "♗"; symbols['N'] = "♘"; symbols['P'] = "♙";
+            symbols['k'] = "♚"; symbols['q'] = "♛"; symbols['r'] = "♜";
+            symbols['b'] = "♝"; symbols['n'] = "♞"; symbols['p'] = "♟";
+            symbols[' '] = "·";
+        }
+        return symbols[piece];
+    }
+    
+    void display_board() {
+        clear_screen();
+        
+        cout << "\n" << string(50, '=') << endl;
+        cout << "   CHESS - " << current_player << "'s Turn" << endl;
+        cout << string(50, '=') << endl;
+        
+        cout << "\n    a  b  c  d  e  f  g  h" << endl;
+        cout << "  ┌" << repeat_string("─", 24) << "┐" << endl;
+        
+        for (int i = 0; i < 8; i++) {
+            cout << (8 - i) << " │";
+            for (int j = 0; j < 8; j++) {
+                char piece = board[i][j];
+                cout << " " << get_piece_symbol(piece) << " ";
+            }
+            cout << "│ " << (8 - i) << endl;
+        }
+        
+        cout << "  └" << repeat_string("─", 24) << "┘" << endl;
+        cout << "    a  b  c  d  e  f  g  h\n" << endl;
+        
+        if (!captured_pieces["white"].empty() || !captured_pieces["black"].empty()) {
+            cout << "Captured pieces:" << endl;
+            if (!captured_pieces["black"].empty()) {
+                cout << "  White captured: ";
+                for (size_t i = 0; i < captured_pieces["black"].size(); i++) {
+                    cout << get_piece_symbol(captured_pieces["black"][i]) << " ";
+                }
+                cout << endl;
+            }
+            if (!captured_pieces["white"].empty()) {
+                cout << "  Black captured: ";
+                for (size_t i = 0; i < captured_pieces["white"].size(); i++) {
+                    cout << get_piece_symbol(captured_pieces["white"][i]) << " ";
+                }
+                cout << endl;
+            }
+            cout << endl;
+        }
+        
+        if (!move_log.empty()) {
+            char promotion;
+            Move last = logged_move(move_log.back(), promotion);
+            char piece = (move_log.back() >> 12) ? 'P' : board[last.to_row][last.to_col];
+            cout << "Last move: " << char(toupper(static_cast<unsigned char>(piece)))
+                 << char('a' + last.from_col) << char('0' + (8 - last.from_row)) << "-"
+                 << char('a' + last.to_col) << char('0' + (8 - last.to_row)) << "\n" << endl;
+        }
+    }
+    
+    bool is_valid_position(int row, int col) const {
+        return row >= 0 && row < 8 && col >= 0 && col < 8;
+    }
+    
+    bool is_white_piece(char piece) const {
+        return piece != ' ' && isupper(static_cast<unsigned char>(piece));
+    }
+    
+    bool is_black_piece(char piece) const {
+        return piece != ' ' && islower(static_cast<unsigned char>(piece));
+    }
+    
+    string get_piece_color(char piece) const {
+        if (piece == ' ') return "";
+        return is_white_piece(piece) ? "white" : "black";
+    }
+    
+    vector<Position> get_pawn_moves(int row, int col, char piece) {
+        vector<Position> moves;
+        int direction = is_white_piece(piece) ? -1 : 1;
+        int start_row = is_white_piece(piece) ? 6 : 1;
+        
+        int new_row = row + direction;
+        if (is_valid_position(new_row, col) && board[new_row][col] == ' ') {
+            moves.push_back(Position(new_row, col));
+            
+            if (row == start_row) {
+                int new_row2 = row + 2 * direction;
+                if (board[new_row2][col] == ' ') {
+                    moves.push_back(Position(new_row2, col));
+                }
+            }
+        }
+        
+        int deltas[] = {-1, 1};
+        for (int d = 0; d < 2; d++) {
+            int dc = deltas[d];
+            new_row = row + direction;
+            int new_col = col + dc;
+            if (is_valid_position(new_row, new_col)) {
+                char target = board[new_row][new_col];
+                if (target != ' ' && get_piece_color(target) != get_piece_color(piece)) {
+                    moves.push_back(Position(new_row, new_col));
+                }
+                else if (en_passant_target.has_value() && 
+                         en_passant_target.row == new_row && 
+                         en_passant_target.col == new_col) {
+                    moves.push_back(Position(new_row, new_col));
+                }
+            }
+        }
+        
+        return moves;
+    }
+    
+    vector<Position> get_knight_moves(int row, int col, char piece) {
+        vector<Position> moves;
+        int knight_deltas[][2] = {
+            {-2, -1}, {-2, 1}, {-1, -2}, {-1, 2},
+            {1, -2}, {1, 2}, {2, -1}, {2, 1}
+        };
+        
+        for (int i = 0; i < 8; i++) {
+            int dr = knight_deltas[i][0];
+            int dc = knight_deltas[i][1];
+            int new_row = row + dr;
+            int new_col = col + dc;
+            if (is_valid_position(new_row, new_col)) {
+                char target = board[new_row][new_col];
+                if (target == ' ' || get_piece_color(target) != get_piece_color(piece)) {
+                    moves.push_back(Position(new_row, new_col));
+                }
+            }
+        }
+        
+        return moves;
+    }
+    
+    vector<Position> get_sliding_moves(int row, int col, char piece, 
+                                       const int directions[][2], int num_dirs) {
+        vector<Position> moves;
+        
+        for (int i = 0; i < num_dirs; i++) {
+            int dr = directions[i][0];
+            int dc = directions[i][1];
+            int new_row = row + dr;
+            int new_col = col + dc;
+            while (is_valid_position(new_row, new_col)) {
+                char target = board[new_row][new_col];
+                if (target == ' ') {
+                    moves.push_back(Position(new_row, new_col));
+                } else if (get_piece_color(target) != get_piece_color(piece)) {
+                    moves.push_back(Position(new_row, new_col));
+                    break;
+                } else {
+                    break;
+                }
+                new_row += dr;
+                new_col += dc;
+            }
+        }
+        
+        return moves;
+    }
+    
+    vector<Position> get_bishop_moves(int row, int col, char piece) {
+        int directions[][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+        return get_sliding_moves(row, col, piece, directions, 4);
+    }
+    
+    vector<Position> get_rook_moves(int row, int col, char piece) {
+        int directions[][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+        return get_sliding_moves(row, col, piece, directions, 4);
+    }
+    
+    vector<Position> get_queen_moves(int row, int col, char piece) {
+        int directions[][2] = {
+            {-1, -1}, {-1, 0}, {-1, 1},
+            {0, -1},           {0, 1},
+            {1, -1},  {1, 0},  {1, 1}
+        };
+        return get_sliding_moves(row, col, piece, directions, 8);
+    }
+    
+    vector<Position> get_king_moves(int row, int col, char piece) {
+        vector<Position> moves;
+        int directions[][2] = {
+            {-1, -1}, {-1, 0}, {-1, 1},
+            {0, -1},           {0, 1},
+            {1, -1},  {1, 0},  {1, 1}
+        };
+        
+        for (int i = 0; i < 8; i++) {
+            int dr = directions[i][0];
+            int dc = directions[i][1];
+            int new_row = row + dr;
+            int new_col = col + dc;
+            if (is_valid_position(new_row, new_col)) {
+                char target = board[new_row][new_col];
+                if (target == ' ' || get_piece_color(target) != get_piece_color(piece)) {
+                    moves.push_back(Position(new_row, new_col));
+                }
+            }
+        }
+        
+        if (piece == 'K' && row == 7 && col == 4) {
+            if (white_can_castle_kingside && board[7][5] == ' ' && board[7][6] == ' ') {
+                moves.push_back(Position(7, 6));
+            }
+            if (white_can_castle_queenside && board[7][1] == ' ' && 
+                board[7][2] == ' ' && board[7][3] == ' ') {
+                moves.push_back(Position(7, 2));
+            }
+        } else if (piece == 'k' && row == 0 && col == 4) {
+            if (black_can_castle_kingside && board[0][5] == ' ' && board[0][6] == ' ') {
+                moves.push_back(Position(0, 6));
+            }
+            if (black_can_castle_queenside && board[0][1] == ' ' && 
+                board[0][2] == ' ' && board[0][3] == ' ') {
+                moves.push_back(Position(0, 2));
+            }
+        }
+        
+        return moves;
+    }
+    
+    vector<Position> get_piece_moves(int row, int col) {
+        char piece = board[row][col];
+        if (piece == ' ') return vector<Position>();
+        
+        char piece_type = toupper(static_cast<unsigned char>(piece));
+        
+        switch (piece_type) {
+            case 'P': return get_pawn_moves(row, col, piece);
+            case 'N': return get_knight_moves(row, col, piece);
+            case 'B': return get_bishop_moves(row, col, piece);
+            case 'R': return get_rook_moves(row, col, piece);
+            case 'Q': return get_queen_moves(row, col, piece);
+            case 'K': return get_king_moves(row, col, piece);
+        }
+        
+        return vector<Position>();
+    }
+    
+    // Attack test on the piece bitboards: a square is attacked by a piece
+    // of by_color exactly when that piece, standing on the square, would
+    // see it from there
+    bool is_square_attacked(int row, int col, const string& by_color) {
+        int sq = row * 8 + col;
+        int base = (by_color == "white") ? 0 : 6;
+        uint64_t target = 1ULL << sq;
+        uint64_t pawn_sources = (base == 0) ? black_pawn_attacks(target) : white_pawn_attacks(target);
+        if ((pawn_sources & piece_bb[base]) || (ATTACKS.knight[sq] & piece_bb[base + 1]) || 
+            (ATTACKS.king[sq] & piece_bb[base + 5])) {
+            return true;
+        }
+        
+        uint64_t occupied = 0;
+        for (int i = 0; i < 12; i++) occupied |= piece_bb[i];
+        uint64_t queens = piece_bb[base + 4];
+        return (bishop_attacks(sq, occupied) & (piece_bb[base + 2] | queens)) || 
+               (rook_attacks(sq, occupied) & (piece_bb[base + 3] | queens));
+    }
+    
+    bool is_in_check(const string& color) {
+        Position king_pos = (color == "white") ? white_king_pos : black_king_pos;
+        string opponent_color = (color == "white") ? "black" : "white";
+        return is_square_attacked(king_pos.row, king_pos.col, opponent_color);
+    }
+    
+    // All board writes go through here so the running evaluation sums and
+    // the piece hash stay in step with the board.
+    void set_square(int row, int col, char piece) {
+        int sq = row * 8 + col;
+        int old_index = piece_index(board[row][col]);
+        if (old_index >= 0) {
+            psq_score -= PSQ[old_index][sq];
+            material_key -= MATERIAL_KEY_WEIGHT[old_index];
+            if (has_more_than(piece_bb[old_index], MATERIAL_CAP[old_index % 6])) material_overflow--;
+            piece_hash ^= ZOBRIST.pieces[old_index][sq];
+            if (old_index == 0 || old_index == 6) pawn_hash ^= ZOBRIST.pieces[old_index][sq];
+            piece_bb[old_index] ^= 1ULL << sq;
+        }
+        int new_index = piece_index(piece);
+        if (new_index >= 0) {
+            psq_score += PSQ[new_index][sq];
+            material_key += MATERIAL_KEY_WEIGHT[new_index];
+            piece_hash ^= ZOBRIST.pieces[new_index][sq];
+            if (new_index == 0 || new_index == 6) pawn_hash ^= ZOBRIST.pieces[new_index][sq];
+            piece_bb[new_index] ^= 1ULL << sq;
+            if (has_more_than(piece_bb[new_index], MATERIAL_CAP[new_index % 6])) material_overflow++;
+        }
+        if (nnue_active()) update_nnue_accumulator(old_index, new_index, sq);
+        board[row][col] = piece;
+    }
+    
+    // Adds and removes the feature rows of a board write. A king write
+    // invalidates that side's half instead; evaluate_nnue() rebuilds it
+    // from the per-king-square cache.
+    void update_nnue_accumulator(int old_index, int new_index, int sq) {
+        for (int p = 0; p < 2; p++) {
+            if (nnue_acc.dirty[p]) continue;
+            if (old_index == p * 6 + 5 || new_index == p * 6 + 5) {
+                nnue_acc.dirty[p] = true;
+                continue;
+            }
+            if (old_index >= 0 && old_index % 6 != 5) {
+                nnue_update_row(nnue_acc.values[p], nnue_feature(p, nnue_acc.king_sq[p], old_index, sq), false);
+            }
+            if (new_index >= 0 && new_index % 6 != 5) {
+                nnue_update_row(nnue_acc.values[p], nnue_feature(p, nnue_acc.king_sq[p], new_index, sq), true);
+            }
+        }
+    }
+    
+    int evaluate_nnue() {
+        if (nnue_finny.empty()) {
+            nnue_finny.resize(2 * 64);
+            for (size_t i = 0; i < nnue_finny.size(); i++) nnue_clear_finny_entry(nnue_finny[i]);
+        }
+        for (int p = 0; p < 2; p++) {
+            if (!nnue_acc.dirty[p]) continue;
+            int king_sq = lsb(piece_bb[p * 6 + 5]);
+            nnue_refresh_half(nnue_acc, p, piece_bb, nnue_finny[p * 64 + king_sq]);
+        }
+        return nnue_forward(nnue_acc);
+    }
+    
+    // Recomputes the incremental terms from scratch after the whole board
+    // has been replaced
+    void refresh_incremental_state() {
+        memset(piece_bb, 0, sizeof(piece_bb));
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                int index = piece_index(board[i][j]);
+                if (index >= 0) piece_bb[index] |= 1ULL << (i * 8 + j);
+            }
+        }
+        refresh_from_bitboards();
+    }
+    
+    // Same, when piece_bb already matches the board
+    void refresh_from_bitboards() {
+        psq_score = 0;
+        material_key = 0;
+        material_overflow = 0;
+        piece_hash = 0;
+        pawn_hash = 0;
+        for (int index = 0; index < 12; index++) {
+            int count = popcount(piece_bb[index]);
+            material_key += count * MATERIAL_KEY_WEIGHT[index];
+            if (count > MATERIAL_CAP[index % 6]) material_overflow++;
+            for (uint64_t b = piece_bb[index]; b; b &= b - 1) {
+                int sq = lsb(b);
+                psq_score += PSQ[index][sq];
+                piece_hash ^= ZOBRIST.pieces[index][sq];
+                if (index == 0 || index == 6) pawn_hash ^= ZOBRIST.pieces[index][sq];
+            }
+        }
+        nnue_acc.dirty[0] = nnue_acc.dirty[1] = true;
+    }
+    
+    // Lightweight make/unmake used by search and legality checks. Like the
+    // rest of the search it moves only the piece itself (no castling rook,
+    // en passant or promotion side effects).
+    struct SearchUndo {
+        char piece;
+        char captured;
+    };
+    
+    SearchUndo make_search_move(const Move& move) {
+        SearchUndo undo;
+        undo.piece = board[move.from_row][move.from_col];
+        undo.captured = board[move.to_row][move.to_col];
+        
+        set_square(move.to_row, move.to_col, undo.piece);
+        set_square(move.from_row, move.from_col, ' ');
+        if (undo.piece == 'K') white_king_pos = Position(move.to_row, move.to_col);
+        else if (undo.piece == 'k') black_king_pos = Position(move.to_row, move.to_col);
+        return undo;
+    }
+    
+    void unmake_search_move(const Move& move, const SearchUndo& undo) {
+        set_square(move.from_row, move.from_col, undo.piece);
+        set_square(move.to_row, move.to_col, undo.captured);
+        if (undo.piece == 'K') white_king_pos = Position(move.from_row, move.from_col);
+        else if (undo.piece == 'k') black_king_pos = Position(move.from_row, move.from_col);
+    }
+    
+    struct GameState {
+        vector<vector<char> > board;
+        Position white_king;
+        Position black_king;
+        bool w_castle_k, w_castle_q, b_castle_k, b_castle_q;
+        Position en_passant;
+        Score psq_score;
+        int material_key;
+        int material_overflow;
+        uint64_t piece_hash;
+        uint64_t pawn_hash;
+        uint64_t piece_bb[12];
+    };
+    
+    GameState save_state() {
+        GameState state;
+        state.board = board;
+        state.white_king = white_king_pos;
+        state.black_king = black_king_pos;
+        state.w_castle_k = white_can_castle_kingside;
+        state.w_castle_q = white_can_castle_queenside;
+        state.b_castle_k = black_can_castle_kingside;
+        state.b_castle_q = black_can_castle_queenside;
+        state.en_passant = en_passant_target;
+        state.psq_score = psq_score;
+        state.material_key = material_key;
+        state.material_overflow = material_overflow;
+        state.piece_hash = piece_hash;
+        state.pawn_hash = pawn_hash;
+        memcpy(state.piece_bb, piece_bb, sizeof(piece_bb));
+        return state;
+    }
+    
+    void restore_state(const GameState& state) {
+        board = state.board;
+        white_king_pos = state.white_king;
+        black_king_pos = state.black_king;
+        white_can_castle_kingside = state.w_castle_k;
+        white_can_castle_queenside = state.w_castle_q;
+        black_can_castle_kingside = state.b_castle_k;
+        black_can_castle_queenside = state.b_castle_q;
+        en_passant_target = state.en_passant;
+        psq_score = state.psq_score;
+        material_key = state.material_key;
+        material_overflow = state.material_overflow;
+        piece_hash = state.piece_hash;
+        pawn_hash = state.pawn_hash;
+        memcpy(piece_bb, state.piece_bb, sizeof(piece_bb));
+        nnue_acc.dirty[0] = nnue_acc.dirty[1] = true;
+    }
+    
+    // SAN for a move about to be made, without the check suffix. Must run
+    // before the move so the other pieces that reach the destination can be
+    // seen for disambiguation.
+    string to_pgn_notation(int from_row, int from_col, int to_row, int to_col, 
+                          char piece, bool is_capture, char promotion) {
+        string notation = "";
+        char piece_type = toupper(static_cast<unsigned char>(piece));
+        
+        if (piece_type == 'K' && abs(to_col - from_col) == 2) {
+            return (to_col > from_col) ? "O-O" : "O-O-O";
+        }
+        
+        if (piece_type != 'P') {
+            notation += piece_type;
+        }
+        
+        bool need_file = false;
+        bool need_rank = false;
+        
+        if (piece_type != 'P') {
+            for (int i = 0; i < 8; i++) {
+                for (int j = 0; j < 8; j++) {
+                    if (i == from_row && j == from_col) continue;
+                    if (toupper(static_cast<unsigned char>(board[i][j])) == piece_type &&
+                        get_piece_color(board[i][j]) == get_piece_color(piece)) {
+                        vector<Position> moves = get_piece_moves(i, j);
+                        for (size_t k = 0; k < moves.size(); k++) {
+                            if (moves[k].row == to_row && moves[k].col == to_col) {
+                                if (j != from_col) need_file = true;
+                                else need_rank = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        
+        if (need_file || (piece_type == 'P' && is_capture)) {
+            notation += char('a' + from_col);
+        }
+        if (need_rank) {
+            notation += char('0' + (8 - from_row));
+        }
+        
+        if (is_capture) {
+            notation += 'x';
+        }
+        
+        notation += char('a' + to_col);
+        notation += char('0' + (8 - to_row));
+        
+        if (piece_type == 'P' && (to_row == 0 || to_row == 7)) {
+            notation += '=';
+            notation += promotion;
+        }
+        
+        return notation;
+    }
+    
+    // promotion is the piece a pawn reaching the last rank becomes (Q, R, B
+    // or N); it is ignored for other moves
+    bool make_move(int from_row, int from_col, int to_row, int to_col, char promotion = 'Q') {
+        char piece = board[from_row][from_col];
+        
+        if (piece == ' ') return false;
+        if (get_piece_color(piece) != current_player) return false;
+        if (promotion != 'Q' && promotion != 'R' && promotion != 'B' && promotion != 'N') return false;
+        
+        vector<Position> valid_moves = get_piece_moves(from_row, from_col);
+        bool found = false;
+        for (size_t i = 0; i < valid_moves.size(); i++) {
+            if (valid_moves[i].row == to_row && valid_moves[i].col == to_col) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) return false;
+        
+        GameState saved_state = save_state();
+        bool is_capture = false;
+        char captured = move_piece(from_row, from_col, to_row, to_col, piece, is_capture);
+        
+        if (is_in_check(current_player)) {
+            restore_state(saved_state);
+            if (captured != ' ') {
+                captured_pieces[current_player].pop_back();
+            }
+            return false;
+        }
+        
+        finish_move(from_row, from_col, to_row, to_col, piece, is_capture, promotion);
+        return true;
+    }
+    
+    // Plays a move already known to be legal for the side to move, without
+    // make_move's validation and state copy; PGN replay takes this path
+    // after find_san_move has tested legality
+    void play_legal_move(const Move& move, char promotion) {
+        char piece = board[move.from_row][move.from_col];
+        bool is_capture = false;
+        move_piece(move.from_row, move.from_col, move.to_row, move.to_col, piece, is_capture);
+        finish_move(move.from_row, move.from_col, move.to_row, move.to_col, piece, is_capture, promotion);
+        current_player = (current_player == "white") ? "black" : "white";
+    }
+    
+    // Moves the piece along with any castling rook or en passant victim and
+    // updates castling rights and the en passant square. Returns the
+    // captured piece.
+    char move_piece(int from_row, int from_col, int to_row, int to_col, char piece, bool& is_capture) {
+        char captured = board[to_row][to_col];
+        bool en_passant = toupper(static_cast<unsigned char>(piece)) == 'P' && 
+                          en_passant_target.has_value() && 
+                          en_passant_target.row == to_row && en_passant_target.col == to_col;
+        is_capture = (captured != ' ') || en_passant;
+        
+        if (en_passant) {
+            if (is_white_piece(piece)) {
+                captured = board[to_row + 1][to_col];
+                set_square(to_row + 1, to_col, ' ');
+            } else {
+                captured = board[to_row - 1][to_col];
+                set_square(to_row - 1, to_col, ' ');
+            }
+        }
+        
+        if (captured != ' ') {
+            captured_pieces[current_player].push_back(captured);
+        }
+        
+        set_square(to_row, to_col, piece);
+        set_square(from_row, from_col, ' ');
+        
+        if (piece == 'K') {
+            white_king_pos = Position(to_row, to_col);
+            if (from_col == 4 && to_col == 6) {
+                set_square(7, 5, 'R');
+                set_square(7, 7, ' ');
+            } else if (from_col == 4 && to_col == 2) {
+                set_square(7, 3, 'R');
+                set_square(7, 0, ' ');
+            }
+            white_can_castle_kingside = false;
+            white_can_castle_queenside = false;
+        } else if (piece == 'k') {
+            black_king_pos = Position(to_row, to_col);
+            if (from_col == 4 && to_col == 6) {
+                set_square(0, 5, 'r');
+                set_square(0, 7, ' ');
+            } else if (from_col == 4 && to_col == 2) {
+                set_square(0, 3, 'r');
+                set_square(0, 0, ' ');
+            }
+            black_can_castle_kingside = false;
+            black_can_castle_queenside = false;
+        }
+        
+        if (piece == 'R' && from_row == 7) {
+            if (from_col == 0) white_can_castle_queenside = false;
+            else if (from_col == 7) white_can_castle_kingside = false;
+        } else if (piece == 'r' && from_row == 0) {
+            if (from_col == 0) black_can_castle_queenside = false;
+            else if (from_col == 7) black_can_castle_kingside = false;
+        }
+        
+        en_passant_target = Position();
+        if (toupper(static_cast<unsigned char>(piece)) == 'P' && abs(to_row - from_row) == 2) {
+            en_passant_target = Position((from_row + to_row) / 2, from_col);
+        }
+        
+        return captured;
+    }
+    
+    // Clocks, promotion and move log once a move has been made
+    void finish_move(int from_row, int from_col, int to_row, int to_col, char piece, 
+                     bool is_capture, char promotion) {
+        if (is_capture || toupper(static_cast<unsigned char>(piece)) == 'P') halfmove_clock = 0;
+        else halfmove_clock++;
+        if (!is_white_piece(piece)) fullmove_number++;
+        
+        if (piece == 'P' && to_row == 0) {
+            set_square(to_row, to_col, promotion);
+        } else if (piece == 'p' && to_row == 7) {
+            set_square(to_row, to_col, char(tolower(static_cast<unsigned char>(promotion))));
+        }
+        
+        log_move(from_row, from_col, to_row, to_col, piece, promotion);
+    }
+    
+    // Move log entries are from square | to square << 6, plus (1 + the
+    // promotion's index in "QRBN") << 12 for a pawn reaching the last rank
+    static uint16_t pack_move(int from_row, int from_col, int to_row, int to_col, 
+                              char piece, char promotion) {
+        int promoted = 0;
+        if (toupper(static_cast<unsigned char>(piece)) == 'P' && (to_row == 0 || to_row == 7)) {
+            promoted = 1 + (int)(strchr(GAME_RECORD_PROMOTIONS, promotion) - GAME_RECORD_PROMOTIONS);
+        }
+        return (uint16_t)((from_row * 8 + from_col) | ((to_row * 8 + to_col) << 6) | (promoted << 12));
+    }
+    
+    void log_move(int from_row, int from_col, int to_row, int to_col, char piece, char promotion) {
+        move_log.push_back(pack_move(from_row, from_col, to_row, to_col, piece, promotion));
+    }
+    
+    static Move logged_move(uint16_t entry, char& promotion) {
+        int from = entry & 63;
+        int to = (entry >> 6) & 63;
+        promotion = (entry >> 12) ? GAME_RECORD_PROMOTIONS[(entry >> 12) - 1] : 'Q';
+        return Move(from / 8, from % 8, to / 8, to % 8);
+    }
+    
+    uint16_t pack_board_move(const Move& move, char promotion) const {
+        return pack_move(move.from_row, move.from_col, move.to_row, move.to_col, 
+                         board[move.from_row][move.from_col], promotion);
+    }
+    
+    // SAN for a legal move of the side to move, without the check suffix
+    string san_before_move(const Move& move, char promotion) {
+        char piece = board[move.from_row][move.from_col];
+        bool is_capture = board[move.to_row][move.to_col] != ' ' || 
+                          (toupper(static_cast<unsigned char>(piece)) == 'P' && 
+                           move.from_col != move.to_col);
+        return to_pgn_notation(move.from_row, move.from_col, move.to_row, move.to_col, 
+                               piece, is_capture, promotion);
+    }
+    
+    // SAN for every move of the game, rendered by replaying the move log
+    // from the start position
+    vector<string> render_san_moves() const {
+        vector<string> moves;
+        Chess replay;
+        if (start_fen_length > 0) replay.load_fen(string_view(start_fen, start_fen_length));
+        
+        for (size_t i = 0; i < move_log.size(); i++) {
+            char promotion;
+            Move move = logged_move(move_log[i], promotion);
+            string san = replay.san_before_move(move, promotion);
+            replay.play_move(move, promotion);
+            if (replay.is_in_check(replay.current_player)) {
+                san += replay.is_checkmate(replay.current_player) ? '#' : '+';
+            }
+            moves.push_back(san);
+        }
+        return moves;
+    }
+    
+    vector<Move> get_all_valid_moves(const string& color) {
+        vector<Move> moves;
+        
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                char piece = board[i][j];
+                if (piece != ' ' && get_piece_color(piece) == color) {
+                    vector<Position> piece_moves = get_piece_moves(i, j);
+                    for (size_t k = 0; k < piece_moves.size(); k++) {
+                        Move move(i, j, piece_moves[k].row, piece_moves[k].col);
+                        SearchUndo undo = make_search_move(move);
+                        
+                        if (!is_in_check(color)) {
+                            moves.push_back(move);
+                        }
+                        
+                        unmake_search_move(move, undo);
+                    }
+                }
+            }
+        }
+        
+        return moves;
+    }
+    
+    bool is_checkmate(const string& color) {
+        if (!is_in_check(color)) return false;
+        return get_all_valid_moves(color).empty();
+    }
+    
+    bool is_stalemate(const string& color) {
+        if (is_in_check(color)) return false;
         return get_all_valid_moves(color).empty();
     }
     
-    bool is_stalemate(const string& color) {
-        if (is_in_check(color)) return false;
-        return get_all_valid_moves(color).empty();
+    int castling_rights() const {
+        return (white_can_castle_kingside ? 1 : 0) | (white_can_castle_queenside ? 2 : 0) |
+               (black_can_castle_kingside ? 4 : 0) | (black_can_castle_queenside ? 8 : 0);
+    }
+    
+    uint64_t compute_hash(bool white_to_move) const {
+        uint64_t key = piece_hash;
+        key ^= ZOBRIST.castling[castling_rights()];
+        if (en_passant_target.has_value()) key ^= ZOBRIST.en_passant[en_passant_target.col];
+        if (!white_to_move) key ^= ZOBRIST.black_to_move;
+        return key;
+    }
+    
+    // ============= ENHANCED EVALUATION FUNCTION =============
+    
+    const PawnEntry& probe_pawn_structure() {
+        PawnEntry& entry = PAWN_TABLE_CACHE.slot(pawn_hash);
+        pawn_probes++;
+        if (entry.key == pawn_hash) {
+            pawn_hits++;
+            return entry;
+        }
+        
+        evaluate_pawn_structure(piece_bb[0], piece_bb[6], entry);
+        entry.key = pawn_hash;
+        return entry;
+    }
+    
+    // Evaluates the position for a node searched with the given window.
+    // When the cheap tier (material + PST) is so far outside the window that
+    // the expensive terms cannot bring it back, it returns a bound instead
+    // of the exact score; such bounds are not cached.
+    int evaluate_board(int alpha = -99999, int beta = 99999) {
+        uint64_t key = piece_hash;
+        EvalCacheEntry& entry = EVAL_CACHE.slot(key);
+        if (entry.key == key) {
+            eval_cache_hits++;
+            return entry.score;
+        }
+        eval_cache_misses++;
+        
+        MaterialEntry overflow_entry;
+        const MaterialEntry& material = probe_material(overflow_entry);
+        if (material.flags & MATERIAL_DRAW) return 0;
+        if (material.evaluator == EVAL_KXK_WHITE) return evaluate_kxk(piece_bb, 0);
+        if (material.evaluator == EVAL_KXK_BLACK) return evaluate_kxk(piece_bb, 1);
+        
+        if (nnue_active()) {
+            entry.score = evaluate_nnue();
+            entry.key = key;
+            return entry.score;
+        }
+        
+        // Cheap tier: material, piece-square tables and imbalance
+        eval_cheap_tier++;
+        Score score = psq_score + material.imbalance;
+        int cheap = taper(score, material);
+        if (cheap + LAZY_EVAL_MARGIN <= alpha) return cheap + LAZY_EVAL_MARGIN;
+        if (cheap - LAZY_EVAL_MARGIN >= beta) return cheap - LAZY_EVAL_MARGIN;
+        
+        // Expensive tier
+        eval_full_tier++;
+        entry.score = taper(score + evaluate_expensive_terms(piece_bb, probe_pawn_structure()), material);
+        entry.key = key;
+        return entry.score;
+    }
+    
+    // One table load for the current material; promotions beyond the key's
+    // caps compute the entry into the caller's scratch entry instead.
+    const MaterialEntry& probe_material(MaterialEntry& scratch) const {
+        if (material_overflow == 0) return MATERIAL_TABLE[material_key];
+        
+        int counts[2][6];
+        for (int index = 0; index < 12; index++) {
+            counts[index / 6][index % 6] = popcount(piece_bb[index]);
+        }
+        scratch = compute_material_entry(counts);
+        return scratch;
+    }
+    
+    bool is_insufficient_material() const {
+        MaterialEntry scratch;
+        return (probe_material(scratch).flags & MATERIAL_DRAW) != 0;
+    }
+    
+    // ============= MINIMAX WITH ALPHA-BETA PRUNING =============
+    
+    void reset_search_stats() {
+        nodes_searched = 0;
+        tt_hits = 0;
+        pawn_probes = 0;
+        pawn_hits = 0;
+        eval_cache_hits = 0;
+        eval_cache_misses = 0;
+        eval_cheap_tier = 0;
+        eval_full_tier = 0;
+        tb_probes = 0;
+        tb_cache_hits = 0;
+    }
+    
+    string search_stats_summary() const {
+        ostringstream out;
+        out << fixed << setprecision(1);
+        out << "searched " << nodes_searched << " nodes, " << tt_hits << " TT hits, "
+            << "pawn hash " << (pawn_probes > 0 ? pawn_hits * 100.0 / pawn_probes : 0.0) << "% hits, "
+            << "eval cache " << eval_cache_hits << "/" << (eval_cache_hits + eval_cache_misses) << " hits, "
+            << "lazy exits " << (eval_cheap_tier - eval_full_tier) << "/" << eval_cheap_tier;
+        if (TABLEBASE.is_open()) {
+            out << ", endgame tables " << tb_probes << " probes (" << tb_cache_hits << " cached)";
+        }
+        return out.str();
+    }
+    
+    int piece_count() const {
+        int count = 0;
+        for (int i = 0; i < 12; i++) count += popcount(piece_bb[i]);
+        return count;
+    }
+    
+    // ============= SYZYGY TABLEBASE PROBING =============
+    
+    // A legal move as the tablebase probes need it, with the promotion and
+    // en passant captures the search's own moves leave out
+    struct TablebaseMove {
+        Move move;
+        char promotion;    // 'Q', 'R', 'B' or 'N', or ' '
+        bool en_passant;
+        bool capture;
+        bool pawn;
+        int next_ep;       // en passant square after a double push, or -1
+    };
+    
+    struct TablebaseUndo {
+        SearchUndo search;
+        char victim;       // the pawn taken en passant
+    };
+    
+    // Whether the loaded tables may cover the position: few enough men, no
+    // castling rights
+    bool tablebase_covers() const {
+        return TB_PROBE_LIMIT > 0 && TABLEBASE.is_open() && castling_rights() == 0 &&
+               piece_count() <= min(TB_PROBE_LIMIT, TABLEBASE.max_pieces());
+    }
+    
+    // The game's en passant square, as tablebase_moves takes it
+    int tablebase_ep() const {
+        return en_passant_target.has_value() ? en_passant_target.row * 8 + en_passant_target.col : -1;
+    }
+    
+    // Legal moves of a side on the bitboards, ep being the square a pawn
+    // may take en passant on, or -1. No castling: the probes refuse
+    // positions with castling rights.
+    void tablebase_moves(bool white, int ep, vector<TablebaseMove>& moves) const {
+        moves.clear();
+        int base = white ? 0 : 6;
+        uint64_t occupied = 0, own = 0;
+        for (int i = 0; i < 12; i++) occupied |= piece_bb[i];
+        for (int i = base; i < base + 6; i++) own |= piece_bb[i];
+        uint64_t enemy = occupied & ~own;
+        uint64_t ep_bb = ep >= 0 ? 1ULL << ep : 0;
+        
+        for (int type = 0; type < 6; type++) {
+            for (uint64_t b = piece_bb[base + type]; b; b &= b - 1) {
+                int from = lsb(b);
+                uint64_t from_bb = 1ULL << from;
+                uint64_t targets;
+                if (type == 0) {
+                    uint64_t push = (white ? from_bb >> 8 : from_bb << 8) & ~occupied;
+                    uint64_t double_push = 0;
+                    if (push && from / 8 == (white ? 6 : 1)) {
+                        double_push = (white ? push >> 8 : push << 8) & ~occupied;
+                    }
+                    uint64_t attacks = white ? white_pawn_attacks(from_bb) : black_pawn_attacks(from_bb);
+                    targets = push | double_push | (attacks & (enemy | ep_bb));
+                } else if (type == 1) {
+                    targets = ATTACKS.knight[from];
+                } else if (type == 2) {
+                    targets = bishop_attacks(from, occupied);
+                } else if (type == 3) {
+                    targets = rook_attacks(from, occupied);
+                } else if (type == 4) {
+                    targets = bishop_attacks(from, occupied) | rook_attacks(from, occupied);
+                } else {
+                    targets = ATTACKS.king[from];
+                }
+                
+                for (uint64_t t = targets & ~own; t; t &= t - 1) {
+                    int to = lsb(t);
+                    TablebaseMove move;
+                    move.move = Move(from / 8, from % 8, to / 8, to % 8);
+                    move.en_passant = type == 0 && to == ep;
+                    move.capture = (enemy & (1ULL << to)) || move.en_passant;
+                    move.pawn = type == 0;
+                    move.next_ep = (type == 0 && abs(to - from) == 16) ? (from + to) / 2 : -1;
+                    move.promotion = ' ';
+                    int lifted = move.en_passant ? (white ? to + 8 : to - 8) : -1;
+                    if (!move_keeps_king_safe(from, to, lifted, white, occupied)) continue;
+                    if (type == 0 && (to < 8 || to >= 56)) {
+                        for (const char* p = "QRBN"; *p; p++) {
+                            move.promotion = *p;
+                            moves.push_back(move);
+                        }
+                    } else {
+                        moves.push_back(move);
+                    }
+                }
+            }
+        }
+    }
+    
+    TablebaseUndo make_tablebase_move(const TablebaseMove& m) {
+        TablebaseUndo undo;
+        undo.search = make_search_move(m.move);
+        undo.victim = ' ';
+        bool white = undo.search.piece == 'P';
+        if (m.promotion != ' ') {
+            set_square(m.move.to_row, m.move.to_col, white ? m.promotion : char(tolower(m.promotion)));
+        }
+        if (m.en_passant) {
+            undo.victim = board[m.move.from_row][m.move.to_col];
+            set_square(m.move.from_row, m.move.to_col, ' ');
+        }
+        return undo;
+    }
+    
+    void unmake_tablebase_move(const TablebaseMove& m, const TablebaseUndo& undo) {
+        if (m.en_passant) set_square(m.move.from_row, m.move.to_col, undo.victim);
+        if (m.promotion != ' ') set_square(m.move.to_row, m.move.to_col, undo.search.piece);
+        unmake_search_move(m.move, undo.search);
+    }
+    
+    bool tablebase_mated(bool white, int ep) {
+        vector<TablebaseMove> moves;
+        tablebase_moves(white, ep, moves);
+        return moves.empty() && is_in_check(white ? "white" : "black");
+    }
+    
+    // Stored value of the position as it stands (see SyzygyTables::probe)
+    bool tablebase_table(bool white, bool dtz, int wdl, int& value, bool& other_side) const {
+        if (castling_rights() != 0 || ((piece_bb[0] | piece_bb[6]) & 0xFF000000000000FFULL)) return false;
+        return TABLEBASE.probe(piece_bb, white, dtz, wdl, value, other_side);
+    }
+    
+    // WDL for the side to move (white or not), ep as for tablebase_moves.
+    // The tables are only trusted where no capture is better: captures,
+    // and with check_zeroing pawn moves too, are played out first. state
+    // becomes TB_PROBE_ZEROING when the best move is one of those.
+    int tablebase_wdl_search(bool white, int ep, bool check_zeroing, TablebaseProbeState& state) {
+        vector<TablebaseMove> moves;
+        tablebase_moves(white, ep, moves);
+        int best = -2;
+        size_t searched = 0;
+        for (size_t i = 0; i < moves.size(); i++) {
+            if (!moves[i].capture && !(check_zeroing && moves[i].pawn)) continue;
+            searched++;
+            TablebaseUndo undo = make_tablebase_move(moves[i]);
+            int value = -tablebase_wdl_search(!white, moves[i].next_ep, false, state);
+            unmake_tablebase_move(moves[i], undo);
+            if (state == TB_PROBE_FAIL) return 0;
+            if (value > best) {
+                best = value;
+                if (value == 2) {
+                    state = TB_PROBE_ZEROING;
+                    return value;
+                }
+            }
+        }
+        
+        // With every move searched the table is not needed, and may be wrong
+        // (it knows nothing of en passant)
+        bool no_more_moves = searched > 0 && searched == moves.size();
+        int value = best;
+        bool other_side;
+        if (!no_more_moves && !tablebase_table(white, false, 0, value, other_side)) {
+            state = TB_PROBE_FAIL;
+            return 0;
+        }
+        if (best >= value) {
+            state = (best > 0 || no_more_moves) ? TB_PROBE_ZEROING : TB_PROBE_OK;
+            return best;
+        }
+        state = TB_PROBE_OK;
+        return value;
+    }
+    
+    // DTZ in plies for the side to move: positive when it wins, 0 for a
+    // draw. Where the table holds only the other side to move, this is the
+    // best of the moves one ply down.
+    int tablebase_dtz(bool white, int ep, TablebaseProbeState& state) {
+        state = TB_PROBE_OK;
+        int wdl = tablebase_wdl_search(white, ep, true, state);
+        if (state == TB_PROBE_FAIL || wdl == 0) return 0;
+        if (state == TB_PROBE_ZEROING) return dtz_before_zeroing(wdl);
+        
+        int dtz;
+        bool other_side;
+        if (!tablebase_table(white, true, wdl, dtz, other_side)) {
+            state = TB_PROBE_FAIL;
+            return 0;
+        }
+        if (!other_side) return (dtz + (wdl == 1 || wdl == -1 ? 100 : 0)) * (wdl > 0 ? 1 : -1);
+        
+        vector<TablebaseMove> moves;
+        tablebase_moves(white, ep, moves);
+        int min_dtz = numeric_limits<int>::max();
+        for (size_t i = 0; i < moves.size(); i++) {
+            bool zeroing = moves[i].capture || moves[i].pawn;
+            TablebaseUndo undo = make_tablebase_move(moves[i]);
+            // A zeroing move counts from before it: the position after only
+            // gives its sign
+            int value = zeroing ? -dtz_before_zeroing(tablebase_wdl_search(!white, moves[i].next_ep, false, state))
+                                : -tablebase_dtz(!white, moves[i].next_ep, state);
+            if (value == 1 && tablebase_mated(!white, moves[i].next_ep)) min_dtz = 1;
+            if (!zeroing) value += value > 0 ? 1 : value < 0 ? -1 : 0;
+            if (value < min_dtz && (value > 0) == (wdl > 0) && value != 0) min_dtz = value;
+            unmake_tablebase_move(moves[i], undo);
+            if (state == TB_PROBE_FAIL) return 0;
+        }
+        return min_dtz == numeric_limits<int>::max() ? -1 : min_dtz;
+    }
+    
+    // Score, from white's point of view, of a search position the loaded
+    // tables cover: TB_WIN for a win, 0 for a draw. The game has no
+    // fifty-move rule, so wins and losses it would spoil count in full.
+    // Search positions carry no en passant right.
+    bool probe_tablebase(bool white_to_move, int& score) {
+        uint64_t key = compute_hash(white_to_move);
+        TablebaseCacheEntry& entry = TB_CACHE.slot(key);
+        if (entry.key == key) {
+            tb_cache_hits++;
+        } else {
+            entry.key = key;
+            TablebaseProbeState state = TB_PROBE_OK;
+            int wdl = tablebase_wdl_search(white_to_move, -1, false, state);
+            entry.value = state == TB_PROBE_FAIL ? TB_NOT_COVERED : wdl;
+        }
+        if (entry.value == TB_NOT_COVERED) return false;
+        tb_probes++;
+        int value = entry.value > 0 ? TB_WIN : entry.value < 0 ? -TB_WIN : 0;
+        score = white_to_move ? value : -value;
+        return true;
+    }
+    
+    // The game move the tables rate best: a win by the fewest plies to the
+    // next capture or pawn move, a loss by the most, or else a draw. Fails
+    // without the DTZ tables, leaving the search to play on their WDL.
+    bool tablebase_move(Move& best, char& promotion) {
+        bool white = current_player == "white";
+        int ep = tablebase_ep();
+        vector<TablebaseMove> moves;
+        tablebase_moves(white, ep, moves);
+        
+        int best_rank = numeric_limits<int>::min();
+        for (size_t i = 0; i < moves.size(); i++) {
+            TablebaseProbeState state = TB_PROBE_OK;
+            TablebaseUndo undo = make_tablebase_move(moves[i]);
+            int dtz;
+            if (moves[i].capture || moves[i].pawn) {
+                dtz = dtz_before_zeroing(-tablebase_wdl_search(!white, moves[i].next_ep, false, state));
+            } else {
+                dtz = -tablebase_dtz(!white, moves[i].next_ep, state);
+                dtz += dtz > 0 ? 1 : dtz < 0 ? -1 : 0;
+            }
+            if (dtz == 2 && tablebase_mated(!white, moves[i].next_ep)) dtz = 1;
+            unmake_tablebase_move(moves[i], undo);
+            if (state == TB_PROBE_FAIL) return false;
+            
+            int rank = dtz > 0 ? 1000 - dtz : dtz < 0 ? -1000 - dtz : 0;
+            if (rank > best_rank) {
+                best_rank = rank;
+                best = moves[i].move;
+                promotion = moves[i].promotion == ' ' ? 'Q' : moves[i].promotion;
+            }
+        }
+        return !moves.empty();
+    }
+    
+    int minimax(int depth, int alpha, int beta, bool maximizing_player) {
+        nodes_searched++;
+        
+        string color = maximizing_player ? "white" : "black";
+        
+        // Positions the endgame tables cover score by their WDL, at any
+        // depth. Like the mate scores below, a win further from the root is
+        // worth less to the winner, so the search takes the shortest way
+        // into the table's win.
+        if (tablebase_covers()) {
+            int score;
+            if (probe_tablebase(maximizing_player, score)) {
+                int ply = 5 - depth;
+                if (score > 0) return score - ply;
+                if (score < 0) return score + ply;
+                return 0;
+            }
+        }
+        
+        if (depth == 0) {
+            return evaluate_board(alpha, beta);
+        }
+        
+        // Transposition table cutoff (scores are stored from white's point of view)
+        uint64_t key = compute_hash(maximizing_player);
+        int alpha_orig = alpha;
+        int beta_orig = beta;
+        int hash_from = 64, hash_to = 64;
+        TTProbe entry;
+        if (TT.probe(key, entry)) {
+            tt_hits++;
+            hash_from = entry.from_sq;
+            hash_to = entry.to_sq;
+            if (entry.depth >= depth) {
+                if (entry.flag == TT_EXACT) return entry.score;
+                if (entry.flag == TT_LOWER) alpha = max(alpha, entry.score);
+                else if (entry.flag == TT_UPPER) beta = min(beta, entry.score);
+                if (alpha >= beta) return entry.score;
+            }
+        }
+        
+        if (is_checkmate(color)) {
+            return maximizing_player ? -30000 + (5 - depth) * 100 : 30000 - (5 - depth) * 100;
+        }
+        
+        if (is_stalemate(color)) {
+            return 0;
+        }
+        
+        vector<Move> moves = get_all_valid_moves(color);
+        if (moves.empty()) return 0;
+        
+        // Search the hash move first
+        for (size_t i = 0; i < moves.size(); i++) {
+            if (moves[i].from_row * 8 + moves[i].from_col == hash_from &&
+                moves[i].to_row * 8 + moves[i].to_col == hash_to) {
+                swap(moves[0], moves[i]);
+                break;
+            }
+        }
+        
+        size_t best_index = 0;
+        int best_eval;
+        
+        if (maximizing_player) {
+            int max_eval = -99999;
+            for (size_t i = 0; i < moves.size(); i++) {
+                SearchUndo undo = make_search_move(moves[i]);
+                int eval = minimax(depth - 1, alpha, beta, false);
+                unmake_search_move(moves[i], undo);
+                
+                if (eval > max_eval) {
+                    max_eval = eval;
+                    best_index = i;
+                }
+                alpha = max(alpha, eval);
+                if (beta <= alpha) break;
+            }
+            best_eval = max_eval;
+        } else {
+            int min_eval = 99999;
+            for (size_t i = 0; i < moves.size(); i++) {
+                SearchUndo undo = make_search_move(moves[i]);
+                int eval = minimax(depth - 1, alpha, beta, true);
+                unmake_search_move(moves[i], undo);
+                
+                if (eval < min_eval) {
+                    min_eval = eval;
+                    best_index = i;
+                }
+                beta = min(beta, eval);
+                if (beta <= alpha) break;
+            }
+            best_eval = min_eval;
+        }
+        
+        int flag = TT_EXACT;
+        if (best_eval <= alpha_orig) flag = TT_UPPER;
+        else if (best_eval >= beta_orig) flag = TT_LOWER;
+        const Move& best = moves[best_index];
+        TT.store(key, best_eval, depth, flag, best.from_row * 8 + best.from_col, 
+                 best.to_row * 8 + best.to_col);
+        
+        return best_eval;
+    }
+    
+    static bool contains_move(const vector<Move>& moves, const Move& move) {
+        for (size_t i = 0; i < moves.size(); i++) {
+            if (moves[i].from_row == move.from_row && moves[i].from_col == move.from_col && 
+                moves[i].to_row == move.to_row && moves[i].to_col == move.to_col) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // The move to play and, for a pawn reaching the last rank, the piece it
+    // promotes to: the book's or the index's choice, otherwise a queen
+    Move get_ai_move(int difficulty, char& promotion) {
+        promotion = 'Q';
+        vector<Move> valid_moves = get_all_valid_moves(current_player);
+        
+        if (valid_moves.empty()) return Move();
+        
+        // Book positions early in the game play a weighted random book move
+        // without a search
+        if (difficulty > 1 && POLYGLOT_BOOK.is_open() && game_ply() < BOOK_DEPTH) {
+            uint16_t book_move = 0;
+            if (POLYGLOT_BOOK.pick(polyglot_key(), gen, book_move)) {
+                Move move = polyglot_move(book_move, promotion);
+                if (contains_move(valid_moves, move)) return move;
+            }
+        }
+        
+        // The learned book plays a move that scored in our own games
+        if (difficulty > 1 && LEARNED_BOOK.is_open()) {
+            uint16_t book_move = 0;
+            if (LEARNED_BOOK.pick(get_position_key(), current_player == "white", gen, book_move)) {
+                Move move = logged_move(book_move, promotion);
+                if (contains_move(valid_moves, move)) return move;
+            }
+        }
+        
+        // Positions in the loaded game index play their best scoring move
+        // without a search
+        if (difficulty > 1 && POSITION_INDEX.is_open()) {
+            uint16_t indexed = 0;
+            if (POSITION_INDEX.best_move(get_position_key(), current_player == "white", indexed)) {
+                Move move = logged_move(indexed, promotion);
+                if (contains_move(valid_moves, move)) return move;
+            }
+        }
+        promotion = 'Q';
+        
+        // Positions the endgame tables cover play their best move outright,
+        // by DTZ, so won endings are converted without the random pick below
+        if (difficulty > 1 && tablebase_covers()) {
+            Move move;
+            if (tablebase_move(move, promotion)) return move;
+            promotion = 'Q';
+        }
+        
+        if (difficulty == 1) {
+            uniform_int_distribution<int> dis(0, valid_moves.size() - 1);
+            return valid_moves[dis(gen)];
+        }
+        
+        // Determine search depth based on difficulty
+        int search_depth = (difficulty == 2) ? 2 : 3;
+        
+        reset_search_stats();
+        bool maximizing = (current_player == "white");
+        
+        vector<MoveScore> move_scores;
+        
+        for (size_t m = 0; m < valid_moves.size(); m++) {
+            Move move = valid_moves[m];
+            SearchUndo undo = make_search_move(move);
+            
+            int score = minimax(search_depth - 1, -99999, 99999, !maximizing);
+            
+            move_scores.push_back(MoveScore(move.from_row, move.from_col, 
+                                           move.to_row, move.to_col, 
+                                           maximizing ? score : -score));
+            
+            unmake_search_move(move, undo);
+        }
+        
+        sort(move_scores.begin(), move_scores.end(), compare_move_scores);
+        
+        MoveScore selected = move_scores[0];
+        
+        uniform_real_distribution<double> prob_dist(0.0, 1.0);
+        
+        if (difficulty == 2) {
+            if (prob_dist(gen) < 0.7) {
+                selected = move_scores[0];
+            } else {
+                int top_count = min(3, (int)move_scores.size());
+                uniform_int_distribution<int> dis(0, top_count - 1);
+                selected = move_scores[dis(gen)];
+            }
+        } else {
+            if (prob_dist(gen) < 0.95) {
+                selected = move_scores[0];
+            } else {
+                int top_count = min(2, (int)move_scores.size());
+                uniform_int_distribution<int> dis(0, top_count - 1);
+                selected = move_scores[dis(gen)];
+            }
+        }
+        
+        return Move(selected.from_row, selected.from_col, 
+                   selected.to_row, selected.to_col);
+    }
+    
+    bool play_ai_turn(const string& ai_name, int difficulty) {
+        cout << ai_name << " is thinking" << flush;
+        
+        int delay_ms = (difficulty == 1) ? 300 : ((difficulty == 2) ? 600 : 900);
+        
+        for (int i = 0; i < 3; i++) {
+            cout << "." << flush;
+            this_thread::sleep_for(chrono::milliseconds(delay_ms / 3));
+        }
+        cout << endl;
+        
+        char promotion;
+        Move move = get_ai_move(difficulty, promotion);
+        
+        if (move.has_value()) {
+            char piece = board[move.from_row][move.from_col];
+            
+            if (make_move(move.from_row, move.from_col, move.to_row, move.to_col, promotion)) {
+                string from_pos = string(1, char('a' + move.from_col)) + char('0' + (8 - move.from_row));
+                string to_pos = string(1, char('a' + move.to_col)) + char('0' + (8 - move.to_row));
+                cout << ai_name << " plays: " << get_piece_symbol(piece) << " " << from_pos << " → " << to_pos;
+                if (difficulty > 1) {
+                    cout << " (" << search_stats_summary() << ")";
+                }
+                cout << endl;
+                this_thread::sleep_for(chrono::milliseconds(500));
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    string get_difficulty_name(int diff) const {
+        if (diff == 1) return "Easy";
+        if (diff == 2) return "Medium";
+        return "Hard";
+    }
+    
+    string get_current_date() const {
+        time_t now = time(0);
+        tm* ltm = localtime(&now);
+        char buffer[20];
+        snprintf(buffer, sizeof(buffer), "%04d.%02d.%02d", 
+                1900 + ltm->tm_year, 1 + ltm->tm_mon, ltm->tm_mday);
+        return string(buffer);
+    }
+    
+    void generate_pgn() {
+        string pgn = "";
+        
+        pgn += "[Event \"AI vs AI Chess Match\"]\n";
+        pgn += "[Site \"C++ Chess Engine\"]\n";
+        pgn += "[Date \"" + get_current_date() + "\"]\n";
+        pgn += "[Round \"" + to_string(game_round > 0 ? game_round : total_games) + "\"]\n";
+        pgn += "[White \"AI " + get_difficulty_name(difficulty_ai1) + "\"]\n";
+        pgn += "[Black \"AI " + get_difficulty_name(difficulty_ai2) + "\"]\n";
+        
+        string result = "1-0";
+        if (winner == "black") result = "0-1";
+        else if (winner == "draw") result = "1/2-1/2";
+        
+        pgn += "[Result \"" + result + "\"]\n";
+        if (start_fen_length > 0) {
+            pgn += "[SetUp \"1\"]\n";
+            pgn += "[FEN \"" + string(start_fen, start_fen_length) + "\"]\n";
+        }
+        pgn += "[Engine \"" + string(ENGINE_VERSION) + "\"]\n";
+        if (seeded_game) {
+            pgn += "[Seed \"" + to_string(game_seed) + "\"]\n";
+        }
+        if (timed_game) {
+            char seconds[32];
+            snprintf(seconds, sizeof(seconds), "%.3f", game_seconds);
+            pgn += "[GameTime \"" + string(seconds) + "\"]\n";
+        }
+        pgn += "\n";
+        
+        // Games set up with black to move start with "N..."
+        vector<string> pgn_moves = render_san_moves();
+        size_t first_ply = start_white_to_move ? 0 : 1;
+        for (size_t i = 0; i < pgn_moves.size(); i++) {
+            size_t ply = i + first_ply;
+            if (ply % 2 == 0) {
+                pgn += to_string(start_fullmove + ply / 2) + ". ";
+            } else if (i == 0) {
+                pgn += to_string(start_fullmove) + "... ";
+            }
+            pgn += pgn_moves[i] + " ";
+            
+            if (i % 16 == 15) {
+                pgn += "\n";
+            }
+        }
+        
+        pgn += result + "\n";
+        
+        last_game_pgn = pgn;
+    }
+    
+    void save_pgn_to_file() {
+        if (get_last_game_pgn().empty()) {
+            cout << "No game to save!" << endl;
+            return;
+        }
+        
+        string filename = timestamped_filename("chess_game", ".pgn");
+        ofstream file(filename.c_str());
+        if (file.is_open()) {
+            file << last_game_pgn;
+            file.close();
+            cout << "\n✓ Game saved to: " << filename << endl;
+        } else {
+            cout << "\n✗ Error saving file!" << endl;
+        }
+    }
+    
+    void show_last_game_pgn() {
+        if (get_last_game_pgn().empty()) {
+            cout << "No game to display!" << endl;
+            return;
+        }
+        
+        cout << "\n" << string(60, '=') << endl;
+        cout << "LAST GAME PGN:" << endl;
+        cout << string(60, '=') << endl;
+        cout << last_game_pgn << endl;
+        cout << string(60, '=') << endl;
+    }
+    
+    void reset_game() {
+        board = init_board();
+        refresh_incremental_state();
+        current_player = "white";
+        move_log.clear();
+        captured_pieces["white"].clear();
+        captured_pieces["black"].clear();
+        winner = "";
+        white_king_pos = Position(7, 4);
+        black_king_pos = Position(0, 4);
+        white_can_castle_kingside = true;
+        white_can_castle_queenside = true;
+        black_can_castle_kingside = true;
+        black_can_castle_queenside = true;
+        en_passant_target = Position();
+        halfmove_clock = 0;
+        fullmove_number = 1;
+        start_fen_length = 0;
+        start_fullmove = 1;
+        start_white_to_move = true;
+        seeded_game = false;
+        timed_game = false;
+        game_round = 0;
+        last_game_pgn.clear();   // a finished game's PGN is only kept until the next one starts
+        pgn_pending = false;
+    }
+    
+    // Sets up a position from a FEN record or an EPD line (whose clocks are
+    // optional; operations after the four position fields are ignored).
+    // Parses straight from the view without allocating, and leaves the
+    // current game untouched if the record is invalid.
+    bool load_fen(string_view record) {
+        size_t pos = 0;
+        char squares[64];
+        if (!parse_fen_board(next_fen_field(record, pos), squares)) return false;
+        
+        string_view side = next_fen_field(record, pos);
+        if (side != "w" && side != "b") return false;
+        
+        string_view castling = next_fen_field(record, pos);
+        bool rights[4] = { false, false, false, false };   // K, Q, k, q
+        if (castling != "-") {
+            if (castling.empty()) return false;
+            for (size_t i = 0; i < castling.size(); i++) {
+                const char* flag = strchr("KQkq", castling[i]);
+                if (!flag || castling[i] == '\0') return false;
+                rights[flag - "KQkq"] = true;
+            }
+        }
+        
+        string_view ep = next_fen_field(record, pos);
+        Position ep_target;
+        if (ep != "-") {
+            if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' || (ep[1] != '3' && ep[1] != '6')) {
+                return false;
+            }
+            ep_target = Position(8 - (ep[1] - '0'), ep[0] - 'a');
+        }
+        
+        // Clocks are optional in EPD; anything else there is an operation
+        int halfmove = 0;
+        int fullmove = 1;
+        if (parse_fen_number(next_fen_field(record, pos), halfmove)) {
+            if (!parse_fen_number(next_fen_field(record, pos), fullmove) || fullmove == 0) {
+                fullmove = 1;
+            }
+        } else {
+            halfmove = 0;
+        }
+        
+        memset(piece_bb, 0, sizeof(piece_bb));
+        for (int sq = 0; sq < 64; sq++) {
+            char piece = squares[sq];
+            board[sq / 8][sq % 8] = piece;
+            int index = piece_index(piece);
+            if (index >= 0) piece_bb[index] |= 1ULL << sq;
+        }
+        white_king_pos = Position(lsb(piece_bb[5]) / 8, lsb(piece_bb[5]) % 8);
+        black_king_pos = Position(lsb(piece_bb[11]) / 8, lsb(piece_bb[11]) % 8);
+        refresh_from_bitboards();
+        
+        // Rights whose king or rook has left its square cannot be used
+        bool white_king_home = board[7][4] == 'K';
+        bool black_king_home = board[0][4] == 'k';
+        white_can_castle_kingside = rights[0] && white_king_home && board[7][7] == 'R';
+        white_can_castle_queenside = rights[1] && white_king_home && board[7][0] == 'R';
+        black_can_castle_kingside = rights[2] && black_king_home && board[0][7] == 'r';
+        black_can_castle_queenside = rights[3] && black_king_home && board[0][0] == 'r';
+        en_passant_target = ep_target;
+        current_player = (side == "w") ? "white" : "black";
+        halfmove_clock = halfmove;
+        fullmove_number = fullmove;
+        
+        move_log.clear();
+        captured_pieces["white"].clear();
+        captured_pieces["black"].clear();
+        winner = "";
+        headless_move_count = 0;
+        
+        start_fen_length = write_fen(start_fen);
+        start_fullmove = fullmove_number;
+        start_white_to_move = (current_player == "white");
+        if (string_view(start_fen, start_fen_length) == STANDARD_START_FEN) start_fen_length = 0;
+        return true;
+    }
+    
+    // Writes the position as a FEN record into out (at least FEN_BUFFER_SIZE
+    // bytes, NUL-terminated) and returns its length
+    size_t write_fen(char* out) const {
+        size_t n = 0;
+        for (int row = 0; row < 8; row++) {
+            int empty = 0;
+            for (int col = 0; col < 8; col++) {
+                char piece = board[row][col];
+                if (piece == ' ') {
+                    empty++;
+                    continue;
+                }
+                if (empty) out[n++] = (char)('0' + empty);
+                empty = 0;
+                out[n++] = piece;
+            }
+            if (empty) out[n++] = (char)('0' + empty);
+            if (row < 7) out[n++] = '/';
+        }
+        
+        out[n++] = ' ';
+        out[n++] = (current_player == "white") ? 'w' : 'b';
+        out[n++] = ' ';
+        size_t castling_start = n;
+        if (white_can_castle_kingside) out[n++] = 'K';
+        if (white_can_castle_queenside) out[n++] = 'Q';
+        if (black_can_castle_kingside) out[n++] = 'k';
+        if (black_can_castle_queenside) out[n++] = 'q';
+        if (n == castling_start) out[n++] = '-';
+        out[n++] = ' ';
+        if (en_passant_target.has_value()) {
+            out[n++] = (char)('a' + en_passant_target.col);
+            out[n++] = (char)('0' + 8 - en_passant_target.row);
+        } else {
+            out[n++] = '-';
+        }
+        n = append_fen_number(out, n, halfmove_clock);
+        n = append_fen_number(out, n, fullmove_number);
+        out[n] = '\0';
+        return n;
+    }
+    
+    string to_fen() const {
+        char buffer[FEN_BUFFER_SIZE];
+        return string(buffer, write_fen(buffer));
+    }
+    
+    // Resolves a SAN move ("Nbd7", "exd8=Q+", "O-O") for the side to move
+    // against the legal moves of the pieces it can name. Fails unless
+    // exactly one legal move matches.
+    bool find_san_move(string_view san, Move& result, char& promotion) {
+        while (!san.empty() && string_view("+#!?").find(san.back()) != string_view::npos) {
+            san.remove_suffix(1);
+        }
+        promotion = 'Q';
+        bool white = (current_player == "white");
+        int home_row = white ? 7 : 0;
+        
+        if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+            int to_col = (san.size() == 3) ? 6 : 2;
+            Position king = white ? white_king_pos : black_king_pos;
+            if (king.row != home_row || king.col != 4) return false;
+            vector<Move> moves = get_all_valid_moves(current_player);
+            for (size_t i = 0; i < moves.size(); i++) {
+                if (moves[i].from_row == home_row && moves[i].from_col == 4 && 
+                    moves[i].to_row == home_row && moves[i].to_col == to_col) {
+                    result = moves[i];
+                    return true;
+                }
+            }
+            return false;
+        }
+        
+        char piece_type = 'P';
+        if (!san.empty() && string_view("NBRQK").find(san[0]) != string_view::npos) {
+            piece_type = san[0];
+            san.remove_prefix(1);
+        }
+        if (piece_type == 'P' && san.size() >= 2 && 
+            string_view("QRBN").find(san.back()) != string_view::npos) {
+            promotion = san.back();
+            san.remove_suffix(1);
+            if (san.back() == '=') san.remove_suffix(1);
+        }
+        if (san.size() < 2) return false;
+        
+        char file = san[san.size() - 2];
+        char rank = san[san.size() - 1];
+        if (file < 'a' || file > 'h' || rank < '1' || rank > '8') return false;
+        int to_row = '8' - rank;
+        int to_col = file - 'a';
+        san.remove_suffix(2);
+        bool capture_marked = !san.empty() && san.back() == 'x';
+        if (capture_marked) san.remove_suffix(1);
+        
+        int from_col = -1;
+        int from_row = -1;
+        for (size_t i = 0; i < san.size(); i++) {
+            if (san[i] >= 'a' && san[i] <= 'h') from_col = san[i] - 'a';
+            else if (san[i] >= '1' && san[i] <= '8') from_row = '8' - san[i];
+            else return false;
+        }
+        
+        char piece = white ? piece_type : char(tolower(static_cast<unsigned char>(piece_type)));
+        char captured = board[to_row][to_col];
+        if (captured != ' ' && get_piece_color(captured) == current_player) return false;
+        
+        // Pieces that could reach the target: those of the type standing on
+        // a square the same piece would attack from the target
+        int to = to_row * 8 + to_col;
+        uint64_t occupied = 0;
+        for (int i = 0; i < 12; i++) occupied |= piece_bb[i];
+        uint64_t candidates = piece_bb[piece_index(piece)];
+        if (piece_type == 'N') candidates &= ATTACKS.knight[to];
+        else if (piece_type == 'B') candidates &= bishop_attacks(to, occupied);
+        else if (piece_type == 'R') candidates &= rook_attacks(to, occupied);
+        else if (piece_type == 'Q') candidates &= bishop_attacks(to, occupied) | rook_attacks(to, occupied);
+        else if (piece_type == 'K') candidates &= ATTACKS.king[to];
+        
+        bool en_passant = false;
+        if (piece_type == 'P') {
+            // A pawn captures only when the SAN says so, with an 'x' or a
+            // source file other than the target's: "d5" never means "cxd5"
+            uint64_t target = 1ULL << to;
+            uint64_t sources = 0;
+            bool capture = capture_marked || (from_col >= 0 && from_col != to_col);
+            en_passant = capture && en_passant_target.has_value() && 
+                         en_passant_target.row == to_row && en_passant_target.col == to_col;
+            if (capture) {
+                if (captured != ' ' || en_passant) {
+                    sources = white ? black_pawn_attacks(target) : white_pawn_attacks(target);
+                }
+            } else if (captured == ' ') {
+                // Pushes come from one square behind, or two from the home
+                // rank over an empty square
+                uint64_t single = white ? target << 8 : target >> 8;
+                sources = single;
+                if (!(single & occupied) && to_row == (white ? 4 : 3)) {
+                    sources |= white ? target << 16 : target >> 16;
+                }
+            }
+            candidates &= sources;
+        }
+        // An en passant capture also lifts the pawn beside the target,
+        // which can open a line to the king
+        int lifted = en_passant ? (white ? to + 8 : to - 8) : -1;
+        
+        int matches = 0;
+        for (uint64_t b = candidates; b; b &= b - 1) {
+            int i = lsb(b) / 8;
+            int j = lsb(b) % 8;
+            if ((from_row >= 0 && i != from_row) || (from_col >= 0 && j != from_col)) continue;
+            if (move_keeps_king_safe(lsb(b), to, lifted, white, occupied)) {
+                result = Move(i, j, to_row, to_col);
+                matches++;
+            }
+        }
+        return matches == 1;
+    }
+    
+    // Whether the king of the side moving (white or not) is safe once its
+    // piece on from has moved to to, with the man on lifted (an en passant
+    // victim, or -1) also gone. Tested on the bitboards without making the
+    // move: the captured men are masked out of the attackers, and slider
+    // rays are only traced when a slider stands on one of the king's lines.
+    bool move_keeps_king_safe(int from, int to, int lifted, bool white, uint64_t occupied) const {
+        int own_king = white ? 5 : 11;
+        if (!piece_bb[own_king]) return true;
+        int king = (piece_bb[own_king] & (1ULL << from)) ? to : lsb(piece_bb[own_king]);
+        
+        uint64_t removed = (1ULL << to) | (lifted >= 0 ? 1ULL << lifted : 0);
+        occupied = (occupied & ~(1ULL << from) & ~removed) | (1ULL << to);
+        
+        int base = white ? 6 : 0;
+        uint64_t target = 1ULL << king;
+        uint64_t pawn_sources = white ? white_pawn_attacks(target) : black_pawn_attacks(target);
+        uint64_t leapers = (pawn_sources & piece_bb[base]) | (ATTACKS.knight[king] & piece_bb[base + 1]) | 
+                           (ATTACKS.king[king] & piece_bb[base + 5]);
+        if (leapers & ~removed) return false;
+        
+        uint64_t queens = piece_bb[base + 4];
+        uint64_t diagonal = (piece_bb[base + 2] | queens) & ~removed;
+        uint64_t straight = (piece_bb[base + 3] | queens) & ~removed;
+        uint64_t diagonal_lines = ATTACKS.rays[2][king] | ATTACKS.rays[3][king] | 
+                                  ATTACKS.rays[6][king] | ATTACKS.rays[7][king];
+        uint64_t straight_lines = ATTACKS.rays[0][king] | ATTACKS.rays[1][king] | 
+                                  ATTACKS.rays[4][king] | ATTACKS.rays[5][king];
+        if ((diagonal & diagonal_lines) && (bishop_attacks(king, occupied) & diagonal)) return false;
+        return !((straight & straight_lines) && (rook_attacks(king, occupied) & straight));
+    }
+    
+    // Plays a SAN move for the side to move and passes the turn
+    bool play_san(string_view san) {
+        Move move;
+        char promotion;
+        if (!find_san_move(san, move, promotion)) return false;
+        play_legal_move(move, promotion);
+        return true;
+    }
+    
+    // Makes a move for the side to move and passes the turn
+    bool play_move(const Move& move, char promotion) {
+        if (!make_move(move.from_row, move.from_col, move.to_row, move.to_col, promotion)) return false;
+        current_player = (current_player == "white") ? "black" : "white";
+        return true;
+    }
+    
+    uint64_t get_position_key() const {
+        return compute_hash(current_player == "white");
+    }
+    
+    // Plies since the start of the game, counted from the move numbers so
+    // games set up from a FEN count their earlier moves too
+    int game_ply() const {
+        return (fullmove_number - 1) * 2 + (current_player == "white" ? 0 : 1);
+    }
+    
+    // Polyglot key of the position. En passant only counts when a pawn of
+    // the side to move stands ready to capture.
+    uint64_t polyglot_key() const {
+        uint64_t key = 0;
+        for (int row = 0; row < 8; row++) {
+            for (int col = 0; col < 8; col++) {
+                int index = piece_index(board[row][col]);
+                if (index < 0) continue;
+                int kind = 2 * (index % 6) + (index < 6 ? 1 : 0);
+                key ^= POLYGLOT_RANDOM64[64 * kind + 8 * (7 - row) + col];
+            }
+        }
+        
+        if (white_can_castle_kingside) key ^= POLYGLOT_RANDOM64[POLYGLOT_CASTLE_OFFSET];
+        if (white_can_castle_queenside) key ^= POLYGLOT_RANDOM64[POLYGLOT_CASTLE_OFFSET + 1];
+        if (black_can_castle_kingside) key ^= POLYGLOT_RANDOM64[POLYGLOT_CASTLE_OFFSET + 2];
+        if (black_can_castle_queenside) key ^= POLYGLOT_RANDOM64[POLYGLOT_CASTLE_OFFSET + 3];
+        
+        bool white = (current_player == "white");
+        if (en_passant_target.has_value()) {
+            int row = white ? 3 : 4;
+            char pawn = white ? 'P' : 'p';
+            int col = en_passant_target.col;
+            if ((col > 0 && board[row][col - 1] == pawn) || (col < 7 && board[row][col + 1] == pawn)) {
+                key ^= POLYGLOT_RANDOM64[POLYGLOT_EN_PASSANT_OFFSET + col];
+            }
+        }
+        
+        if (white) key ^= POLYGLOT_RANDOM64[POLYGLOT_TURN_OFFSET];
+        return key;
+    }
+    
+    // Decodes a Polyglot move, whose castling moves are written as the king
+    // taking its own rook
+    Move polyglot_move(uint16_t encoded, char& promotion) const {
+        int to_col = encoded & 7;
+        int to_row = 7 - ((encoded >> 3) & 7);
+        int from_col = (encoded >> 6) & 7;
+        int from_row = 7 - ((encoded >> 9) & 7);
+        int promoted = (encoded >> 12) & 7;
+        promotion = (promoted >= 1 && promoted <= 4) ? "NBRQ"[promoted - 1] : 'Q';
+        
+        char piece = board[from_row][from_col];
+        if ((piece == 'K' || piece == 'k') && from_col == 4 && to_row == from_row) {
+            if (to_col == 7) to_col = 6;
+            else if (to_col == 0) to_col = 2;
+        }
+        return Move(from_row, from_col, to_row, to_col);
+    }
+    
+    // Key ordering the legal moves in game records:
+    // (from square * 64 + to square) * 4 + promotion index into "QRBN"
+    int move_key(const Move& move, char promotion) const {
+        int key = ((move.from_row * 8 + move.from_col) * 64 + move.to_row * 8 + move.to_col) * 4;
+        char piece = board[move.from_row][move.from_col];
+        if (toupper(static_cast<unsigned char>(piece)) == 'P' && (move.to_row == 0 || move.to_row == 7)) {
+            key += (int)(strchr(GAME_RECORD_PROMOTIONS, promotion) - GAME_RECORD_PROMOTIONS);
+        }
+        return key;
+    }
+    
+    // Legal move keys for the side to move, ascending; each promotion
+    // appears once per piece it can become
+    void get_sorted_move_keys(vector<int>& keys) {
+        keys.clear();
+        vector<Move> moves = get_all_valid_moves(current_player);
+        for (size_t i = 0; i < moves.size(); i++) {
+            int key = move_key(moves[i], 'Q');
+            char piece = board[moves[i].from_row][moves[i].from_col];
+            bool promotes = toupper(static_cast<unsigned char>(piece)) == 'P' && 
+                            (moves[i].to_row == 0 || moves[i].to_row == 7);
+            for (int p = 0; p < (promotes ? 4 : 1); p++) {
+                keys.push_back(key + p);
+            }
+        }
+        sort(keys.begin(), keys.end());
+    }
+    
+    // The move a game record byte stands for in the current position; keys
+    // is scratch space for the sorted move list
+    bool find_record_move(uint8_t index, vector<int>& keys, Move& move, char& promotion) {
+        get_sorted_move_keys(keys);
+        if (index >= keys.size()) return false;
+        int key = keys[index];
+        int from = key / 256;
+        int to = (key / 4) % 64;
+        move = Move(from / 8, from % 8, to / 8, to % 8);
+        promotion = GAME_RECORD_PROMOTIONS[key % 4];
+        return true;
+    }
+    
+    // Encodes the finished game. Fails for games set up from a FEN, and for
+    // a move the legal move list does not contain.
+    bool encode_game_record(GameRecord& record) const {
+        if (start_fen_length > 0 || move_log.size() > 0xFFFF) return false;
+        
+        record.result = (winner == "white") ? RECORD_WHITE_WINS : 
+                        (winner == "black") ? RECORD_BLACK_WINS : RECORD_DRAW;
+        record.white_difficulty = (uint8_t)difficulty_ai1;
+        record.black_difficulty = (uint8_t)difficulty_ai2;
+        record.seed = game_seed;
+        record.moves.clear();
+        
+        Chess replay;
+        vector<int> keys;
+        for (size_t i = 0; i < move_log.size(); i++) {
+            char promotion;
+            Move move = logged_move(move_log[i], promotion);
+            replay.get_sorted_move_keys(keys);
+            vector<int>::iterator it = lower_bound(keys.begin(), keys.end(), 
+                                                   replay.move_key(move, promotion));
+            if (it == keys.end() || *it != replay.move_key(move, promotion)) return false;
+            record.moves.push_back((uint8_t)(it - keys.begin()));
+            
+            replay.play_move(move, promotion);
+        }
+        return true;
+    }
+    
+    // Replays a game record from the standard position and records its
+    // result, leaving its PGN in get_last_game_pgn()
+    bool load_game_record(const GameRecord& record) {
+        reset_game();
+        difficulty_ai1 = record.white_difficulty;
+        difficulty_ai2 = record.black_difficulty;
+        game_seed = record.seed;
+        seeded_game = true;
+        
+        vector<int> keys;
+        for (size_t i = 0; i < record.moves.size(); i++) {
+            Move move;
+            char promotion;
+            if (!find_record_move(record.moves[i], keys, move, promotion) || 
+                !play_move(move, promotion)) {
+                return false;
+            }
+        }
+        
+        headless_move_count = (int)record.moves.size();
+        winner = (record.result == RECORD_WHITE_WINS) ? "white" : 
+                 (record.result == RECORD_BLACK_WINS) ? "black" : "draw";
+        record_game_result();
+        return true;
+    }
+    
+    // Sets winner if the side to move is checkmated or stalemated, or if the
+    // move cap was reached. Returns true once the game is over.
+    bool check_game_over(int move_count) {
+        if (move_count >= MAX_GAME_MOVES) {
+            winner = "draw";
+            return true;
+        }
+        
+        if (is_checkmate(current_player)) {
+            winner = (current_player == "white") ? "black" : "white";
+            return true;
+        }
+        
+        if (is_stalemate(current_player)) {
+            winner = "draw";
+            return true;
+        }
+        
+        if (is_insufficient_material()) {
+            winner = "draw";
+            return true;
+        }
+        
+        return false;
+    }
+    
+    void record_game_result() {
+        if (winner == "white") {
+            white_wins++;
+        } else if (winner == "black") {
+            black_wins++;
+        } else {
+            draws++;
+        }
+        total_games++;
+        
+        // Rendered on first use: headless games rarely need their PGN
+        pgn_pending = true;
+    }
+    
+    void play_ai_vs_ai() {
+        reset_game();
+        
+        cout << "\n=== AI vs AI Chess Match ===" << endl;
+        cout << "White AI: " << get_difficulty_name(difficulty_ai1) << endl;
+        cout << "Black AI: " << get_difficulty_name(difficulty_ai2) << endl;
+        cout << "Starting in 2 seconds...\n" << endl;
+        this_thread::sleep_for(chrono::seconds(2));
+        
+        int move_count = 0;
+        
+        while (true) {
+            display_board();
+            
+            if (check_game_over(move_count)) {
+                break;
+            }
+            
+            string ai_name = (current_player == "white") ? 
+                "White AI (" + get_difficulty_name(difficulty_ai1) + ")" :
+                "Black AI (" + get_difficulty_name(difficulty_ai2) + ")";
+            int ai_diff = (current_player == "white") ? difficulty_ai1 : difficulty_ai2;
+            
+            if (!play_ai_turn(ai_name, ai_diff)) {
+                winner = "draw";
+                break;
+            }
+            
+            current_player = (current_player == "white") ? "black" : "white";
+            move_count++;
+        }
+        
+        display_board();
+        
+        cout << "\n" << string(50, '=') << endl;
+        if (winner == "white") {
+            cout << "   CHECKMATE! White AI Wins! ♔" << endl;
+        } else if (winner == "black") {
+            cout << "   CHECKMATE! Black AI Wins! ♚" << endl;
+        } else {
+            cout << "   DRAW! ½-½" << endl;
+        }
+        cout << string(50, '=') << "\n" << endl;
+        
+        record_game_result();
+        
+        show_statistics();
+    }
+    
+    // ============= HEADLESS GAME STEPPING =============
+    
+    // Plays a space-separated list of coordinate moves ("e2e4 e7e5") from the
+    // current position. Returns false if any of them is illegal.
+    bool apply_opening(const string& opening) {
+        istringstream in(opening);
+        string token;
+        while (in >> token) {
+            if (token.size() != 4) return false;
+            int from_col = token[0] - 'a';
+            int from_row = 8 - (token[1] - '0');
+            int to_col = token[2] - 'a';
+            int to_row = 8 - (token[3] - '0');
+            if (!is_valid_position(from_row, from_col) || !is_valid_position(to_row, to_col)) {
+                return false;
+            }
+            if (!make_move(from_row, from_col, to_row, to_col)) return false;
+            
+            current_player = (current_player == "white") ? "black" : "white";
+            headless_move_count++;
+        }
+        return true;
+    }
+    
+    bool start_headless_game(int white_difficulty, int black_difficulty, unsigned int seed,
+                             const string& opening = "") {
+        reset_game();
+        difficulty_ai1 = white_difficulty;
+        difficulty_ai2 = black_difficulty;
+        gen.seed(seed);
+        game_seed = seed;
+        seeded_game = true;
+        game_seconds = 0.0;
+        timed_game = true;
+        headless_move_count = 0;
+        return apply_opening(opening);
+    }
+    
+    // Plays one move of a headless game, with no display or artificial delays.
+    // Returns false once the game has finished and its result was recorded.
+    bool step_headless_game() {
+        if (check_game_over(headless_move_count)) {
+            record_game_result();
+            return false;
+        }
+        
+        int ai_diff = (current_player == "white") ? difficulty_ai1 : difficulty_ai2;
+        chrono::steady_clock::time_point move_start = chrono::steady_clock::now();
+        char promotion;
+        Move move = get_ai_move(ai_diff, promotion);
+        bool played = move.has_value() && 
+                      make_move(move.from_row, move.from_col, move.to_row, move.to_col, promotion);
+        game_seconds += chrono::duration<double>(chrono::steady_clock::now() - move_start).count();
+        if (!played) {
+            winner = "draw";
+            record_game_result();
+            return false;
+        }
+        
+        current_player = (current_player == "white") ? "black" : "white";
+        headless_move_count++;
+        return true;
+    }
+    
+    // Plays up to plies random legal moves, e.g. to sample test positions
+    void play_random_moves(int plies) {
+        for (int i = 0; i < plies; i++) {
+            char promotion;
+            Move move = get_ai_move(1, promotion);
+            if (!move.has_value() || 
+                !make_move(move.from_row, move.from_col, move.to_row, move.to_col, promotion)) {
+                break;
+            }
+            current_player = (current_player == "white") ? "black" : "white";
+        }
+    }
+    
+    void fill_piece_codes(uint8_t codes[64]) const {
+        for (int sq = 0; sq < 64; sq++) {
+            codes[sq] = (uint8_t)(piece_index(board[sq / 8][sq % 8]) + 1);
+        }
+    }
+    
+    Score get_psq_score() const { return psq_score; }
+    
+    void get_piece_bitboards(uint64_t bb[12]) const {
+        memcpy(bb, piece_bb, sizeof(piece_bb));
+    }
+    
+    const string& get_winner() const { return winner; }
+    const string& get_last_game_pgn() {
+        if (pgn_pending) {
+            generate_pgn();
+            pgn_pending = false;
+        }
+        return last_game_pgn;
+    }
+    int get_headless_move_count() const { return headless_move_count; }
+    void set_round(int round) { game_round = round; }
+    
+    void show_statistics() const {
+        cout << "\n=== Game Statistics ===" << endl;
+        cout << "White AI Wins: " << white_wins << " ♔" << endl;
+        cout << "Black AI Wins: " << black_wins << " ♚" << endl;
+        cout << "Draws: " << draws << endl;
+        cout << "Total Games: " << total_games << endl;
+        
+        if (total_games > 0) {
+            cout << fixed << setprecision(1);
+            cout << "\nWhite Win Rate: " << (white_wins * 100.0 / total_games) << "%" << endl;
+            cout << "Black Win Rate: " << (black_wins * 100.0 / total_games) << "%" << endl;
+            cout << "Draw Rate: " << (draws * 100.0 / total_games) << "%" << endl;
+        }
+        cout << string(23, '=') << "\n" << endl;
+    }
+    
+    void show_menu() const {
+        cout << "\n" << string(50, '=') << endl;
+        cout << "         ♔ ENHANCED CHESS AI vs AI ♚" << endl;
+        cout << string(50, '=') << endl;
+        cout << "1. Watch AI vs AI" << endl;
+        cout << "2. Set White AI Difficulty (Current: " << get_difficulty_name(difficulty_ai1) << ")" << endl;
+        cout << "3. Set Black AI Difficulty (Current: " << get_difficulty_name(difficulty_ai2) << ")" << endl;
+        cout << "4. Show Statistics" << endl;
+        cout << "5. View Last Game PGN" << endl;
+        cout << "6. Save Last Game to File" << endl;
+        cout << "7. Reset Statistics" << endl;
+        cout << "8. Run Headless Tournament" << endl;
+        cout << "9. Exit" << endl;
+        cout << string(50, '=') << endl;
+        cout << "Enter your choice: ";
+    }
+    
+    void run() {
+        bool running = true;
+        
+        while (running) {
+            show_menu();
+            
+            int choice;
+            if (!(cin >> choice)) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid choice. Please try again." << endl;
+                this_thread::sleep_for(chrono::seconds(1));
+                continue;
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            
+            switch (choice) {
+                case 1:
+                    play_ai_vs_ai();
+                    cout << "\nPress Enter to continue...";
+                    cin.get();
+                    break;
+                    
+                case 2: {
+                    int diff;
+                    cout << "Enter difficulty (1=Easy, 2=Medium, 3=Hard): ";
+                    if (cin >> diff) {
+                        difficulty_ai1 = max(1, min(3, diff));
+                        cout << "White AI difficulty set to " << get_difficulty_name(difficulty_ai1) << endl;
+                    } else {
+                        cin.clear();
+                        cout << "Invalid input." << endl;
+                    }
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    this_thread::sleep_for(chrono::seconds(1));
+                    break;
+                }
+                    
+                case 3: {
+                    int diff;
+                    cout << "Enter difficulty (1=Easy, 2=Medium, 3=Hard): ";
+                    if (cin >> diff) {
+                        difficulty_ai2 = max(1, min(3, diff));
+                        cout << "Black AI difficulty set to " << get_difficulty_name(difficulty_ai2) << endl;
+                    } else {
+                        cin.clear();
+                        cout << "Invalid input." << endl;
+                    }
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    this_thread::sleep_for(chrono::seconds(1));
+                    break;
+                }
+                    
+                case 4:
+                    show_statistics();
+                    cout << "\nPress Enter to continue...";
+                    cin.get();
+                    break;
+                    
+                case 5:
+                    show_last_game_pgn();
+                    cout << "\nPress Enter to continue...";
+                    cin.get();
+                    break;
+                    
+                case 6:
+                    save_pgn_to_file();
+                    this_thread::sleep_for(chrono::seconds(2));
+                    break;
+                    
+                case 7:
+                    white_wins = 0;
+                    black_wins = 0;
+                    draws = 0;
+                    total_games = 0;
+                    cout << "Statistics reset!" << endl;
+                    this_thread::sleep_for(chrono::seconds(1));
+                    break;
+                    
+                case 8:
+                    run_headless_tournament(difficulty_ai1, difficulty_ai2);
+                    cout << "\nPress Enter to continue...";
+                    cin.get();
+                    break;
+                
+                case 9:
+                    running = false;
+                    cout << "\nThanks for watching! ♟" << endl;
+                    break;
+                    
+                default:
+                    cout << "Invalid choice. Please try again." << endl;
+                    this_thread::sleep_for(chrono::seconds(1));
+            }
+        }
+    }
+};
+
+// ============= BOOK LEARNING =============
+
+// Games merged into a learned book at a time by BookLearner
+const size_t BOOK_LEARN_BATCH = 256;
+
+// Writes learned book entries, which must come in key and move order, to a
+// ".part" file that close() renames over the book. Statistics for the same
+// move are summed; moves played in fewer than min_games games are written
+// too, but not counted as playable.
+struct LearnedBookWriter {
+    ofstream out;
+    string path;
+    LearnedBookHeader header;
+    LearnedBookEntry entry;
+    bool have_entry;
+    
+    LearnedBookWriter() : have_entry(false) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, LEARNED_BOOK_MAGIC, sizeof(header.magic));
+    }
+    
+    bool open(const string& book_path, uint32_t min_games, uint32_t max_plies) {
+        path = book_path;
+        header.min_games = min_games;
+        header.max_plies = max_plies;
+        out.open((path + ".part").c_str(), ios::binary);
+        out.write((const char*)&header, sizeof(header));   // rewritten by close()
+        return !out.fail();
+    }
+    
+    void finish_entry() {
+        if (have_entry) {
+            out.write((const char*)&entry, sizeof(entry));
+            header.entries++;
+            if (entry.games() >= header.min_games) header.playable++;
+        }
+        have_entry = false;
+    }
+    
+    void add(const LearnedBookEntry& stats) {
+        if (have_entry && stats.key == entry.key && stats.move == entry.move) {
+            entry.white_wins += stats.white_wins;
+            entry.draws += stats.draws;
+            entry.black_wins += stats.black_wins;
+            return;
+        }
+        finish_entry();
+        entry = stats;
+        entry.reserved = 0;
+        have_entry = true;
+    }
+    
+    void add(const IndexOccurrence& occurrence) {
+        LearnedBookEntry stats = { occurrence.key, occurrence.move, 0, 
+                                   (uint32_t)(occurrence.result == RECORD_WHITE_WINS), 
+                                   (uint32_t)(occurrence.result == RECORD_DRAW), 
+                                   (uint32_t)(occurrence.result == RECORD_BLACK_WINS) };
+        add(stats);
+    }
+    
+    bool close() {
+        finish_entry();
+        out.seekp(0);
+        out.write((const char*)&header, sizeof(header));
+        out.close();
+        string part_path = path + ".part";
+        if (out.fail() || rename(part_path.c_str(), path.c_str()) != 0) {
+            remove(part_path.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+    void discard() {
+        out.close();
+        remove((path + ".part").c_str());
+    }
+};
+
+// Learns a book from games as they finish. Their occurrences are collected
+// in memory and merged into the book file once per BOOK_LEARN_BATCH games:
+// the batch is sorted and merged with the book on disk into a new file that
+// replaces it, so the book is rewritten once per batch rather than once per
+// game. add() may be called from several threads; games in progress keep
+// probing the book as it was loaded.
+class BookLearner {
+private:
+    string path;
+    uint32_t min_games;
+    uint32_t max_plies;
+    vector<IndexOccurrence> pending;
+    size_t pending_games;
+    long games;
+    int batches;
+    uint32_t playable;
+    bool failed;
+    mutex lock;
+    
+    bool merge_batch() {
+        if (pending_games == 0) return true;
+        sort(pending.begin(), pending.end(), compare_occurrences);
+        
+        LearnedBook book;
+        book.open(path);   // absent until the first batch is merged
+        LearnedBookWriter writer;
+        if (!writer.open(path, min_games, max_plies)) {
+            writer.discard();
+            return false;
+        }
+        const LearnedBookEntry* entry = book.begin();
+        const LearnedBookEntry* end = book.end();
+        size_t i = 0;
+        while (entry != end || i < pending.size()) {
+            if (i == pending.size() || 
+                (entry != end && (entry->key < pending[i].key || 
+                                  (entry->key == pending[i].key && entry->move <= pending[i].move)))) {
+                writer.add(*entry++);
+            } else {
+                writer.add(pending[i++]);
+            }
+        }
+        writer.header.games = (book.is_open() ? book.get_header().games : 0) + (uint32_t)pending_games;
+        
+        pending.clear();
+        pending_games = 0;
+        batches++;
+        if (!writer.close()) return false;
+        playable = writer.header.playable;
+        return true;
+    }
+
+public:
+    BookLearner() 
+        : min_games(0), max_plies(0), pending_games(0), games(0), batches(0), playable(0), 
+          failed(false) {}
+    
+    // Learns into path, creating it if needed. An existing file must
+    // already be a learned book, and keeps its own filters; a new one
+    // learns the first max_plies plies and plays moves seen in min_games
+    // games.
+    bool open(const string& book_path, int plies, int min_count) {
+        path = book_path;
+        LearnedBook existing;
+        if (existing.open(path)) {
+            min_games = existing.get_header().min_games;
+            max_plies = existing.get_header().max_plies;
+            playable = existing.get_header().playable;
+            return true;
+        }
+        ifstream probe(path.c_str(), ios::binary | ios::ate);
+        if (probe && probe.tellg() > 0) return false;
+        min_games = (uint32_t)max(1, min_count);
+        max_plies = (uint32_t)max(1, plies);
+        return true;
+    }
+    
+    void add(const GameRecord& record) {
+        vector<IndexOccurrence> occurrences;
+        Chess chess;
+        vector<int> keys;
+        Move move;
+        char promotion;
+        size_t plies = min(record.moves.size(), (size_t)max_plies);
+        for (size_t ply = 0; ply < plies; ply++) {
+            if (!chess.find_record_move(record.moves[ply], keys, move, promotion)) break;
+            IndexOccurrence occurrence = { chess.get_position_key(), 0, 
+                                           chess.pack_board_move(move, promotion), record.result, 0 };
+            occurrences.push_back(occurrence);
+            if (!chess.play_move(move, promotion)) break;
+        }
+        
+        lock_guard<mutex> guard(lock);
+        pending.insert(pending.end(), occurrences.begin(), occurrences.end());
+        pending_games++;
+        games++;
+        if (pending_games >= BOOK_LEARN_BATCH && !merge_batch()) failed = true;
+    }
+    
+    // Merges the last, partial batch
+    bool close() {
+        lock_guard<mutex> guard(lock);
+        if (!merge_batch()) failed = true;
+        return !failed;
+    }
+    
+    const string& get_path() const { return path; }
+    long get_games() const { return games; }
+    int get_batches() const { return batches; }
+    uint32_t get_playable() const { return playable; }
+};
+
+// ============= COOPERATIVE GAME SCHEDULER =============
+
+// A headless game driven as a resumable task: each resume() plays exactly one
+// move and then yields control back to the scheduler.
+struct GameTask {
+    int id;
+    int white_difficulty;
+    int black_difficulty;
+    unsigned int seed;
+    bool started;
+    bool finished;
+    Chess game;
+    
+    GameTask(int i, int wd, int bd, unsigned int s)
+        : id(i), white_difficulty(wd), black_difficulty(bd), seed(s),
+          started(false), finished(false) {}
+    
+    bool resume() {
+        if (!started) {
+            game.start_headless_game(white_difficulty, black_difficulty, seed);
+            started = true;
+        }
+        if (!game.step_headless_game()) {
+            finished = true;
+        }
+        return !finished;
+    }
+};
+
+struct GameResult {
+    int id;
+    string winner;
+    int moves;
+    
+    GameResult(int i, const string& w, int m) : id(i), winner(w), moves(m) {}
+};
+
+// Multiplexes many games on the calling thread. Unfinished tasks are resumed
+// round-robin at move boundaries, so thousands of cheap games can share one
+// thread without a thread (and stack) per game.
+class GameScheduler {
+private:
+    vector<GameTask> tasks;
+    vector<GameResult> results;
+    GameRecordWriter* writer;       // finished games are appended to these if set
+    PgnStreamWriter* pgn_writer;
+    BookLearner* learner;           // ... and learned from, if set
+
+public:
+    GameScheduler() : writer(NULL), pgn_writer(NULL), learner(NULL) {}
+    
+    void set_writer(GameRecordWriter* w) { writer = w; }
+    void set_pgn_writer(PgnStreamWriter* w) { pgn_writer = w; }
+    void set_learner(BookLearner* l) { learner = l; }
+    
+    void add_game(int id, int white_difficulty, int black_difficulty, unsigned int seed) {
+        tasks.push_back(GameTask(id, white_difficulty, black_difficulty, seed));
+    }
+    
+    void run() {
+        deque<size_t> ready;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            ready.push_back(i);
+        }
+        
+        while (!ready.empty()) {
+            size_t index = ready.front();
+            ready.pop_front();
+            
+            GameTask& task = tasks[index];
+            if (task.resume()) {
+                ready.push_back(index);
+            } else {
+                results.push_back(GameResult(task.id, task.game.get_winner(), 
+                                             task.game.get_headless_move_count()));
+                GameRecord record;
+                if ((writer || learner) && task.game.encode_game_record(record)) {
+                    if (writer) writer->append(record);
+                    if (learner) learner->add(record);
+                }
+                if (pgn_writer) {
+                    pgn_writer->append(task.game.get_last_game_pgn());
+                }
+            }
+        }
+    }
+    
+    const vector<GameResult>& get_results() const { return results; }
+};
+
+struct TournamentSummary {
+    int white_wins;
+    int black_wins;
+    int draws;
+    int games;
+    long total_moves;
+    double seconds;
+    
+    TournamentSummary() : white_wins(0), black_wins(0), draws(0), games(0), 
+                          total_moves(0), seconds(0.0) {}
+};
+
+// Plays num_games headless games with one scheduler per thread, spreading the
+// games evenly so every core runs a single thread with no oversubscription.
+// Finished games are also appended to the writers that are given, and
+// learned from by the learner.
+TournamentSummary run_tournament(int num_games, int white_difficulty, int black_difficulty,
+                                 unsigned int base_seed, int num_threads, 
+                                 GameRecordWriter* writer = NULL, 
+                                 PgnStreamWriter* pgn_writer = NULL,
+                                 BookLearner* learner = NULL) {
+    if (num_threads < 1) num_threads = 1;
+    
+    vector<GameScheduler> schedulers(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+        schedulers[t].set_writer(writer);
+        schedulers[t].set_pgn_writer(pgn_writer);
+        schedulers[t].set_learner(learner);
+    }
+    for (int g = 0; g < num_games; g++) {
+        schedulers[g % num_threads].add_game(g, white_difficulty, black_difficulty, 
+                                             base_seed + g);
+    }
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    vector<thread> workers;
+    for (int t = 0; t < num_threads; t++) {
+        workers.push_back(thread(&GameScheduler::run, &schedulers[t]));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+    
+    TournamentSummary summary;
+    summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    for (int t = 0; t < num_threads; t++) {
+        const vector<GameResult>& results = schedulers[t].get_results();
+        for (size_t i = 0; i < results.size(); i++) {
+            if (results[i].winner == "white") summary.white_wins++;
+            else if (results[i].winner == "black") summary.black_wins++;
+            else summary.draws++;
+            summary.total_moves += results[i].moves;
+            summary.games++;
+        }
+    }
+    
+    return summary;
+}
+
+void print_tournament_summary(const TournamentSummary& summary) {
+    cout << "\n=== Tournament Results ===" << endl;
+    cout << "White AI Wins: " << summary.white_wins << " ♔" << endl;
+    cout << "Black AI Wins: " << summary.black_wins << " ♚" << endl;
+    cout << "Draws: " << summary.draws << endl;
+    cout << fixed << setprecision(1);
+    cout << "Time: " << summary.seconds << "s (" 
+         << (summary.seconds > 0 ? summary.games / summary.seconds : 0.0) << " games/s, "
+         << (summary.seconds > 0 ? summary.total_moves / summary.seconds : 0.0) << " moves/s)" << endl;
+    cout << string(26, '=') << endl;
+}
+
+void run_headless_tournament(int white_difficulty, int black_difficulty) {
+    int num_games;
+    cout << "Number of games: ";
+    if (!(cin >> num_games) || num_games < 1) {
+        cin.clear();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cout << "Invalid input." << endl;
+        return;
+    }
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    
+    int num_threads = (int)thread::hardware_concurrency();
+    if (num_threads < 1) num_threads = 1;
+    num_threads = min(num_threads, num_games);
+    
+    cout << "Playing " << num_games << " games on " << num_threads 
+         << " scheduler thread(s)..." << endl;
+    
+    random_device rd;
+    TournamentSummary summary = run_tournament(num_games, white_difficulty, black_difficulty, 
+                                               rd(), num_threads);
+    
+    print_tournament_summary(summary);
+}
+
+// Checks the SIMD and scalar kernels against evaluate_board() on positions
+// sampled from random playouts: the piece-square sums against its
+// incremental score, and the full evaluations built on each kernel against
+// its result. Reports the throughput of both kernels.
+int run_simd_eval_check(int num_positions) {
+    vector<uint8_t> codes(num_positions * 64);
+    vector<Score> expected_psq(num_positions);
+    vector<int> expected(num_positions);
+    vector<Score> psq[2];
+    vector<int> full[2];
+    
+    Chess game;
+    mt19937 rng(12345);
+    for (int i = 0; i < num_positions; i++) {
+        game.start_headless_game(1, 1, rng());
+        game.play_random_moves(rng() % 120);
+        game.fill_piece_codes(&codes[i * 64]);
+        expected_psq[i] = game.get_psq_score();
+        expected[i] = game.evaluate_board();
+    }
+    
+    const int repeats = 20;
+    double psq_seconds[2];
+    double full_seconds[2];
+    for (int pass = 0; pass < 2; pass++) {
+        psq[pass].resize(num_positions);
+        full[pass].resize(num_positions);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            evaluate_psq_batch(&codes[0], num_positions, &psq[pass][0], pass == 1);
+        }
+        psq_seconds[pass] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            for (int i = 0; i < num_positions; i++) {
+                full[pass][i] = evaluate_codes(&codes[i * 64], pass == 1);
+            }
+        }
+        full_seconds[pass] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    
+    int psq_mismatches = 0;
+    int mismatches = 0;
+    for (int i = 0; i < num_positions; i++) {
+        if (psq[0][i] != expected_psq[i] || psq[1][i] != expected_psq[i]) psq_mismatches++;
+        if (full[0][i] != expected[i] || full[1][i] != expected[i]) mismatches++;
+    }
+    
+    double evaluated = (double)num_positions * repeats;
+    const char* simd_name = cpu_has_avx2() ? "AVX2" : "Scalar (no AVX2)";
+    cout << fixed << setprecision(0);
+    cout << "Positions: " << num_positions << ", piece-square mismatches: " << psq_mismatches 
+         << ", evaluate_board mismatches: " << mismatches << endl;
+    cout << "Scalar kernel: " << evaluated / psq_seconds[0] << " positions/s, full evaluation " 
+         << evaluated / full_seconds[0] << " positions/s" << endl;
+    cout << simd_name << " kernel: " << evaluated / psq_seconds[1] << " positions/s, full evaluation " 
+         << evaluated / full_seconds[1] << " positions/s" << endl;
+    return psq_mismatches == 0 && mismatches == 0 ? 0 : 1;
+}
+
+// Checks the batch evaluator against evaluate_board() and the one-position
+// evaluate_position(), and compares their throughput
+int run_batch_eval_benchmark(int num_positions) {
+    PositionBatch batch;
+    batch.resize(num_positions);
+    vector<int> expected(num_positions);
+    vector<int> single(num_positions);
+    vector<int> batched(num_positions);
+    
+    Chess game;
+    mt19937 rng(54321);
+    for (int i = 0; i < num_positions; i++) {
+        game.start_headless_game(1, 1, rng());
+        game.play_random_moves(rng() % 160);
+        uint64_t bb[12];
+        game.get_piece_bitboards(bb);
+        batch.set(i, bb);
+        expected[i] = game.evaluate_board();
+    }
+    
+    const int repeats = 5;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < num_positions; i++) {
+            uint64_t bb[12];
+            for (int index = 0; index < 12; index++) bb[index] = batch.pieces[index][i];
+            single[i] = evaluate_position(bb);
+        }
+    }
+    double single_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        evaluate_batch(batch, &batched[0]);
+    }
+    double batch_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    int mismatches = 0;
+    for (int i = 0; i < num_positions; i++) {
+        if (single[i] != expected[i] || batched[i] != expected[i]) mismatches++;
+    }
+    
+    double evaluated = (double)num_positions * repeats;
+    cout << fixed << setprecision(0);
+    cout << "Positions: " << num_positions << ", mismatches: " << mismatches << endl;
+    cout << "One at a time: " << evaluated / single_seconds << " positions/s" << endl;
+    cout << "Batched: " << evaluated / batch_seconds << " positions/s" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Loads every line of an EPD/FEN file into a game, checks that the position
+// fields survive a write_fen() round trip, and reports the parse rate
+int run_epd_benchmark(const string& path) {
+    ifstream in(path.c_str(), ios::binary);
+    if (!in) {
+        cerr << "Cannot read " << path << endl;
+        return 1;
+    }
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    
+    Chess game;
+    long loaded = 0;
+    long invalid = 0;
+    long mismatches = 0;
+    char fen[FEN_BUFFER_SIZE];
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t pos = 0; pos < text.size(); ) {
+        size_t end = text.find('\n', pos);
+        if (end == string::npos) end = text.size();
+        string_view line(text.data() + pos, end - pos);
+        pos = end + 1;
+        if (line.empty() || line[0] == '#') continue;
+        
+        if (!game.load_fen(line)) {
+            invalid++;
+            continue;
+        }
+        loaded++;
+        
+        // Placement and side to move must come back unchanged
+        size_t written = game.write_fen(fen);
+        size_t in_pos = 0;
+        size_t out_pos = 0;
+        string_view out(fen, written);
+        for (int field = 0; field < 2; field++) {
+            if (next_fen_field(line, in_pos) != next_fen_field(out, out_pos)) {
+                mismatches++;
+                break;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    cout << "Loaded " << loaded << " positions (" << invalid << " invalid, " 
+         << mismatches << " round-trip mismatches)" << endl;
+    cout << fixed << setprecision(0) << (loaded + invalid) / max(seconds, 1e-9) 
+         << " lines/s" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ============= PGN READER =============
+
+struct PgnTag {
+    string_view name;
+    string_view value;   // as written, escapes included
+};
+
+// One game, as views into the source text
+struct PgnGame {
+    string_view record;
+    vector<PgnTag> tags;
+    string_view movetext;
+    
+    string_view tag(string_view name) const {
+        for (size_t i = 0; i < tags.size(); i++) {
+            if (tags[i].name == name) return tags[i].value;
+        }
+        return string_view();
+    }
+};
+
+// Line starting at pos, without its line ending; pos moves to the next line
+string_view next_pgn_line(string_view text, size_t& pos) {
+    size_t start = pos;
+    size_t end = text.find('\n', pos);
+    if (end == string_view::npos) end = text.size();
+    pos = (end < text.size()) ? end + 1 : end;
+    if (end > start && text[end - 1] == '\r') end--;
+    return text.substr(start, end - start);
+}
+
+inline bool is_blank_line(string_view line) {
+    for (size_t i = 0; i < line.size(); i++) {
+        if (!is_fen_space(line[i])) return false;
+    }
+    return true;
+}
+
+// Next game record in text from pos: its tag section and movetext, up to
+// the next tag line that follows movetext
+bool next_pgn_game(string_view text, size_t& pos, string_view& record) {
+    while (pos < text.size()) {
+        size_t line_start = pos;
+        if (!is_blank_line(next_pgn_line(text, pos))) {
+            pos = line_start;
+            break;
+        }
+    }
+    if (pos >= text.size()) return false;
+    
+    size_t start = pos;
+    bool seen_moves = false;
+    while (pos < text.size()) {
+        size_t line_start = pos;
+        string_view line = next_pgn_line(text, pos);
+        if (is_blank_line(line) || line[0] == '%') continue;
+        if (line[0] == '[') {
+            if (seen_moves) {
+                pos = line_start;
+                break;
+            }
+        } else {
+            seen_moves = true;
+        }
+    }
+    record = text.substr(start, pos - start);
+    return true;
+}
+
+// First game start at or after pos: a tag line whose previous non-blank
+// line is not a tag line. Used to split a file between threads.
+size_t find_pgn_game_start(string_view text, size_t pos) {
+    if (pos == 0) return 0;
+    size_t line = text.rfind('\n', pos - 1);
+    line = (line == string_view::npos) ? 0 : line + 1;
+    if (line < pos) {
+        next_pgn_line(text, line);
     }
     
-    // ============= ENHANCED EVALUATION FUNCTION =============
+    while (line < text.size()) {
+        size_t line_start = line;
+        string_view current = next_pgn_line(text, line);
+        if (current.empty() || current[0] != '[') continue;
+        
+        // Walk back over blank lines to the previous content line
+        size_t back = line_start;
+        string_view previous;
+        while (back > 0) {
+            size_t prev_end = back - 1;
+            size_t prev_start = (prev_end == 0) ? 0 : text.rfind('\n', prev_end - 1);
+            prev_start = (prev_start == string_view::npos || prev_end == 0) ? 0 : prev_start + 1;
+            previous = text.substr(prev_start, prev_end - prev_start);
+            back = prev_start;
+            if (!is_blank_line(previous)) break;
+            previous = string_view();
+        }
+        if (previous.empty() || previous[0] != '[') return line_start;
+    }
+    return text.size();
+}
+
+// Splits a record into its tags and movetext
+bool parse_pgn_game(string_view record, PgnGame& game) {
+    game.record = record;
+    game.tags.clear();
+    game.movetext = string_view();
     
-    bool is_endgame() {
-        int queens = 0, minors = 0;
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                char piece = toupper(static_cast<unsigned char>(board[i][j]));
-                if (piece == 'Q') queens++;
-                if (piece == 'N' || piece == 'B') minors++;
+    size_t pos = 0;
+    while (pos < record.size()) {
+        size_t line_start = pos;
+        string_view line = next_pgn_line(record, pos);
+        if (is_blank_line(line)) continue;
+        if (line[0] != '[') {
+            game.movetext = record.substr(line_start);
+            break;
+        }
+        
+        size_t name_end = line.find(' ');
+        size_t open = line.find('"');
+        size_t close = line.rfind('"');
+        if (name_end == string_view::npos || open == string_view::npos || close <= open) {
+            return false;
+        }
+        PgnTag tag;
+        tag.name = line.substr(1, name_end - 1);
+        tag.value = line.substr(open + 1, close - open - 1);
+        game.tags.push_back(tag);
+    }
+    return true;
+}
+
+inline bool is_pgn_result(string_view token) {
+    return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
+
+// Characters that end a movetext token: white space and the brackets of
+// comments and variations, looked up in one table load per character
+struct PgnDelimiters {
+    bool ends_token[256];
+};
+
+constexpr PgnDelimiters build_pgn_delimiters() {
+    PgnDelimiters d{};
+    const char delimiters[] = " \t\r\n{();";
+    for (int i = 0; delimiters[i]; i++) d.ends_token[(unsigned char)delimiters[i]] = true;
+    return d;
+}
+
+constexpr PgnDelimiters PGN_DELIMITERS = build_pgn_delimiters();
+
+// Next SAN move in the movetext, skipping move numbers, comments, nested
+// variations, NAGs and the result
+bool next_pgn_move(string_view text, size_t& pos, string_view& san) {
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (is_fen_space(c) || c == ')') {
+            pos++;
+        } else if (c == '{') {
+            pos = text.find('}', pos);
+            pos = (pos == string_view::npos) ? text.size() : pos + 1;
+        } else if (c == ';') {
+            pos = text.find('\n', pos);
+            if (pos == string_view::npos) pos = text.size();
+        } else if (c == '(') {
+            int depth = 0;
+            for (; pos < text.size(); pos++) {
+                if (text[pos] == '{') {
+                    pos = text.find('}', pos);
+                    if (pos == string_view::npos) pos = text.size() - 1;
+                } else if (text[pos] == '(') {
+                    depth++;
+                } else if (text[pos] == ')' && --depth == 0) {
+                    pos++;
+                    break;
+                }
+            }
+        } else if (c == '$') {
+            pos++;
+            while (pos < text.size() && isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        } else {
+            size_t start = pos;
+            while (pos < text.size() && !PGN_DELIMITERS.ends_token[(unsigned char)text[pos]]) pos++;
+            string_view token = text.substr(start, pos - start);
+            if (is_pgn_result(token)) continue;
+            
+            // A move number ("12." or "12...") may be glued to the move
+            size_t digits = 0;
+            while (digits < token.size() && isdigit(static_cast<unsigned char>(token[digits]))) digits++;
+            if (digits > 0 && digits < token.size() && token[digits] == '.') {
+                while (digits < token.size() && token[digits] == '.') digits++;
+                token.remove_prefix(digits);
+            } else if (digits == token.size()) {
+                continue;
+            }
+            if (token.empty()) continue;
+            
+            san = token;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Replays a parsed game on chess from its start position (the FEN tag if
+// present). Returns false on the first move that does not resolve to
+// exactly one legal move.
+bool replay_pgn_game(const PgnGame& game, Chess& chess, long& moves) {
+    chess.reset_game();
+    string_view fen = game.tag("FEN");
+    if (!fen.empty() && !chess.load_fen(fen)) return false;
+    
+    size_t pos = 0;
+    string_view san;
+    moves = 0;
+    while (next_pgn_move(game.movetext, pos, san)) {
+        if (!chess.play_san(san)) return false;
+        moves++;
+    }
+    return true;
+}
+
+// Replays every game of one slice of a PGN file
+struct PgnReplayWorker {
+    string_view text;
+    long games;
+    long moves;
+    long errors;
+    long results[3];   // white wins, draws, black wins
+    
+    void run() {
+        games = moves = errors = 0;
+        results[0] = results[1] = results[2] = 0;
+        
+        Chess chess;
+        PgnGame game;
+        string_view record;
+        size_t pos = 0;
+        while (next_pgn_game(text, pos, record)) {
+            long game_moves = 0;
+            if (!parse_pgn_game(record, game) || !replay_pgn_game(game, chess, game_moves)) {
+                errors++;
+                continue;
+            }
+            games++;
+            moves += game_moves;
+            string_view result = game.tag("Result");
+            if (result == "1-0") results[0]++;
+            else if (result == "1/2-1/2") results[1]++;
+            else if (result == "0-1") results[2]++;
+        }
+    }
+};
+
+// Reads a PGN file through a memory map, split at game boundaries across
+// all cores, replaying every move against the legal move generator
+int run_pgn_reader(const string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        cerr << "Cannot read " << path << endl;
+        return 1;
+    }
+    string_view text = file.view();
+    
+    int num_threads = max(1, (int)thread::hardware_concurrency());
+    vector<size_t> bounds(num_threads + 1);
+    bounds[0] = 0;
+    bounds[num_threads] = text.size();
+    for (int t = 1; t < num_threads; t++) {
+        bounds[t] = max(bounds[t - 1], find_pgn_game_start(text, text.size() * t / num_threads));
+    }
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<PgnReplayWorker> slices(num_threads);
+    vector<thread> workers;
+    for (int t = 0; t < num_threads; t++) {
+        slices[t].text = text.substr(bounds[t], bounds[t + 1] - bounds[t]);
+        workers.push_back(thread(&PgnReplayWorker::run, &slices[t]));
+    }
+    
+    long games = 0, moves = 0, errors = 0;
+    long results[3] = { 0, 0, 0 };
+    for (int t = 0; t < num_threads; t++) {
+        workers[t].join();
+        games += slices[t].games;
+        moves += slices[t].moves;
+        errors += slices[t].errors;
+        for (int r = 0; r < 3; r++) results[r] += slices[t].results[r];
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    cout << "Games: " << games << " (+" << results[0] << " =" << results[1] << " -" << results[2]
+         << "), moves: " << moves << ", unreadable games: " << errors << endl;
+    cout << fixed << setprecision(0) << games / max(seconds, 1e-9) << " games/s, "
+         << moves / max(seconds, 1e-9) << " moves/s on " << num_threads << " thread(s)" << endl;
+    return errors == 0 ? 0 : 1;
+}
+
+// Plays num_games headless games on all cores, streaming each game as it
+// finishes to a PGN file (for a ".pgn" path, rotated every rotate_bytes if
+// non-zero) or else to a game record file, and learning from it if a
+// learner is given
+int run_game_recorder(int num_games, const string& path, int white_difficulty, int black_difficulty,
+                      size_t rotate_bytes, BookLearner* learner) {
+    bool pgn = path.size() > 4 && path.compare(path.size() - 4, 4, ".pgn") == 0;
+    GameRecordWriter writer;
+    PgnStreamWriter pgn_writer;
+    if (pgn ? !pgn_writer.open(path, rotate_bytes) : !writer.open(path)) {
+        cerr << "Cannot write games to " << path << endl;
+        return 1;
+    }
+    
+    int num_threads = max(1, min((int)thread::hardware_concurrency(), num_games));
+    random_device rd;
+    TournamentSummary summary = run_tournament(num_games, white_difficulty, black_difficulty, 
+                                               rd(), num_threads, pgn ? NULL : &writer, 
+                                               pgn ? &pgn_writer : NULL, learner);
+    if (pgn ? !pgn_writer.close() : !writer.close()) {
+        cerr << "Cannot write games to " << path << endl;
+        return 1;
+    }
+    if (learner && !learner->close()) {
+        cerr << "Cannot update learned book " << learner->get_path() << endl;
+        return 1;
+    }
+    
+    print_tournament_summary(summary);
+    if (pgn) {
+        cout << "Recorded " << pgn_writer.get_games() << " games in " << pgn_writer.get_bytes() 
+             << " bytes to";
+        const vector<string>& files = pgn_writer.get_files();
+        for (size_t i = 0; i < files.size(); i++) cout << " " << files[i];
+        cout << endl;
+    } else {
+        cout << "Recorded " << writer.get_count() << " games in " << writer.get_bytes() 
+             << " bytes to " << path << endl;
+    }
+    if (learner) {
+        cout << "Learned from " << learner->get_games() << " games in " << learner->get_batches() 
+             << " batch(es): " << learner->get_path() << " now has " << learner->get_playable() 
+             << " book moves" << endl;
+    }
+    return 0;
+}
+
+// Writes records [first, first + count) of a game record file as PGN
+int convert_games_to_pgn(const string& in_path, const string& out_path, size_t first, size_t count) {
+    GameRecordReader reader;
+    if (!reader.open(in_path)) {
+        cerr << "Cannot read game records from " << in_path << endl;
+        return 1;
+    }
+    ofstream out(out_path.c_str(), ios::binary);
+    if (!out.is_open()) {
+        cerr << "Cannot write " << out_path << endl;
+        return 1;
+    }
+    
+    Chess game;
+    GameRecord record;
+    long converted = 0, invalid = 0;
+    first = min(first, reader.size());
+    count = min(count, reader.size() - first);
+    for (size_t i = first; i < first + count; i++) {
+        reader.read(i, record);
+        if (!game.load_game_record(record)) {
+            invalid++;
+            continue;
+        }
+        out << game.get_last_game_pgn() << "\n";
+        converted++;
+    }
+    
+    cout << "Converted " << converted << " of " << reader.size() << " games";
+    if (invalid > 0) cout << " (" << invalid << " invalid)";
+    cout << endl;
+    return out.good() && invalid == 0 ? 0 : 1;
+}
+
+// Difficulty from a "White"/"Black" tag as written by generate_pgn
+int parse_difficulty_name(string_view player) {
+    if (player == "AI Easy") return 1;
+    if (player == "AI Medium") return 2;
+    if (player == "AI Hard") return 3;
+    return 0;
+}
+
+// Converts a PGN file to a game record file. Games set up from a FEN
+// cannot be recorded and are skipped.
+int convert_pgn_to_games(const string& in_path, const string& out_path) {
+    MappedFile file;
+    if (!file.open(in_path)) {
+        cerr << "Cannot read " << in_path << endl;
+        return 1;
+    }
+    GameRecordWriter writer;
+    if (!writer.open(out_path)) {
+        cerr << "Cannot write game records to " << out_path << endl;
+        return 1;
+    }
+    
+    string_view text = file.view();
+    Chess chess;
+    PgnGame game;
+    GameRecord record;
+    string_view game_text;
+    size_t pos = 0;
+    long skipped = 0;
+    while (next_pgn_game(text, pos, game_text)) {
+        long moves = 0;
+        if (!parse_pgn_game(game_text, game) || !replay_pgn_game(game, chess, moves) ||
+            !chess.encode_game_record(record)) {
+            skipped++;
+            continue;
+        }
+        
+        string_view result = game.tag("Result");
+        record.result = (result == "1-0") ? RECORD_WHITE_WINS : 
+                        (result == "0-1") ? RECORD_BLACK_WINS : RECORD_DRAW;
+        record.white_difficulty = (uint8_t)parse_difficulty_name(game.tag("White"));
+        record.black_difficulty = (uint8_t)parse_difficulty_name(game.tag("Black"));
+        record.seed = (uint32_t)strtoul(string(game.tag("Seed")).c_str(), NULL, 10);
+        writer.append(record);
+    }
+    if (!writer.close()) {
+        cerr << "Cannot write game records to " << out_path << endl;
+        return 1;
+    }
+    
+    cout << "Recorded " << writer.get_count() << " games in " << writer.get_bytes() << " bytes";
+    if (skipped > 0) cout << " (" << skipped << " skipped)";
+    cout << endl;
+    return 0;
+}
+
+// ============= POSITION INDEX BUILDER =============
+
+// Occurrences each builder thread sorts in memory before spilling a run
+const size_t INDEX_RUN_OCCURRENCES = 1 << 21;   // 32 MB
+
+// Replays one slice of a game collection (a PGN text slice, or a range of
+// game records) and spills its occurrences as sorted run files
+struct IndexBuildWorker {
+    string_view text;
+    const GameRecordReader* records;
+    size_t first_record;
+    size_t end_record;
+    uint32_t first_game;   // id of the slice's first game
+    int max_plies;
+    string run_prefix;
+    
+    vector<IndexOccurrence> buffer;
+    vector<string> runs;
+    long games;
+    bool failed;
+    
+    IndexBuildWorker() 
+        : records(NULL), first_record(0), end_record(0), first_game(0), max_plies(0), 
+          games(0), failed(false) {}
+    
+    void count_games() {
+        games = 0;
+        size_t pos = 0;
+        string_view record;
+        while (next_pgn_game(text, pos, record)) games++;
+    }
+    
+    void add(uint64_t key, uint32_t game, uint16_t move, uint8_t result) {
+        IndexOccurrence occurrence = { key, game, move, result, 0 };
+        buffer.push_back(occurrence);
+        if (buffer.size() >= INDEX_RUN_OCCURRENCES) write_run();
+    }
+    
+    void write_run() {
+        if (buffer.empty()) return;
+        sort(buffer.begin(), buffer.end(), compare_occurrences);
+        string path = run_prefix + to_string(runs.size());
+        ofstream out(path.c_str(), ios::binary);
+        out.write((const char*)&buffer[0], buffer.size() * sizeof(IndexOccurrence));
+        if (!out) failed = true;
+        runs.push_back(path);
+        buffer.clear();
+    }
+    
+    void run() {
+        Chess chess;
+        vector<int> keys;
+        Move move;
+        char promotion;
+        
+        if (records) {
+            GameRecord record;
+            for (size_t i = first_record; i < end_record; i++) {
+                records->read(i, record);
+                chess.reset_game();
+                size_t plies = min(record.moves.size(), (size_t)max_plies);
+                for (size_t ply = 0; ply < plies; ply++) {
+                    if (!chess.find_record_move(record.moves[ply], keys, move, promotion)) break;
+                    add(chess.get_position_key(), (uint32_t)i, chess.pack_board_move(move, promotion), 
+                        record.result);
+                    if (!chess.play_move(move, promotion)) break;
+                }
+            }
+            games = end_record - first_record;
+        } else {
+            PgnGame game;
+            string_view record;
+            size_t pos = 0;
+            uint32_t id = first_game;
+            while (next_pgn_game(text, pos, record)) {
+                uint32_t game_id = id++;
+                if (!parse_pgn_game(record, game)) continue;
+                
+                // Unfinished games say nothing about how the moves scored
+                string_view result = game.tag("Result");
+                uint8_t outcome;
+                if (result == "1-0") outcome = RECORD_WHITE_WINS;
+                else if (result == "0-1") outcome = RECORD_BLACK_WINS;
+                else if (result == "1/2-1/2") outcome = RECORD_DRAW;
+                else continue;
+                
+                chess.reset_game();
+                string_view fen = game.tag("FEN");
+                if (!fen.empty() && !chess.load_fen(fen)) continue;
+                
+                size_t move_pos = 0;
+                string_view san;
+                for (int ply = 0; ply < max_plies && next_pgn_move(game.movetext, move_pos, san); ply++) {
+                    if (!chess.find_san_move(san, move, promotion)) break;
+                    add(chess.get_position_key(), game_id, chess.pack_board_move(move, promotion), outcome);
+                    chess.play_legal_move(move, promotion);
+                }
+            }
+            games = id - first_game;
+        }
+        write_run();
+    }
+};
+
+// Streams one sorted run file back in blocks
+struct IndexRunReader {
+    ifstream in;
+    vector<IndexOccurrence> block;
+    size_t pos;
+    
+    IndexRunReader() : pos(0) {}
+    
+    bool open(const string& path) {
+        in.open(path.c_str(), ios::binary);
+        return in.is_open();
+    }
+    
+    bool next(IndexOccurrence& occurrence) {
+        if (pos == block.size()) {
+            block.resize(65536);
+            in.read((char*)&block[0], block.size() * sizeof(IndexOccurrence));
+            block.resize(in.gcount() / sizeof(IndexOccurrence));
+            pos = 0;
+            if (block.empty()) return false;
+        }
+        occurrence = block[pos++];
+        return true;
+    }
+};
+
+struct IndexHeapItem {
+    IndexOccurrence occurrence;
+    size_t run;
+};
+
+// Orders the merge heap so the smallest occurrence is on top
+bool compare_heap_items(const IndexHeapItem& a, const IndexHeapItem& b) {
+    return compare_occurrences(b.occurrence, a.occurrence);
+}
+
+// Merges sorted run files into one sorted occurrence stream
+struct IndexRunMerger {
+    vector<IndexRunReader> readers;
+    vector<IndexHeapItem> heap;
+    
+    bool open(const vector<string>& runs) {
+        readers.resize(runs.size());
+        heap.clear();
+        for (size_t r = 0; r < runs.size(); r++) {
+            IndexHeapItem item;
+            item.run = r;
+            if (!readers[r].open(runs[r])) return false;
+            if (readers[r].next(item.occurrence)) heap.push_back(item);
+        }
+        make_heap(heap.begin(), heap.end(), compare_heap_items);
+        return true;
+    }
+    
+    bool next(IndexOccurrence& occurrence) {
+        if (heap.empty()) return false;
+        pop_heap(heap.begin(), heap.end(), compare_heap_items);
+        IndexHeapItem& item = heap.back();
+        occurrence = item.occurrence;
+        if (readers[item.run].next(item.occurrence)) {
+            push_heap(heap.begin(), heap.end(), compare_heap_items);
+        } else {
+            heap.pop_back();
+        }
+        return true;
+    }
+};
+
+// Folds the merged, sorted occurrence stream into the three index tables,
+// each written to its own temporary file
+struct IndexTableWriter {
+    ofstream positions;
+    ofstream moves;
+    ofstream games;
+    PositionIndexHeader header;
+    PositionIndexEntry position;
+    MoveIndexEntry move;
+    vector<uint32_t> position_games;
+    bool have_position;
+    
+    IndexTableWriter() : have_position(false) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, POSITION_INDEX_MAGIC, sizeof(header.magic));
+    }
+    
+    bool open(const string& prefix) {
+        positions.open((prefix + ".positions").c_str(), ios::binary);
+        moves.open((prefix + ".moves").c_str(), ios::binary);
+        games.open((prefix + ".games").c_str(), ios::binary);
+        return positions.is_open() && moves.is_open() && games.is_open();
+    }
+    
+    void finish_move() {
+        moves.write((const char*)&move, sizeof(move));
+        header.moves++;
+        position.move_count++;
+    }
+    
+    void finish_position() {
+        if (!have_position) return;
+        finish_move();
+        sort(position_games.begin(), position_games.end());
+        position_games.erase(unique(position_games.begin(), position_games.end()), position_games.end());
+        games.write((const char*)&position_games[0], position_games.size() * sizeof(uint32_t));
+        header.game_ids += (uint32_t)position_games.size();
+        positions.write((const char*)&position, sizeof(position));
+        header.positions++;
+        have_position = false;
+    }
+    
+    void add(const IndexOccurrence& occurrence) {
+        if (!have_position || occurrence.key != position.key) {
+            finish_position();
+            memset(&position, 0, sizeof(position));
+            position.key = occurrence.key;
+            position.first_move = header.moves;
+            position.first_game = header.game_ids;
+            position_games.clear();
+            memset(&move, 0, sizeof(move));
+            move.move = occurrence.move;
+            have_position = true;
+        } else if (occurrence.move != move.move) {
+            finish_move();
+            memset(&move, 0, sizeof(move));
+            move.move = occurrence.move;
+        }
+        
+        if (occurrence.result == RECORD_WHITE_WINS) {
+            position.white_wins++;
+            move.white_wins++;
+        } else if (occurrence.result == RECORD_BLACK_WINS) {
+            position.black_wins++;
+            move.black_wins++;
+        } else {
+            position.draws++;
+            move.draws++;
+        }
+        position_games.push_back(occurrence.game);
+    }
+    
+    bool close() {
+        finish_position();
+        positions.close();
+        moves.close();
+        games.close();
+        return !positions.fail() && !moves.fail() && !games.fail();
+    }
+};
+
+bool append_file(ofstream& out, const string& path) {
+    ifstream in(path.c_str(), ios::binary);
+    if (!in) return false;
+    out << in.rdbuf();
+    return !out.fail();
+}
+
+// Replays the first max_plies plies of every game in a PGN or game record
+// file into sorted run files named run_prefix*. Threads replay slices of
+// the collection and spill runs of at most INDEX_RUN_OCCURRENCES, so memory
+// use does not grow with the collection. The runs are left for the caller
+// to merge and remove, even on failure.
+bool collect_index_runs(const string& in_path, const string& run_prefix, int max_plies,
+                        vector<string>& runs, long& games) {
+    MappedFile file;
+    GameRecordReader records;
+    if (!file.open(in_path)) {
+        cerr << "Cannot read " << in_path << endl;
+        return false;
+    }
+    string_view text = file.view();
+    bool binary = text.substr(0, GAME_RECORD_MAGIC_SIZE) == 
+                  string_view(GAME_RECORD_MAGIC, GAME_RECORD_MAGIC_SIZE);
+    if (binary && !records.open(in_path)) {
+        cerr << "Cannot read game records from " << in_path << endl;
+        return false;
+    }
+    
+    int num_threads = max(1, (int)thread::hardware_concurrency());
+    vector<IndexBuildWorker> slices(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+        slices[t].max_plies = max_plies;
+        slices[t].run_prefix = run_prefix + to_string(t) + "_";
+        if (binary) {
+            slices[t].records = &records;
+            slices[t].first_record = records.size() * t / num_threads;
+            slices[t].end_record = records.size() * (t + 1) / num_threads;
+        }
+    }
+    
+    // PGN games are numbered in file order, so count each slice first
+    if (!binary) {
+        size_t begin = 0;
+        for (int t = 0; t < num_threads; t++) {
+            size_t end = (t + 1 < num_threads) ? 
+                         max(begin, find_pgn_game_start(text, text.size() * (t + 1) / num_threads)) : 
+                         text.size();
+            slices[t].text = text.substr(begin, end - begin);
+            begin = end;
+        }
+        vector<thread> counters;
+        for (int t = 0; t < num_threads; t++) {
+            counters.push_back(thread(&IndexBuildWorker::count_games, &slices[t]));
+        }
+        uint32_t first_game = 0;
+        for (int t = 0; t < num_threads; t++) {
+            counters[t].join();
+            slices[t].first_game = first_game;
+            first_game += (uint32_t)slices[t].games;
+        }
+    }
+    
+    vector<thread> workers;
+    for (int t = 0; t < num_threads; t++) {
+        workers.push_back(thread(&IndexBuildWorker::run, &slices[t]));
+    }
+    bool failed = false;
+    games = 0;
+    for (int t = 0; t < num_threads; t++) {
+        workers[t].join();
+        runs.insert(runs.end(), slices[t].runs.begin(), slices[t].runs.end());
+        games += slices[t].games;
+        failed = failed || slices[t].failed;
+    }
+    if (failed) cerr << "Cannot write sorted runs to " << run_prefix << "*" << endl;
+    return !failed;
+}
+
+// Builds a position index over the first max_plies plies of every game in
+// a PGN or game record file: the sorted runs from collect_index_runs are
+// merged into the three index tables, which are then joined behind a header
+int build_position_index(const string& in_path, const string& out_path, int max_plies) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<string> runs;
+    long games = 0;
+    if (!collect_index_runs(in_path, out_path + ".run", max_plies, runs, games)) {
+        for (size_t r = 0; r < runs.size(); r++) remove(runs[r].c_str());
+        return 1;
+    }
+    
+    IndexTableWriter tables;
+    IndexRunMerger merger;
+    bool failed = !tables.open(out_path) || !merger.open(runs);
+    IndexOccurrence occurrence;
+    while (!failed && merger.next(occurrence)) tables.add(occurrence);
+    failed = !tables.close() || failed;
+    tables.header.max_plies = (uint32_t)max_plies;
+    
+    string part_path = out_path + ".part";
+    if (!failed) {
+        ofstream out(part_path.c_str(), ios::binary);
+        out.write((const char*)&tables.header, sizeof(tables.header));
+        failed = !out || !append_file(out, out_path + ".positions") || 
+                 !append_file(out, out_path + ".moves") || !append_file(out, out_path + ".games");
+        out.close();
+        failed = failed || out.fail() || rename(part_path.c_str(), out_path.c_str()) != 0;
+    }
+    
+    for (size_t r = 0; r < runs.size(); r++) remove(runs[r].c_str());
+    remove((out_path + ".positions").c_str());
+    remove((out_path + ".moves").c_str());
+    remove((out_path + ".games").c_str());
+    if (failed) {
+        remove(part_path.c_str());
+        cerr << "Cannot write " << out_path << endl;
+        return 1;
+    }
+    
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Indexed " << games << " games (" << max_plies << " plies each): " 
+         << tables.header.positions << " positions, " << tables.header.moves << " moves, "
+         << runs.size() << " sorted run(s), " << fixed << setprecision(2) << seconds << "s" << endl;
+    return 0;
+}
+
+// Shows what was played from a position (the start position by default)
+// and how it scored
+int probe_position_index(const string& index_path, const string& fen) {
+    PositionIndex index;
+    if (!index.open(index_path)) {
+        cerr << "Cannot read position index " << index_path << endl;
+        return 1;
+    }
+    Chess chess;
+    if (!fen.empty() && !chess.load_fen(fen)) {
+        cerr << "Invalid FEN: " << fen << endl;
+        return 1;
+    }
+    
+    uint64_t key = chess.get_position_key();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    const PositionIndexEntry* entry = index.find(key);
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    
+    cout << chess.to_fen() << endl;
+    cout << fixed << setprecision(1);
+    if (!entry) {
+        cout << "Not in the index (" << micros << " us)" << endl;
+        return 0;
+    }
+    cout << "Games: " << entry->games() << " (+" << entry->white_wins << " =" << entry->draws 
+         << " -" << entry->black_wins << "), found in " << micros << " us" << endl;
+    
+    const MoveIndexEntry* moves = index.get_moves(*entry);
+    for (uint16_t i = 0; i < entry->move_count; i++) {
+        char promotion;
+        Move move = Chess::logged_move(moves[i].move, promotion);
+        cout << "  " << setw(8) << left << chess.san_before_move(move, promotion) << right
+             << setw(6) << moves[i].games() << " games, white scores " 
+             << 100.0 * (moves[i].white_wins + 0.5 * moves[i].draws) / moves[i].games() << "%" << endl;
+    }
+    
+    uint32_t count;
+    const uint32_t* games = index.get_games(*entry, count);
+    cout << "Game ids:";
+    for (uint32_t i = 0; i < count && i < 20; i++) cout << " " << games[i];
+    if (count > 20) cout << " ... (" << count << ")";
+    cout << endl;
+    return 0;
+}
+
+// Lists the loaded book's moves for a position (the start position by
+// default)
+int probe_polyglot_book(const string& fen) {
+    if (!POLYGLOT_BOOK.is_open()) {
+        cerr << "No opening book loaded (use --book)" << endl;
+        return 1;
+    }
+    Chess chess;
+    if (!fen.empty() && !chess.load_fen(fen)) {
+        cerr << "Invalid FEN: " << fen << endl;
+        return 1;
+    }
+    
+    uint64_t key = chess.polyglot_key();
+    vector<pair<uint16_t, uint16_t> > moves;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    POLYGLOT_BOOK.get_moves(key, moves);
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    
+    cout << chess.to_fen() << endl;
+    cout << "Polyglot key " << hex << setw(16) << setfill('0') << key << dec << setfill(' ') 
+         << ": " << moves.size() << " book move(s) in " << fixed << setprecision(1) << micros << " us" << endl;
+    uint32_t total = 0;
+    for (size_t i = 0; i < moves.size(); i++) total += moves[i].second;
+    for (size_t i = 0; i < moves.size(); i++) {
+        char promotion;
+        Move move = chess.polyglot_move(moves[i].first, promotion);
+        cout << "  " << setw(8) << left << chess.san_before_move(move, promotion) << right 
+             << setw(6) << moves[i].second << "  " 
+             << (total > 0 ? 100.0 * moves[i].second / total : 0.0) << "%" << endl;
+    }
+    return 0;
+}
+
+// ============= LEARNED BOOK BUILDER =============
+
+// Builds a learned book from a PGN or game record file: the moves played
+// within the first max_plies plies of its games, with how they scored.
+// Those played in at least min_games games are the ones played from it.
+int build_learned_book(const string& in_path, const string& out_path, int max_plies, int min_games) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<string> runs;
+    long games = 0;
+    if (!collect_index_runs(in_path, out_path + ".run", max_plies, runs, games)) {
+        for (size_t r = 0; r < runs.size(); r++) remove(runs[r].c_str());
+        return 1;
+    }
+    
+    LearnedBookWriter writer;
+    IndexRunMerger merger;
+    bool failed = !writer.open(out_path, (uint32_t)min_games, (uint32_t)max_plies) || 
+                  !merger.open(runs);
+    IndexOccurrence occurrence;
+    long occurrences = 0;
+    while (!failed && merger.next(occurrence)) {
+        writer.add(occurrence);
+        occurrences++;
+    }
+    writer.header.games = (uint32_t)games;
+    if (failed) writer.discard();
+    else failed = !writer.close();
+    
+    for (size_t r = 0; r < runs.size(); r++) remove(runs[r].c_str());
+    if (failed) {
+        cerr << "Cannot write " << out_path << endl;
+        return 1;
+    }
+    
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Learned a book from " << games << " games (" << max_plies << " plies each, moves in " 
+         << min_games << "+ games): " << writer.header.playable << " book moves of " 
+         << writer.header.entries << " seen, from " << occurrences << " played, " << fixed << setprecision(2) << seconds << "s" << endl;
+    return 0;
+}
+
+// Lists the learned book's moves for a position (the start position by
+// default)
+int probe_learned_book(const string& fen) {
+    if (!LEARNED_BOOK.is_open()) {
+        cerr << "No learned book loaded (use --own-book or --learn-book)" << endl;
+        return 1;
+    }
+    Chess chess;
+    if (!fen.empty() && !chess.load_fen(fen)) {
+        cerr << "Invalid FEN: " << fen << endl;
+        return 1;
+    }
+    
+    const LearnedBookHeader& header = LEARNED_BOOK.get_header();
+    const LearnedBookEntry* last;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    const LearnedBookEntry* first = LEARNED_BOOK.find(chess.get_position_key(), last);
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    
+    cout << chess.to_fen() << endl;
+    cout << "Book of " << header.playable << " moves from " << header.games << " games: " 
+         << (last - first) << " book move(s) in " << fixed << setprecision(1) << micros << " us" << endl;
+    bool white_to_move = chess.game_ply() % 2 == 0;
+    for (const LearnedBookEntry* entry = first; entry != last; entry++) {
+        char promotion;
+        Move move = Chess::logged_move(entry->move, promotion);
+        uint32_t wins = white_to_move ? entry->white_wins : entry->black_wins;
+        cout << "  " << setw(8) << left << chess.san_before_move(move, promotion) << right 
+             << setw(6) << entry->games() << " games, scores " 
+             << 100.0 * (wins + 0.5 * entry->draws) / entry->games() << "%"
+             << (LEARNED_BOOK.is_playable(*entry) ? "" : " (too few games)") << endl;
+    }
+    return 0;
+}
+
+// ============= ENDGAME TABLE CHECK =============
+
+// Reference results for KQvK, KRvK and KPvK, generated in memory to check
+// loaded Syzygy tables against (--check-tables). Values are kept per
+// endgame_table_index(side, white king, black king, piece), side 0 being
+// white to move, with the board's squares; each is, for the side to move,
+// 0 for a draw, n for a win and TB_LOSS | n for a loss, with mate n plies
+// away under best play.
+const size_t ENDGAME_TABLE_SIZE = 2 * 64 * 64 * 64;
+const uint8_t TB_LOSS = 0x80;
+
+inline size_t endgame_table_index(int side, int strong_king, int weak_king, int piece) {
+    return (((size_t)side * 64 + strong_king) * 64 + weak_king) * 64 + piece;
+}
+
+// Retrograde generation of the values for white's king and one piece
+// against the black king, resolving positions a ply at a time: after n
+// plies, white positions with a move to a black loss in n - 1 are wins in
+// n, and black positions whose every move reaches a white win are losses
+// in n. What is left unresolved is a draw. Black can only draw, by
+// stalemate or by taking the piece.
+struct EndgameTableGenerator {
+    char piece;                                  // 'Q', 'R' or 'P'
+    const vector<uint8_t>* promotion_tables[2];  // KQvK and KRvK, for pawn promotions
+    int promotion_depth;                         // their longest mate
+    vector<uint8_t> values;
+    
+    EndgameTableGenerator(char p, const vector<uint8_t>* queen_table, const vector<uint8_t>* rook_table) 
+        : piece(p), promotion_depth(0), values(ENDGAME_TABLE_SIZE, 0) {
+        promotion_tables[0] = queen_table;
+        promotion_tables[1] = rook_table;
+        for (int t = 0; t < 2; t++) {
+            for (size_t i = 0; i < promotion_tables[t]->size(); i++) {
+                promotion_depth = max(promotion_depth, (*promotion_tables[t])[i] & ~TB_LOSS);
+            }
+        }
+    }
+    
+    uint64_t piece_attacks(int sq, uint64_t occupied) const {
+        if (piece == 'Q') return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+        if (piece == 'R') return rook_attacks(sq, occupied);
+        return white_pawn_attacks(1ULL << sq);
+    }
+    
+    bool is_legal(int side, int wk, int bk, int x) const {
+        if (wk == bk || wk == x || bk == x || (ATTACKS.king[wk] & (1ULL << bk))) return false;
+        if (piece == 'P' && (x < 8 || x >= 56)) return false;
+        // Black, when not to move, cannot be in check
+        return side == 1 || !(piece_attacks(x, (1ULL << wk) | (1ULL << bk)) & (1ULL << bk));
+    }
+    
+    // Whether white, to move, has a move to a black loss in target plies
+    bool white_reaches(int wk, int bk, int x, int target) const {
+        uint8_t loss = (uint8_t)(TB_LOSS | target);
+        uint64_t wk_bb = 1ULL << wk, bk_bb = 1ULL << bk, x_bb = 1ULL << x;
+        for (uint64_t b = ATTACKS.king[wk] & ~ATTACKS.king[bk] & ~x_bb; b; b &= b - 1) {
+            if (values[endgame_table_index(1, lsb(b), bk, x)] == loss) return true;
+        }
+        if (piece != 'P') {
+            for (uint64_t b = piece_attacks(x, wk_bb | bk_bb) & ~wk_bb & ~bk_bb; b; b &= b - 1) {
+                if (values[endgame_table_index(1, wk, bk, lsb(b))] == loss) return true;
             }
+            return false;
+        }
+        
+        int to = x - 8;
+        if ((wk_bb | bk_bb) & (1ULL << to)) return false;
+        // A rook can win where a queen would stalemate; knights and bishops
+        // never win
+        if (to < 8) {
+            return (*promotion_tables[0])[endgame_table_index(1, wk, bk, to)] == loss || 
+                   (*promotion_tables[1])[endgame_table_index(1, wk, bk, to)] == loss;
         }
-        return queens == 0 || (queens == 2 && minors <= 2);
+        if (values[endgame_table_index(1, wk, bk, to)] == loss) return true;
+        to -= 8;
+        return x >= 48 && !((wk_bb | bk_bb) & (1ULL << to)) && 
+               values[endgame_table_index(1, wk, bk, to)] == loss;
     }
     
-    int count_mobility(const string& color) {
-        int mobility = 0;
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                if (board[i][j] != ' ' && get_piece_color(board[i][j]) == color) {
-                    mobility += get_piece_moves(i, j).size();
-                }
+    // Black's moves from a position with black to move: counts them and
+    // whether they all reach white wins
+    bool black_moves(int wk, int bk, int x, int& count) const {
+        bool all_lose = true;
+        count = 0;
+        uint64_t wk_bb = 1ULL << wk;
+        for (uint64_t b = ATTACKS.king[bk] & ~ATTACKS.king[wk]; b; b &= b - 1) {
+            int to = lsb(b);
+            if (to == x) {
+                if (ATTACKS.king[wk] & (1ULL << x)) continue;
+                count++;
+                all_lose = false;
+            } else if (!(piece_attacks(x, wk_bb | (1ULL << to)) & (1ULL << to))) {
+                count++;
+                uint8_t value = values[endgame_table_index(0, wk, to, x)];
+                if (value == 0) all_lose = false;
             }
         }
-        return mobility;
+        return all_lose;
     }
     
-    int evaluate_pawn_structure() {
-        int score = 0;
-        
-        // Doubled pawns penalty
-        for (int col = 0; col < 8; col++) {
-            int white_pawns = 0, black_pawns = 0;
-            for (int row = 0; row < 8; row++) {
-                if (board[row][col] == 'P') white_pawns++;
-                if (board[row][col] == 'p') black_pawns++;
+    // Fills values; fails if a mate lies too far away to encode
+    bool run() {
+        for (int wk = 0; wk < 64; wk++) {
+            for (int bk = 0; bk < 64; bk++) {
+                for (int x = 0; x < 64; x++) {
+                    int count;
+                    if (!is_legal(1, wk, bk, x)) continue;
+                    black_moves(wk, bk, x, count);
+                    bool in_check = piece_attacks(x, (1ULL << wk) | (1ULL << bk)) & (1ULL << bk);
+                    if (count == 0 && in_check) values[endgame_table_index(1, wk, bk, x)] = TB_LOSS;
+                }
             }
-            if (white_pawns > 1) score -= 20 * (white_pawns - 1);
-            if (black_pawns > 1) score += 20 * (black_pawns - 1);
         }
         
-        // Passed pawns bonus
-        for (int row = 0; row < 8; row++) {
-            for (int col = 0; col < 8; col++) {
-                if (board[row][col] == 'P') {
-                    bool passed = true;
-                    for (int r = 0; r < row; r++) {
-                        if (col > 0 && board[r][col-1] == 'p') passed = false;
-                        if (board[r][col] == 'p') passed = false;
-                        if (col < 7 && board[r][col+1] == 'p') passed = false;
-                    }
-                    if (passed) score += (7 - row) * 10;
-                } else if (board[row][col] == 'p') {
-                    bool passed = true;
-                    for (int r = row + 1; r < 8; r++) {
-                        if (col > 0 && board[r][col-1] == 'P') passed = false;
-                        if (board[r][col] == 'P') passed = false;
-                        if (col < 7 && board[r][col+1] == 'P') passed = false;
+        for (int n = 1; ; n++) {
+            if (n > 127) return false;
+            int side = (n % 2 == 1) ? 0 : 1;
+            bool changed = false;
+            for (int wk = 0; wk < 64; wk++) {
+                for (int bk = 0; bk < 64; bk++) {
+                    for (int x = 0; x < 64; x++) {
+                        uint8_t& value = values[endgame_table_index(side, wk, bk, x)];
+                        if (value != 0 || !is_legal(side, wk, bk, x)) continue;
+                        int count;
+                        if (side == 0 ? white_reaches(wk, bk, x, n - 1) : 
+                                        (black_moves(wk, bk, x, count) && count > 0)) {
+                            value = (uint8_t)(side == 0 ? n : (TB_LOSS | n));
+                            changed = true;
+                        }
                     }
-                    if (passed) score -= row * 10;
                 }
             }
+            // Wins at ply n + 1 need losses at ply n, here or after a promotion
+            if (!changed && n > promotion_depth) return true;
         }
-        
-        return score;
     }
-    
-    int evaluate_board() {
-        int score = 0;
-        bool endgame = is_endgame();
-        
-        // Material and positional evaluation
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                char piece = board[i][j];
-                if (piece == ' ') continue;
-                
-                score += PieceValues::get(piece);
-                
-                char piece_type = toupper(static_cast<unsigned char>(piece));
-                int row = is_black_piece(piece) ? i : 7 - i;
-                
-                int bonus = 0;
-                if (piece_type == 'P') {
-                    bonus = PAWN_TABLE[row][j];
-                } else if (piece_type == 'N') {
-                    bonus = KNIGHT_TABLE[row][j];
-                } else if (piece_type == 'B') {
-                    bonus = BISHOP_TABLE[row][j];
-                } else if (piece_type == 'R') {
-                    bonus = ROOK_TABLE[row][j];
-                } else if (piece_type == 'Q') {
-                    bonus = QUEEN_TABLE[row][j];
-                } else if (piece_type == 'K') {
-                    bonus = endgame ? KING_END_TABLE[row][j] : KING_MIDDLE_TABLE[row][j];
-                }
-                
-                score += is_white_piece(piece) ? bonus : -bonus;
+};
+
+// FEN of a position from the generator, or of its mirror image with the
+// colours swapped
+string endgame_check_fen(char piece, int wk, int bk, int x, bool white_to_move, bool mirrored) {
+    char squares[64];
+    memset(squares, ' ', sizeof(squares));
+    int flip = mirrored ? 56 : 0;
+    squares[wk ^ flip] = mirrored ? 'k' : 'K';
+    squares[bk ^ flip] = mirrored ? 'K' : 'k';
+    squares[x ^ flip] = mirrored ? char(tolower(piece)) : piece;
+    string fen;
+    for (int row = 0; row < 8; row++) {
+        int empty = 0;
+        for (int col = 0; col < 8; col++) {
+            char c = squares[row * 8 + col];
+            if (c == ' ') {
+                empty++;
+                continue;
             }
+            if (empty > 0) fen += char('0' + empty);
+            empty = 0;
+            fen += c;
         }
-        
-        // Mobility bonus
-        int white_mobility = count_mobility("white");
-        int black_mobility = count_mobility("black");
-        score += (white_mobility - black_mobility) * 3;
-        
-        // Pawn structure
-        score += evaluate_pawn_structure();
-        
-        // King safety in middlegame
-        if (!endgame) {
-            // Penalty for exposed king
-            if (white_king_pos.row < 7) score -= 15;
-            if (black_king_pos.row > 0) score += 15;
-        }
-        
-        return score;
+        if (empty > 0) fen += char('0' + empty);
+        if (row < 7) fen += '/';
     }
-    
-    // ============= MINIMAX WITH ALPHA-BETA PRUNING =============
-    
-    int minimax(int depth, int alpha, int beta, bool maximizing_player) {
-        nodes_searched++;
-        
-        string color = maximizing_player ? "white" : "black";
-        
-        if (depth == 0) {
-            return evaluate_board();
-        }
-        
-        if (is_checkmate(color)) {
-            return maximizing_player ? -30000 + (5 - depth) * 100 : 30000 - (5 - depth) * 100;
-        }
-        
-        if (is_stalemate(color)) {
-            return 0;
+    return fen + ((white_to_move != mirrored) ? " w - - 0 1" : " b - - 0 1");
+}
+
+// Checks the loaded KQvK, KRvK and KPvK tables against generated results:
+// the WDL of every legal position and of its colour-swapped mirror, the
+// sign of the DTZ (and for KQvK and KRvK that it is the mate distance,
+// give or take a ply the table rounds away), and that a sample of won
+// positions keep the win with the move tablebase_move picks
+int run_tablebase_check() {
+    if (!TABLEBASE.is_open()) {
+        cerr << "No endgame tables loaded (use --tablebase)" << endl;
+        return 1;
+    }
+    const char pieces[] = "QRP";
+    vector<uint8_t> promotion_values[2];
+    long failures = 0;
+    Chess chess;
+    for (int t = 0; t < 3; t++) {
+        char piece = pieces[t];
+        EndgameTableGenerator generator(piece, &promotion_values[0], &promotion_values[1]);
+        if (!generator.run()) {
+            cerr << "Cannot generate K" << piece << "vK: mates too long to encode" << endl;
+            return 1;
         }
+        if (piece != 'P') promotion_values[t] = generator.values;
         
-        vector<Move> moves = get_all_valid_moves(color);
-        if (moves.empty()) return 0;
-        
-        if (maximizing_player) {
-            int max_eval = -99999;
-            for (size_t i = 0; i < moves.size(); i++) {
-                GameState saved = save_state();
-                
-                char piece = board[moves[i].from_row][moves[i].from_col];
-                board[moves[i].to_row][moves[i].to_col] = piece;
-                board[moves[i].from_row][moves[i].from_col] = ' ';
-                if (piece == 'K') white_king_pos = Position(moves[i].to_row, moves[i].to_col);
-                else if (piece == 'k') black_king_pos = Position(moves[i].to_row, moves[i].to_col);
-                
-                int eval = minimax(depth - 1, alpha, beta, false);
-                
-                restore_state(saved);
-                
-                max_eval = max(max_eval, eval);
-                alpha = max(alpha, eval);
-                if (beta <= alpha) break;
-            }
-            return max_eval;
-        } else {
-            int min_eval = 99999;
-            for (size_t i = 0; i < moves.size(); i++) {
-                GameState saved = save_state();
-                
-                char piece = board[moves[i].from_row][moves[i].from_col];
-                board[moves[i].to_row][moves[i].to_col] = piece;
-                board[moves[i].from_row][moves[i].from_col] = ' ';
-                if (piece == 'K') white_king_pos = Position(moves[i].to_row, moves[i].to_col);
-                else if (piece == 'k') black_king_pos = Position(moves[i].to_row, moves[i].to_col);
-                
-                int eval = minimax(depth - 1, alpha, beta, true);
+        long positions = 0, wdl_errors = 0, dtz_errors = 0, missing = 0, no_dtz = 0, moves = 0, move_errors = 0;
+        for (size_t i = 0; i < ENDGAME_TABLE_SIZE; i++) {
+            int side = (int)(i / (64 * 64 * 64));
+            int wk = (i / (64 * 64)) % 64, bk = (i / 64) % 64, x = i % 64;
+            if (!generator.is_legal(side, wk, bk, x)) continue;
+            uint8_t value = generator.values[i];
+            int expected = value == 0 ? 0 : (value & TB_LOSS) ? -2 : 2;
+            int plies = value & ~TB_LOSS;
+            
+            for (int mirrored = 0; mirrored < 2; mirrored++) {
+                chess.load_fen(endgame_check_fen(piece, wk, bk, x, side == 0, mirrored));
+                bool white = (side == 0) != (mirrored == 1);
+                positions++;
+                TablebaseProbeState state = TB_PROBE_OK;
+                int wdl = chess.tablebase_wdl_search(white, -1, false, state);
+                if (state == TB_PROBE_FAIL) {
+                    missing++;
+                    continue;
+                }
+                if (wdl != expected) wdl_errors++;
                 
-                restore_state(saved);
+                int dtz = chess.tablebase_dtz(white, -1, state);
+                if (state == TB_PROBE_FAIL) {
+                    no_dtz++;
+                    continue;
+                }
+                bool dtz_ok = (dtz > 0) == (expected > 0) && (dtz < 0) == (expected < 0);
+                if (piece != 'P' && expected != 0 && abs(abs(dtz) - plies) > 1) dtz_ok = false;
+                if (!dtz_ok) dtz_errors++;
                 
-                min_eval = min(min_eval, eval);
-                beta = min(beta, eval);
-                if (beta <= alpha) break;
+                if (expected == 2 && positions % 64 == 0) {
+                    Move move;
+                    char promotion;
+                    moves++;
+                    if (!chess.tablebase_move(move, promotion) || !chess.play_move(move, promotion) ||
+                        chess.tablebase_wdl_search(!white, chess.tablebase_ep(), false, state) != -2) {
+                        move_errors++;
+                    }
+                }
             }
-            return min_eval;
         }
+        cout << "K" << piece << "vK: " << positions << " positions, " << wdl_errors << " WDL and " 
+             << dtz_errors << " DTZ mismatches, " << move_errors << "/" << moves << " moves losing the win";
+        if (missing > 0) cout << ", " << missing << " not covered";
+        if (no_dtz > 0) cout << ", " << no_dtz << " without DTZ";
+        cout << endl;
+        failures += wdl_errors + dtz_errors + move_errors;
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+// Shows the endgame table result of a position and its best move
+int probe_endgame_tables(const string& fen) {
+    if (!TABLEBASE.is_open()) {
+        cerr << "No endgame tables loaded (use --tablebase)" << endl;
+        return 1;
+    }
+    Chess chess;
+    if (!chess.load_fen(fen)) {
+        cerr << "Invalid FEN: " << fen << endl;
+        return 1;
     }
     
-    Move get_ai_move(int difficulty) {
-        vector<Move> valid_moves = get_all_valid_moves(current_player);
-        
-        if (valid_moves.empty()) return Move();
-        
-        if (difficulty == 1) {
-            uniform_int_distribution<int> dis(0, valid_moves.size() - 1);
-            return valid_moves[dis(gen)];
-        }
-        
-        // Determine search depth based on difficulty
-        int search_depth = (difficulty == 2) ? 2 : 3;
-        
-        nodes_searched = 0;
-        bool maximizing = (current_player == "white");
-        
-        vector<MoveScore> move_scores;
-        
-        for (size_t m = 0; m < valid_moves.size(); m++) {
-            Move move = valid_moves[m];
-            GameState saved_state = save_state();
-            
-            char piece = board[move.from_row][move.from_col];
-            board[move.to_row][move.to_col] = piece;
-            board[move.from_row][move.from_col] = ' ';
-            if (piece == 'K') {
-                white_king_pos = Position(move.to_row, move.to_col);
-            } else if (piece == 'k') {
-                black_king_pos = Position(move.to_row, move.to_col);
-            }
-            
-            int score = minimax(search_depth - 1, -99999, 99999, !maximizing);
-            
-            move_scores.push_back(MoveScore(move.from_row, move.from_col, 
-                                           move.to_row, move.to_col, 
-                                           maximizing ? score : -score));
-            
-            restore_state(saved_state);
-        }
-        
-        sort(move_scores.begin(), move_scores.end(), compare_move_scores);
-        
-        MoveScore selected = move_scores[0];
-        
-        uniform_real_distribution<double> prob_dist(0.0, 1.0);
-        
-        if (difficulty == 2) {
-            if (prob_dist(gen) < 0.7) {
-                selected = move_scores[0];
-            } else {
-                int top_count = min(3, (int)move_scores.size());
-                uniform_int_distribution<int> dis(0, top_count - 1);
-                selected = move_scores[dis(gen)];
-            }
-        } else {
-            if (prob_dist(gen) < 0.95) {
-                selected = move_scores[0];
-            } else {
-                int top_count = min(2, (int)move_scores.size());
-                uniform_int_distribution<int> dis(0, top_count - 1);
-                selected = move_scores[dis(gen)];
-            }
-        }
-        
-        return Move(selected.from_row, selected.from_col, 
-                   selected.to_row, selected.to_col);
+    static const char* const WDL_NAMES[] = { 
+        "Loss", "Loss, saved by the fifty-move rule", "Draw", "Win, spoilt by the fifty-move rule", "Win" 
+    };
+    bool white_to_move = chess.game_ply() % 2 == 0;
+    cout << chess.to_fen() << endl;
+    TablebaseProbeState state = TB_PROBE_OK;
+    int wdl = 0;
+    if (chess.tablebase_covers()) wdl = chess.tablebase_wdl_search(white_to_move, chess.tablebase_ep(), false, state);
+    if (!chess.tablebase_covers() || state == TB_PROBE_FAIL) {
+        cout << "Not covered by the endgame tables" << endl;
+        return 0;
     }
+    cout << WDL_NAMES[wdl + 2] << endl;
+    int dtz = chess.tablebase_dtz(white_to_move, chess.tablebase_ep(), state);
+    if (state == TB_PROBE_FAIL) {
+        cout << "No DTZ table" << endl;
+        return 0;
+    }
+    cout << "DTZ " << dtz << " plies" << endl;
     
-    bool play_ai_turn(const string& ai_name, int difficulty) {
-        cout << ai_name << " is thinking" << flush;
-        
-        int delay_ms = (difficulty == 1) ? 300 : ((difficulty == 2) ? 600 : 900);
-        
-        for (int i = 0; i < 3; i++) {
-            cout << "." << flush;
-            this_thread::sleep_for(chrono::milliseconds(delay_ms / 3));
+    Move best;
+    char promotion;
+    if (chess.tablebase_move(best, promotion)) {
+        cout << "Best move: " << chess.san_before_move(best, promotion) << endl;
+    }
+    return 0;
+}
+
+// ============= MULTI-PROCESS TOURNAMENT COORDINATOR =============
+//
+// The coordinator listens on a local Unix socket and hands game jobs to
+// worker processes, one job per worker at a time. Protocol (text lines):
+//
+//   worker -> coordinator   READY <pid>
+//   coordinator -> worker   JOB <id> <white diff> <black diff> <seed> [opening moves...]
+//   worker -> coordinator   RESULT <id> <winner> <moves> <pgn bytes>\n<pgn>
+//   worker -> coordinator   FAILED <id> <reason>
+//   coordinator -> worker   QUIT
+//
+// A worker that disconnects while holding a job (crash, kill) has that job
+// re-queued and a replacement worker is forked. A job the worker cannot
+// play (an illegal opening) fails outright, as a retry would fail again.
+// Games are written to the PGN file in job order, each tagged with its
+// job number as the round.
+
+struct GameJob {
+    int id;
+    int white_difficulty;
+    int black_difficulty;
+    unsigned int seed;
+    string opening;
+    int attempts;
+    bool finished;   // played or given up on
+    
+    GameJob(int i, int wd, int bd, unsigned int s, const string& o)
+        : id(i), white_difficulty(wd), black_difficulty(bd), seed(s), opening(o), attempts(0), 
+          finished(false) {}
+};
+
+struct JobResult {
+    int id;
+    string winner;
+    int moves;
+    string pgn;
+    
+    JobResult() : id(-1), moves(0) {}
+};
+
+// Openings handed out round-robin so workers do not replay the same game
+const char* TOURNAMENT_OPENINGS[] = {
+    "",
+    "e2e4 e7e5",
+    "e2e4 c7c5",
+    "d2d4 d7d5",
+    "d2d4 g8f6 c2c4 e7e6",
+    "c2c4 e7e5",
+    "g1f3 d7d5",
+    "e2e4 e7e6 d2d4 d7d5"
+};
+const int NUM_TOURNAMENT_OPENINGS = sizeof(TOURNAMENT_OPENINGS) / sizeof(TOURNAMENT_OPENINGS[0]);
+
+const int MAX_JOB_ATTEMPTS = 3;
+
+#ifndef _WIN32
+
+bool write_all(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
         }
-        cout << endl;
-        
-        Move move = get_ai_move(difficulty);
-        
-        if (move.has_value()) {
-            char piece = board[move.from_row][move.from_col];
-            
-            if (make_move(move.from_row, move.from_col, move.to_row, move.to_col)) {
-                string from_pos = string(1, char('a' + move.from_col)) + char('0' + (8 - move.from_row));
-                string to_pos = string(1, char('a' + move.to_col)) + char('0' + (8 - move.to_row));
-                cout << ai_name << " plays: " << get_piece_symbol(piece) << " " << from_pos << " → " << to_pos;
-                if (difficulty > 1) {
-                    cout << " (searched " << nodes_searched << " nodes)";
-                }
-                cout << endl;
-                this_thread::sleep_for(chrono::milliseconds(500));
-                return true;
-            }
+        sent += n;
+    }
+    return true;
+}
+
+// Blocking line reader used on the worker side of the socket
+bool read_line(int fd, string& buffer, string& line) {
+    while (true) {
+        size_t newline = buffer.find('\n');
+        if (newline != string::npos) {
+            line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return true;
         }
-        
-        return false;
+        char chunk[4096];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
     }
+}
+
+int connect_unix_socket(const string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
     
-    string get_difficulty_name(int diff) const {
-        if (diff == 1) return "Easy";
-        if (diff == 2) return "Medium";
-        return "Hard";
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Worker process main loop: plays every job it is handed with the regular
+// headless game loop and reports the result and PGN back.
+int run_worker(const string& socket_path) {
+    int fd = connect_unix_socket(socket_path);
+    if (fd < 0) {
+        cerr << "Worker: cannot connect to " << socket_path << ": " << strerror(errno) << endl;
+        return 1;
     }
     
-    string get_current_date() const {
-        time_t now = time(0);
-        tm* ltm = localtime(&now);
-        char buffer[20];
-        snprintf(buffer, sizeof(buffer), "%04d.%02d.%02d", 
-                1900 + ltm->tm_year, 1 + ltm->tm_mon, ltm->tm_mday);
-        return string(buffer);
+    if (!write_all(fd, "READY " + to_string((long)getpid()) + "\n")) {
+        close(fd);
+        return 1;
     }
     
-    void generate_pgn() {
-        string pgn = "";
-        
-        pgn += "[Event \"AI vs AI Chess Match\"]\n";
-        pgn += "[Site \"C++ Chess Engine\"]\n";
-        pgn += "[Date \"" + get_current_date() + "\"]\n";
-        pgn += "[Round \"" + to_string(total_games) + "\"]\n";
-        pgn += "[White \"AI " + get_difficulty_name(difficulty_ai1) + "\"]\n";
-        pgn += "[Black \"AI " + get_difficulty_name(difficulty_ai2) + "\"]\n";
+    Chess game;
+    string buffer;
+    string line;
+    while (read_line(fd, buffer, line)) {
+        istringstream in(line);
+        string command;
+        in >> command;
+        if (command == "QUIT") break;
+        if (command != "JOB") continue;
         
-        string result = "1-0";
-        if (winner == "black") result = "0-1";
-        else if (winner == "draw") result = "1/2-1/2";
+        int id, white_difficulty, black_difficulty;
+        unsigned int seed;
+        in >> id >> white_difficulty >> black_difficulty >> seed;
+        string opening;
+        getline(in, opening);
         
-        pgn += "[Result \"" + result + "\"]\n\n";
+        if (!game.start_headless_game(white_difficulty, black_difficulty, seed, opening)) {
+            if (!write_all(fd, "FAILED " + to_string(id) + " illegal opening\n")) break;
+            continue;
+        }
+        game.set_round(id + 1);
+        while (game.step_headless_game()) {
+        }
         
-        for (size_t i = 0; i < pgn_moves.size(); i++) {
-            if (i % 2 == 0) {
-                pgn += to_string((i / 2) + 1) + ". ";
-            }
-            pgn += pgn_moves[i] + " ";
-            
-            if (i % 16 == 15) {
-                pgn += "\n";
+        const string& pgn = game.get_last_game_pgn();
+        string reply = "RESULT " + to_string(id) + " " + game.get_winner() + " " +
+                       to_string(game.get_headless_move_count()) + " " + 
+                       to_string(pgn.size()) + "\n" + pgn;
+        if (!write_all(fd, reply)) break;
+    }
+    
+    close(fd);
+    return 0;
+}
+
+struct WorkerConnection {
+    int fd;
+    long pid;
+    int job;  // index into the job list, or -1 when idle
+    bool ready;
+    string buffer;
+    
+    WorkerConnection(int f) : fd(f), pid(-1), job(-1), ready(false) {}
+};
+
+class TournamentCoordinator {
+private:
+    string socket_path;
+    int num_workers;
+    int listen_fd;
+    vector<GameJob> jobs;
+    deque<int> pending;
+    vector<WorkerConnection> connections;
+    vector<JobResult> results;
+    PgnStreamWriter* pgn_writer;   // takes the games' PGN in job order if set
+    map<int, string> held_pgn;     // finished games waiting for an earlier job
+    int next_pgn_job;              // first job not yet written or skipped
+    int completed;
+    int failed;
+    int live_children;
+    int respawned;
+    
+    void spawn_worker() {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+            for (size_t i = 0; i < connections.size(); i++) {
+                close(connections[i].fd);
             }
+            _exit(run_worker(socket_path));
         }
-        
-        pgn += result + "\n";
-        
-        last_game_pgn = pgn;
+        if (pid > 0) live_children++;
     }
     
-    void save_pgn_to_file() {
-        if (last_game_pgn.empty()) {
-            cout << "No game to save!" << endl;
-            return;
+    // Writes the PGN of every finished job that no unfinished job precedes
+    void flush_pgn() {
+        while (next_pgn_job < (int)jobs.size() && jobs[next_pgn_job].finished) {
+            map<int, string>::iterator held = held_pgn.find(next_pgn_job);
+            if (held != held_pgn.end()) {
+                pgn_writer->append(held->second);
+                held_pgn.erase(held);
+            }
+            next_pgn_job++;
         }
-        
-        time_t now = time(0);
-        tm* ltm = localtime(&now);
-        char filename[100];
-        snprintf(filename, sizeof(filename), "chess_game_%04d%02d%02d_%02d%02d%02d.pgn",
-                1900 + ltm->tm_year, 1 + ltm->tm_mon, ltm->tm_mday,
-                ltm->tm_hour, ltm->tm_min, ltm->tm_sec);
-        
-        ofstream file(filename);
-        if (file.is_open()) {
-            file << last_game_pgn;
-            file.close();
-            cout << "\n✓ Game saved to: " << filename << endl;
+    }
+    
+    void fail_job(int job) {
+        jobs[job].finished = true;
+        failed++;
+        if (pgn_writer) flush_pgn();
+    }
+    
+    void requeue(int job) {
+        jobs[job].attempts++;
+        if (jobs[job].attempts >= MAX_JOB_ATTEMPTS) {
+            cerr << "Coordinator: giving up on job " << jobs[job].id << endl;
+            fail_job(job);
         } else {
-            cout << "\n✗ Error saving file!" << endl;
+            pending.push_front(job);
         }
     }
     
-    void show_last_game_pgn() const {
-        if (last_game_pgn.empty()) {
-            cout << "No game to display!" << endl;
-            return;
+    void drop_connection(size_t index) {
+        WorkerConnection& conn = connections[index];
+        if (conn.job >= 0) {
+            cerr << "Coordinator: worker " << conn.pid << " lost, re-queuing job "
+                 << jobs[conn.job].id << endl;
+            requeue(conn.job);
         }
-        
-        cout << "\n" << string(60, '=') << endl;
-        cout << "LAST GAME PGN:" << endl;
-        cout << string(60, '=') << endl;
-        cout << last_game_pgn << endl;
-        cout << string(60, '=') << endl;
+        close(conn.fd);
+        connections.erase(connections.begin() + index);
     }
     
-    void reset_game() {
-        board = init_board();
-        current_player = "white";
-        move_history.clear();
-        pgn_moves.clear();
-        captured_pieces["white"].clear();
-        captured_pieces["black"].clear();
-        winner = "";
-        white_king_pos = Position(7, 4);
-        black_king_pos = Position(0, 4);
-        white_can_castle_kingside = true;
-        white_can_castle_queenside = true;
-        black_can_castle_kingside = true;
-        black_can_castle_queenside = true;
-        en_passant_target = Position();
+    // Consumes complete messages from a worker's buffer. Returns false on a
+    // protocol error.
+    bool process_messages(WorkerConnection& conn) {
+        while (true) {
+            size_t newline = conn.buffer.find('\n');
+            if (newline == string::npos) return true;
+            
+            istringstream in(conn.buffer.substr(0, newline));
+            string command;
+            in >> command;
+            
+            if (command == "READY") {
+                in >> conn.pid;
+                conn.ready = true;
+                conn.buffer.erase(0, newline + 1);
+            } else if (command == "RESULT") {
+                JobResult result;
+                size_t pgn_size = 0;
+                in >> result.id >> result.winner >> result.moves >> pgn_size;
+                if (!in || conn.job < 0 || jobs[conn.job].id != result.id) return false;
+                if (conn.buffer.size() < newline + 1 + pgn_size) return true;
+                
+                result.pgn = conn.buffer.substr(newline + 1, pgn_size);
+                conn.buffer.erase(0, newline + 1 + pgn_size);
+                jobs[conn.job].finished = true;
+                if (pgn_writer) {
+                    held_pgn[conn.job].swap(result.pgn);
+                    flush_pgn();
+                }
+                results.push_back(result);
+                conn.job = -1;
+                completed++;
+            } else if (command == "FAILED") {
+                int id;
+                string reason;
+                in >> id;
+                getline(in, reason);
+                if (!in || conn.job < 0 || jobs[conn.job].id != id) return false;
+                conn.buffer.erase(0, newline + 1);
+                cerr << "Coordinator: job " << id << " failed:" << reason << endl;
+                fail_job(conn.job);
+                conn.job = -1;
+            } else {
+                return false;
+            }
+        }
     }
     
-    void play_ai_vs_ai() {
-        reset_game();
+    void reap_children() {
+        int status;
+        while (waitpid(-1, &status, WNOHANG) > 0) {
+            live_children--;
+        }
+    }
+
+public:
+    TournamentCoordinator(const string& path, int workers)
+        : socket_path(path), num_workers(max(1, workers)), listen_fd(-1), pgn_writer(NULL),
+          next_pgn_job(0), completed(0), failed(0), live_children(0), respawned(0) {}
+    
+    void set_pgn_writer(PgnStreamWriter* writer) { pgn_writer = writer; }
+    
+    void add_job(int white_difficulty, int black_difficulty, unsigned int seed, 
+                 const string& opening) {
+        int id = (int)jobs.size();
+        jobs.push_back(GameJob(id, white_difficulty, black_difficulty, seed, opening));
+        pending.push_back(id);
+    }
+    
+    bool run() {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) return false;
         
-        cout << "\n=== AI vs AI Chess Match ===" << endl;
-        cout << "White AI: " << get_difficulty_name(difficulty_ai1) << endl;
-        cout << "Black AI: " << get_difficulty_name(difficulty_ai2) << endl;
-        cout << "Starting in 2 seconds...\n" << endl;
-        this_thread::sleep_for(chrono::seconds(2));
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socket_path.c_str());
+        if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 64) < 0) {
+            cerr << "Coordinator: cannot listen on " << socket_path << ": " << strerror(errno) << endl;
+            close(listen_fd);
+            return false;
+        }
         
-        const int max_moves = 200;
-        int move_count = 0;
+        for (int i = 0; i < num_workers; i++) {
+            spawn_worker();
+        }
         
-        while (move_count < max_moves) {
-            display_board();
+        while (completed + failed < (int)jobs.size()) {
+            vector<pollfd> fds(connections.size() + 1);
+            fds[0].fd = listen_fd;
+            fds[0].events = POLLIN;
+            for (size_t i = 0; i < connections.size(); i++) {
+                fds[i + 1].fd = connections[i].fd;
+                fds[i + 1].events = POLLIN;
+            }
             
-            if (is_checkmate(current_player)) {
-                winner = (current_player == "white") ? "black" : "white";
-                break;
+            if (poll(&fds[0], fds.size(), 1000) < 0 && errno != EINTR) break;
+            
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listen_fd, NULL, NULL);
+                if (fd >= 0) connections.push_back(WorkerConnection(fd));
             }
             
-            if (is_stalemate(current_player)) {
-                winner = "draw";
-                break;
+            // Walk backwards so dropping a connection keeps earlier indices valid
+            for (size_t i = fds.size() - 1; i >= 1; i--) {
+                if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                
+                WorkerConnection& conn = connections[i - 1];
+                char chunk[65536];
+                ssize_t n = read(conn.fd, chunk, sizeof(chunk));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    drop_connection(i - 1);
+                    continue;
+                }
+                conn.buffer.append(chunk, n);
+                if (!process_messages(conn)) {
+                    cerr << "Coordinator: protocol error from worker " << conn.pid << endl;
+                    drop_connection(i - 1);
+                }
             }
             
-            string ai_name = (current_player == "white") ? 
-                "White AI (" + get_difficulty_name(difficulty_ai1) + ")" :
-                "Black AI (" + get_difficulty_name(difficulty_ai2) + ")";
-            int ai_diff = (current_player == "white") ? difficulty_ai1 : difficulty_ai2;
+            reap_children();
             
-            if (!play_ai_turn(ai_name, ai_diff)) {
-                winner = "draw";
-                break;
+            // Replace crashed workers while there is still work to hand out
+            int outstanding = (int)jobs.size() - completed - failed;
+            while (live_children < num_workers && live_children < outstanding) {
+                spawn_worker();
+                respawned++;
             }
             
-            current_player = (current_player == "white") ? "black" : "white";
-            move_count++;
+            for (size_t i = 0; i < connections.size() && !pending.empty(); i++) {
+                WorkerConnection& conn = connections[i];
+                if (!conn.ready || conn.job >= 0) continue;
+                
+                int job = pending.front();
+                pending.pop_front();
+                const GameJob& j = jobs[job];
+                string message = "JOB " + to_string(j.id) + " " + to_string(j.white_difficulty) + " " +
+                                 to_string(j.black_difficulty) + " " + to_string(j.seed) + " " +
+                                 j.opening + "\n";
+                conn.job = job;
+                if (!write_all(conn.fd, message)) {
+                    drop_connection(i);
+                    i--;
+                }
+            }
         }
         
-        if (move_count >= max_moves) {
-            winner = "draw";
+        for (size_t i = 0; i < connections.size(); i++) {
+            write_all(connections[i].fd, "QUIT\n");
+            close(connections[i].fd);
         }
+        connections.clear();
+        close(listen_fd);
+        unlink(socket_path.c_str());
         
-        display_board();
-        
-        cout << "\n" << string(50, '=') << endl;
-        if (winner == "white") {
-            cout << "   CHECKMATE! White AI Wins! ♔" << endl;
-            white_wins++;
-        } else if (winner == "black") {
-            cout << "   CHECKMATE! Black AI Wins! ♚" << endl;
-            black_wins++;
-        } else {
-            cout << "   DRAW! ½-½" << endl;
-            draws++;
+        while (live_children > 0 && wait(NULL) > 0) {
+            live_children--;
         }
-        cout << string(50, '=') << "\n" << endl;
-        
-        total_games++;
-        
-        generate_pgn();
-        
-        show_statistics();
+        return true;
     }
     
-    void show_statistics() const {
-        cout << "\n=== Game Statistics ===" << endl;
-        cout << "White AI Wins: " << white_wins << " ♔" << endl;
-        cout << "Black AI Wins: " << black_wins << " ♚" << endl;
-        cout << "Draws: " << draws << endl;
-        cout << "Total Games: " << total_games << endl;
-        
-        if (total_games > 0) {
-            cout << fixed << setprecision(1);
-            cout << "\nWhite Win Rate: " << (white_wins * 100.0 / total_games) << "%" << endl;
-            cout << "Black Win Rate: " << (black_wins * 100.0 / total_games) << "%" << endl;
-            cout << "Draw Rate: " << (draws * 100.0 / total_games) << "%" << endl;
-        }
-        cout << string(23, '=') << "\n" << endl;
+    const vector<JobResult>& get_results() const { return results; }
+    int get_failed() const { return failed; }
+    int get_respawned() const { return respawned; }
+};
+
+int run_coordinator(int num_workers, int num_games, int white_difficulty, int black_difficulty,
+                    size_t rotate_bytes) {
+    char path[108];
+    snprintf(path, sizeof(path), "/tmp/chess-coordinator-%ld.sock", (long)getpid());
+    
+    string filename = timestamped_filename("tournament", ".pgn");
+    PgnStreamWriter pgn_writer;
+    if (!pgn_writer.open(filename, rotate_bytes)) {
+        cerr << "Cannot write " << filename << endl;
+        return 1;
     }
     
-    void show_menu() const {
-        cout << "\n" << string(50, '=') << endl;
-        cout << "         ♔ ENHANCED CHESS AI vs AI ♚" << endl;
-        cout << string(50, '=') << endl;
-        cout << "1. Watch AI vs AI" << endl;
-        cout << "2. Set White AI Difficulty (Current: " << get_difficulty_name(difficulty_ai1) << ")" << endl;
-        cout << "3. Set Black AI Difficulty (Current: " << get_difficulty_name(difficulty_ai2) << ")" << endl;
-        cout << "4. Show Statistics" << endl;
-        cout << "5. View Last Game PGN" << endl;
-        cout << "6. Save Last Game to File" << endl;
-        cout << "7. Reset Statistics" << endl;
-        cout << "8. Exit" << endl;
-        cout << string(50, '=') << endl;
-        cout << "Enter your choice: ";
+    TournamentCoordinator coordinator(path, num_workers);
+    coordinator.set_pgn_writer(&pgn_writer);
+    random_device rd;
+    unsigned int base_seed = rd();
+    for (int g = 0; g < num_games; g++) {
+        coordinator.add_job(white_difficulty, black_difficulty, base_seed + g,
+                            TOURNAMENT_OPENINGS[g % NUM_TOURNAMENT_OPENINGS]);
     }
     
-    void run() {
-        bool running = true;
-        
-        while (running) {
-            show_menu();
-            
-            int choice;
-            if (!(cin >> choice)) {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid choice. Please try again." << endl;
-                this_thread::sleep_for(chrono::seconds(1));
-                continue;
-            }
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            
-            switch (choice) {
-                case 1:
-                    play_ai_vs_ai();
-                    cout << "\nPress Enter to continue...";
-                    cin.get();
-                    break;
-                    
-                case 2: {
-                    int diff;
-                    cout << "Enter difficulty (1=Easy, 2=Medium, 3=Hard): ";
-                    if (cin >> diff) {
-                        difficulty_ai1 = max(1, min(3, diff));
-                        cout << "White AI difficulty set to " << get_difficulty_name(difficulty_ai1) << endl;
-                    } else {
-                        cin.clear();
-                        cout << "Invalid input." << endl;
-                    }
-                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    this_thread::sleep_for(chrono::seconds(1));
-                    break;
-                }
-                    
-                case 3: {
-                    int diff;
-                    cout << "Enter difficulty (1=Easy, 2=Medium, 3=Hard): ";
-                    if (cin >> diff) {
-                        difficulty_ai2 = max(1, min(3, diff));
-                        cout << "Black AI difficulty set to " << get_difficulty_name(difficulty_ai2) << endl;
-                    } else {
-                        cin.clear();
-                        cout << "Invalid input." << endl;
-                    }
-                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    this_thread::sleep_for(chrono::seconds(1));
-                    break;
-                }
-                    
-                case 4:
-                    show_statistics();
-                    cout << "\nPress Enter to continue...";
-                    cin.get();
-                    break;
-                    
-                case 5:
-                    show_last_game_pgn();
-                    cout << "\nPress Enter to continue...";
-                    cin.get();
-                    break;
-                    
-                case 6:
-                    save_pgn_to_file();
-                    this_thread::sleep_for(chrono::seconds(2));
-                    break;
-                    
-                case 7:
-                    white_wins = 0;
-                    black_wins = 0;
-                    draws = 0;
-                    total_games = 0;
-                    cout << "Statistics reset!" << endl;
-                    this_thread::sleep_for(chrono::seconds(1));
-                    break;
-                    
-                case 8:
-                    running = false;
-                    cout << "\nThanks for watching! ♟" << endl;
-                    break;
-                    
-                default:
-                    cout << "Invalid choice. Please try again." << endl;
-                    this_thread::sleep_for(chrono::seconds(1));
-            }
+    cout << "Coordinating " << num_games << " games across " << num_workers 
+         << " worker process(es) on " << path << "..." << endl;
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool ran = coordinator.run();
+    bool written = pgn_writer.close();
+    if (!ran) return 1;
+    
+    TournamentSummary summary;
+    summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    const vector<JobResult>& results = coordinator.get_results();
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].winner == "white") summary.white_wins++;
+        else if (results[i].winner == "black") summary.black_wins++;
+        else summary.draws++;
+        summary.total_moves += results[i].moves;
+        summary.games++;
+    }
+    
+    print_tournament_summary(summary);
+    if (coordinator.get_respawned() > 0 || coordinator.get_failed() > 0) {
+        cout << "Workers respawned: " << coordinator.get_respawned() 
+             << ", jobs failed: " << coordinator.get_failed() << endl;
+    }
+    if (!written) {
+        cerr << "Cannot write " << filename << endl;
+        return 1;
+    }
+    const vector<string>& files = pgn_writer.get_files();
+    for (size_t i = 0; i < files.size(); i++) {
+        cout << "✓ Games saved to: " << files[i] << endl;
+    }
+    return 0;
+}
+
+#endif
+
+int main(int argc, char* argv[]) {
+    init_piece_square_tables();
+    init_material_table();
+    
+    size_t tt_megabytes = 16;
+    string shared_tt_name;
+    string evaluator = "classical";
+    string nnue_file = "nnue.bin";
+    string params_file;
+    size_t pgn_rotate_mb = 0;
+    string index_file;
+    string book_file;
+    string own_book_file;
+    string learn_book_file;
+    string tablebase_dir;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--tt-mb" && i + 1 < argc) {
+            tt_megabytes = max(1, atoi(argv[++i]));
+        } else if (arg == "--shared-tt" && i + 1 < argc) {
+            shared_tt_name = argv[++i];
+        } else if (arg == "--eval" && i + 1 < argc) {
+            evaluator = argv[++i];
+        } else if (arg == "--nnue-file" && i + 1 < argc) {
+            nnue_file = argv[++i];
+        } else if (arg == "--params" && i + 1 < argc) {
+            params_file = argv[++i];
+        } else if (arg == "--book" && i + 1 < argc) {
+            book_file = argv[++i];
+        } else if (arg == "--book-depth" && i + 1 < argc) {
+            BOOK_DEPTH = max(0, atoi(argv[++i]));
+        } else if (arg == "--learn-book-depth" && i + 1 < argc) {
+            LEARNED_BOOK_DEPTH = max(1, atoi(argv[++i]));
+        } else if (arg == "--book-min-games" && i + 1 < argc) {
+            BOOK_MIN_GAMES = max(1, atoi(argv[++i]));
+        } else if (arg == "--own-book" && i + 1 < argc) {
+            own_book_file = argv[++i];
+        } else if (arg == "--learn-book" && i + 1 < argc) {
+            learn_book_file = argv[++i];
+        } else if (arg == "--tablebase" && i + 1 < argc) {
+            tablebase_dir = argv[++i];
+        } else if (arg == "--tb-pieces" && i + 1 < argc) {
+            TB_PROBE_LIMIT = max(0, atoi(argv[++i]));
+        } else if (arg == "--position-index" && i + 1 < argc) {
+            index_file = argv[++i];
+        } else if (arg == "--pgn-rotate-mb" && i + 1 < argc) {
+            pgn_rotate_mb = (size_t)max(0, atoi(argv[++i]));
+        } else {
+            args.push_back(arg);
         }
     }
-};
+    
+    if (!params_file.empty()) {
+        vector<int> values;
+        string error;
+        if (!load_eval_params(params_file, values, error)) {
+            cerr << "Cannot load evaluation parameters: " << error << endl;
+            return 1;
+        }
+        apply_eval_params(values);
+    }
+    if (!book_file.empty()) {
+        string error;
+        if (!POLYGLOT_BOOK.open(book_file, error)) {
+            cerr << "Cannot load opening book: " << error << endl;
+            return 1;
+        }
+    }
+    // A book being learned is also played from, once it exists
+    BookLearner learner;
+    if (!learn_book_file.empty()) {
+        if (!learner.open(learn_book_file, LEARNED_BOOK_DEPTH, BOOK_MIN_GAMES)) {
+            cerr << "Cannot learn into " << learn_book_file << ": not a learned book" << endl;
+            return 1;
+        }
+        if (own_book_file.empty() && learner.get_playable() > 0) own_book_file = learn_book_file;
+    }
+    if (!own_book_file.empty() && !LEARNED_BOOK.open(own_book_file)) {
+        cerr << "Cannot load learned book " << own_book_file << endl;
+        return 1;
+    }
+    if (!tablebase_dir.empty()) {
+        string error;
+        if (!TABLEBASE.open(tablebase_dir, error)) {
+            cerr << "Cannot load endgame tables: " << error << endl;
+            return 1;
+        }
+    }
+    if (!index_file.empty() && !POSITION_INDEX.open(index_file)) {
+        cerr << "Cannot load position index " << index_file << endl;
+        return 1;
+    }
+    if (evaluator == "nnue") {
+        if (NNUE.load(nnue_file)) {
+            ACTIVE_EVALUATOR = EVALUATOR_NNUE;
+        } else {
+            cerr << "Cannot load NNUE weights from " << nnue_file 
+                 << ", using the classical evaluation" << endl;
+        }
+    }
+    if (!args.empty() && args[0] == "--check-simd") {
+        return run_simd_eval_check(args.size() >= 2 ? max(1, atoi(args[1].c_str())) : 10000);
+    }
+    if (args.size() >= 3 && args[0] == "--tune") {
+        return run_texel_tuning(args[1], args[2], args.size() >= 4 ? max(1, atoi(args[3].c_str())) : 300);
+    }
+    if (args.size() >= 2 && args[0] == "--bench-epd") {
+        return run_epd_benchmark(args[1]);
+    }
+    if (args.size() >= 2 && args[0] == "--read-pgn") {
+        return run_pgn_reader(args[1]);
+    }
+    if (args.size() >= 3 && args[0] == "--record-games") {
+        int white_difficulty = (args.size() >= 5) ? max(1, min(3, atoi(args[3].c_str()))) : 2;
+        int black_difficulty = (args.size() >= 5) ? max(1, min(3, atoi(args[4].c_str()))) : 2;
+        return run_game_recorder(max(1, atoi(args[1].c_str())), args[2], 
+                                 white_difficulty, black_difficulty, pgn_rotate_mb << 20, 
+                                 learn_book_file.empty() ? NULL : &learner);
+    }
+    if (args.size() >= 3 && args[0] == "--games-to-pgn") {
+        return convert_games_to_pgn(args[1], args[2], 
+                                    args.size() >= 4 ? (size_t)atol(args[3].c_str()) : 0,
+                                    args.size() >= 5 ? (size_t)atol(args[4].c_str()) : (size_t)-1);
+    }
+    if (args.size() >= 3 && args[0] == "--pgn-to-games") {
+        return convert_pgn_to_games(args[1], args[2]);
+    }
+    if (args.size() >= 3 && args[0] == "--build-index") {
+        return build_position_index(args[1], args[2], 
+                                    args.size() >= 4 ? max(1, atoi(args[3].c_str())) : 40);
+    }
+    if (!args.empty() && args[0] == "--check-tables") {
+        return run_tablebase_check();
+    }
+    if (args.size() >= 2 && args[0] == "--probe-tables") {
+        return probe_endgame_tables(args[1]);
+    }
+    if (args.size() >= 3 && args[0] == "--build-book") {
+        return build_learned_book(args[1], args[2], LEARNED_BOOK_DEPTH, BOOK_MIN_GAMES);
+    }
+    if (!args.empty() && args[0] == "--probe-own-book") {
+        return probe_learned_book(args.size() >= 2 ? args[1] : string());
+    }
+    if (!args.empty() && args[0] == "--probe-book") {
+        return probe_polyglot_book(args.size() >= 2 ? args[1] : string());
+    }
+    if (args.size() >= 2 && args[0] == "--probe-index") {
+        return probe_position_index(args[1], args.size() >= 3 ? args[2] : string());
+    }
+    if (!args.empty() && args[0] == "--bench-batch") {
+        return run_batch_eval_benchmark(args.size() >= 2 ? max(1, atoi(args[1].c_str())) : 20000);
+    }
+
+#ifndef _WIN32
+    if (!shared_tt_name.empty()) {
+        if (!TT.attach_shared(shared_tt_name, tt_megabytes)) {
+            cerr << "Cannot attach shared transposition table " << shared_tt_name 
+                 << ", using a private one" << endl;
+            TT.resize(tt_megabytes);
+        }
+    } else {
+        TT.resize(tt_megabytes);
+    }
+    
+    if (args.size() >= 2 && args[0] == "--worker") {
+        return run_worker(args[1]);
+    }
+    if (args.size() >= 3 && args[0] == "--coordinator") {
+        int white_difficulty = (args.size() >= 5) ? max(1, min(3, atoi(args[3].c_str()))) : 2;
+        int black_difficulty = (args.size() >= 5) ? max(1, min(3, atoi(args[4].c_str()))) : 2;
+        return run_coordinator(atoi(args[1].c_str()), atoi(args[2].c_str()), 
+                               white_difficulty, black_difficulty, pgn_rotate_mb << 20);
+    }
+#else
+    TT.resize(tt_megabytes);
+#endif
 
-int main() {
     Chess game;
     game.run();
     return 0;